@@ -2,6 +2,7 @@
 // Build: gcc server.c -o server -pthread
 // Usage: ./server [port] [webroot]
 // Example: ./server 8080 ./www
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,12 +20,19 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 
 
 #define DEFAULT_PORT 8080
 #define DEFAULT_WEBROOT "./www"
 #define BUFFER_SIZE 8192
+#define DIR_CACHE_SLOTS 32        // directories whose listing is kept in memory
+#define DIR_READ_BATCH 65536      // bytes per getdents64 call
+#define LISTING_PER_PAGE 100      // default page size when ?page= is given
+#define LISTING_MAX_PER_PAGE 10000
+#define TEMPLATE_DIR "/templates"     // page templates under the webroot, never served as files
+#define TEMPLATE_MAX_SEGMENTS 32      // static chunks plus {{field}} slots per template
 
 int server_socket = -1;
 volatile int running = 1;
@@ -188,63 +196,545 @@ void send_file_response(int client_socket, const char* file_path) {
     close(fd);
 }
 
-// Send generated directory listing as HTML
-void send_directory_listing(int client_socket, const char* dirpath, const char* uri) {
-    DIR *d = opendir(dirpath);
-    if (!d) {
-        // 403 or 404
-        send_error_response(client_socket, 404, "Not Found", ".");
-        return;
+// One directory entry of a cached listing
+typedef struct {
+    const char *name;       // points into the listing's name blob
+    int is_dir;
+    off_t size;
+    time_t mtime;
+} dir_entry_t;
+
+// Sorted listing of one directory, valid while the directory's mtime is unchanged
+typedef struct {
+    char path[PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    dir_entry_t *entries;
+    size_t count;
+    char *names;
+    int refs;               // cache slot + requests currently streaming it
+    unsigned long last_used;
+} dir_listing_t;
+
+pthread_mutex_t dir_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+dir_listing_t *dir_cache[DIR_CACHE_SLOTS];
+unsigned long dir_cache_clock = 0;
+
+static void listing_release(dir_listing_t *listing) {
+    pthread_mutex_lock(&dir_cache_lock);
+    int refs = --listing->refs;
+    pthread_mutex_unlock(&dir_cache_lock);
+    if (refs > 0) return;
+    free(listing->entries);
+    free(listing->names);
+    free(listing);
+}
+
+// Directories first, then by name
+static int compare_entries(const void *a, const void *b) {
+    const dir_entry_t *x = a, *y = b;
+    if (x->is_dir != y->is_dir) return y->is_dir - x->is_dir;
+    return strcmp(x->name, y->name);
+}
+
+// Reads a directory with getdents64 batches and sorts it
+static dir_listing_t *build_listing(int dirfd, const char *dirpath, const struct stat *dir_st) {
+    dir_listing_t *listing = calloc(1, sizeof(*listing));
+    if (!listing) return NULL;
+    snprintf(listing->path, sizeof(listing->path), "%s", dirpath);
+    listing->dev = dir_st->st_dev;
+    listing->ino = dir_st->st_ino;
+    listing->mtime = dir_st->st_mtim;
+    listing->refs = 1;
+
+    char *batch = malloc(DIR_READ_BATCH);
+    size_t names_len = 0, names_cap = 0, entries_cap = 0;
+    size_t *name_offsets = NULL;
+    ssize_t n;
+
+    while (batch && (n = getdents64(dirfd, batch, DIR_READ_BATCH)) > 0) {
+        for (ssize_t pos = 0; pos < n; ) {
+            struct dirent64 *ent = (struct dirent64 *)(batch + pos);
+            pos += ent->d_reclen;
+            if (strcmp(ent->d_name, ".") == 0) continue;
+
+            size_t len = strlen(ent->d_name) + 1;
+            if (names_len + len > names_cap) {
+                names_cap = names_cap ? names_cap * 2 : 4096;
+                while (names_cap < names_len + len) names_cap *= 2;
+                char *grown = realloc(listing->names, names_cap);
+                if (!grown) goto fail;
+                listing->names = grown;
+            }
+            if (listing->count == entries_cap) {
+                entries_cap = entries_cap ? entries_cap * 2 : 64;
+                dir_entry_t *grown = realloc(listing->entries, entries_cap * sizeof(dir_entry_t));
+                size_t *grown_offsets = realloc(name_offsets, entries_cap * sizeof(size_t));
+                if (grown) listing->entries = grown;
+                if (grown_offsets) name_offsets = grown_offsets;
+                if (!grown || !grown_offsets) goto fail;
+            }
+
+            // size/mtime come from one fstatat per entry, paid once per directory change
+            dir_entry_t *entry = &listing->entries[listing->count];
+            struct stat st;
+            memset(entry, 0, sizeof(*entry));
+            if (fstatat(dirfd, ent->d_name, &st, 0) == 0) {
+                entry->is_dir = S_ISDIR(st.st_mode);
+                entry->size = st.st_size;
+                entry->mtime = st.st_mtime;
+            } else {
+                entry->is_dir = ent->d_type == DT_DIR;
+            }
+            memcpy(listing->names + names_len, ent->d_name, len);
+            name_offsets[listing->count++] = names_len;
+            names_len += len;
+        }
     }
+    if (!batch || n < 0) goto fail;
 
-    char header[BUFFER_SIZE];
-    char body[BUFFER_SIZE*4];
-    size_t offset = 0;
-    offset += snprintf(body + offset, sizeof(body) - offset,
-        "<!doctype html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width,initial-scale=1'><title>Index of %s</title>"
-        "<style>body{font-family:Segoe UI,Roboto,Arial;background:#0D1117;color:#c9d1d9;padding:20px}a{color:#58a6ff}</style></head><body><h1>Index of %s</h1><ul>",
-        uri, uri);
+    // names may have moved while growing: resolve pointers once the blob is final
+    for (size_t i = 0; i < listing->count; i++) {
+        listing->entries[i].name = listing->names + name_offsets[i];
+    }
+    qsort(listing->entries, listing->count, sizeof(dir_entry_t), compare_entries);
+    free(name_offsets);
+    free(batch);
+    return listing;
+
+fail:
+    free(name_offsets);
+    free(batch);
+    free(listing->entries);
+    free(listing->names);
+    free(listing);
+    return NULL;
+}
 
-    struct dirent *ent;
-    while ((ent = readdir(d)) != NULL) {
-        // skip . and ..
-        if (strcmp(ent->d_name, ".") == 0) continue;
-        char name_esc[PATH_MAX];
-        // naive escape: only replace spaces for display
-        for (size_t i=0; i<strlen(ent->d_name) && i < sizeof(name_esc)-1; ++i) name_esc[i] = ent->d_name[i];
-        name_esc[strlen(ent->d_name)] = '\0';
+// Returns a referenced listing for dirpath, rebuilding it if the directory changed
+static dir_listing_t *get_listing(const char *dirpath) {
+    int dirfd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) return NULL;
+    struct stat st;
+    if (fstat(dirfd, &st) == -1) {
+        close(dirfd);
+        return NULL;
+    }
 
-        // build link: uri + "/" + ent->d_name (careful with trailing slash)
-        char link[PATH_MAX];
-        if (uri[strlen(uri)-1] == '/') snprintf(link, sizeof(link), "%s%s", uri, ent->d_name);
-        else snprintf(link, sizeof(link), "%s/%s", uri, ent->d_name);
+    pthread_mutex_lock(&dir_cache_lock);
+    for (int i = 0; i < DIR_CACHE_SLOTS; i++) {
+        dir_listing_t *cached = dir_cache[i];
+        if (cached && cached->dev == st.st_dev && cached->ino == st.st_ino &&
+            cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+            strcmp(cached->path, dirpath) == 0) {
+            cached->refs++;
+            cached->last_used = ++dir_cache_clock;
+            pthread_mutex_unlock(&dir_cache_lock);
+            close(dirfd);
+            return cached;
+        }
+    }
+    pthread_mutex_unlock(&dir_cache_lock);
+
+    dir_listing_t *listing = build_listing(dirfd, dirpath, &st);
+    close(dirfd);
+    if (!listing) return NULL;
+
+    // Replace a stale entry for the same path, else the least recently used slot
+    pthread_mutex_lock(&dir_cache_lock);
+    int slot = 0;
+    for (int i = 0; i < DIR_CACHE_SLOTS; i++) {
+        if (dir_cache[i] && strcmp(dir_cache[i]->path, dirpath) == 0) {
+            slot = i;
+            break;
+        }
+        if (!dir_cache[i] || (dir_cache[slot] && dir_cache[i]->last_used < dir_cache[slot]->last_used)) {
+            slot = i;
+        }
+    }
+    dir_listing_t *evicted = dir_cache[slot];
+    listing->refs++;
+    listing->last_used = ++dir_cache_clock;
+    dir_cache[slot] = listing;
+    pthread_mutex_unlock(&dir_cache_lock);
+
+    if (evicted) listing_release(evicted);
+    return listing;
+}
 
-        offset += snprintf(body + offset, sizeof(body) - offset,
-                           "<li><a href=\"%s\">%s</a></li>",
-                           link, name_esc);
+// Buffered response writer; uses chunked transfer encoding for HTTP/1.1 clients
+typedef struct {
+    int client_socket;
+    int chunked;
+    int failed;
+    size_t len;
+    char buf[BUFFER_SIZE * 2];
+} stream_writer_t;
+
+static void writer_flush(stream_writer_t *w) {
+    if (w->len == 0 || w->failed) return;
+    char size_line[32];
+    int size_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", w->len);
+    if ((w->chunked && send(w->client_socket, size_line, size_len, MSG_NOSIGNAL) <= 0) ||
+        send(w->client_socket, w->buf, w->len, MSG_NOSIGNAL) <= 0 ||
+        (w->chunked && send(w->client_socket, "\r\n", 2, MSG_NOSIGNAL) <= 0)) {
+        w->failed = 1;
+    }
+    w->len = 0;
+}
 
-        if (offset > sizeof(body) - 200) break; // prevent overflow
+static void writer_write(stream_writer_t *w, const char *data, size_t len) {
+    while (len > 0 && !w->failed) {
+        size_t room = sizeof(w->buf) - w->len;
+        size_t n = len < room ? len : room;
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+        if (w->len == sizeof(w->buf)) writer_flush(w);
     }
-    closedir(d);
+}
+
+static void writer_puts(stream_writer_t *w, const char *s) {
+    writer_write(w, s, strlen(s));
+}
 
-    offset += snprintf(body + offset, sizeof(body) - offset, "</ul><hr><a href=\"/\">Home</a></body></html>");
+static void writer_printf(stream_writer_t *w, const char *fmt, ...) {
+    char tmp[BUFFER_SIZE];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n > 0) writer_write(w, tmp, (size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1);
+}
 
+static void writer_finish(stream_writer_t *w) {
+    writer_flush(w);
+    if (w->chunked && !w->failed) send(w->client_socket, "0\r\n\r\n", 5, MSG_NOSIGNAL);
+}
+
+static void write_html_escaped(stream_writer_t *w, const char *s) {
+    for (; *s; s++) {
+        switch (*s) {
+            case '&': writer_puts(w, "&amp;"); break;
+            case '<': writer_puts(w, "&lt;"); break;
+            case '>': writer_puts(w, "&gt;"); break;
+            case '"': writer_puts(w, "&quot;"); break;
+            case '\'': writer_puts(w, "&#39;"); break;
+            default: writer_write(w, s, 1);
+        }
+    }
+}
+
+// Percent-encodes a path for use in an href ('/' is kept)
+static void write_url_encoded(stream_writer_t *w, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (isalnum(c) || strchr("/-_.~", c)) {
+            writer_write(w, s, 1);
+        } else {
+            writer_printf(w, "%%%02X", c);
+        }
+    }
+}
+
+static void write_json_string(stream_writer_t *w, const char *s) {
+    writer_puts(w, "\"");
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            writer_puts(w, "\\");
+            writer_write(w, s, 1);
+        } else if (c < 0x20) {
+            writer_printf(w, "\\u%04x", c);
+        } else {
+            writer_write(w, s, 1);
+        }
+    }
+    writer_puts(w, "\"");
+}
+
+// Reads ?name=value from a query string into out (empty if absent)
+static void get_query_param(const char *query, const char *name, char *out, size_t out_len) {
+    size_t name_len = strlen(name);
+    out[0] = '\0';
+    while (query && *query) {
+        const char *end = strchr(query, '&');
+        size_t len = end ? (size_t)(end - query) : strlen(query);
+        if (len > name_len && strncmp(query, name, name_len) == 0 && query[name_len] == '=') {
+            size_t value_len = len - name_len - 1;
+            if (value_len >= out_len) value_len = out_len - 1;
+            memcpy(out, query + name_len + 1, value_len);
+            out[value_len] = '\0';
+            return;
+        }
+        query = end ? end + 1 : NULL;
+    }
+}
+
+// Send generated directory listing (HTML, or JSON with ?format=json), optionally
+// paginated with ?page=N&per_page=M. The sorted listing is cached per directory
+// and streamed, so large directories are neither truncated nor re-read.
+void send_directory_listing(int client_socket, const char* dirpath, const char* uri,
+                            const char *query, int chunked) {
+    dir_listing_t *listing = get_listing(dirpath);
+    if (!listing) {
+        // 403 or 404
+        send_error_response(client_socket, 404, "Not Found", ".");
+        return;
+    }
+
+    char param[32];
+    get_query_param(query, "format", param, sizeof(param));
+    int json = strcmp(param, "json") == 0;
+
+    size_t first = 0, last = listing->count;
+    long page = 0, per_page = 0, pages = 1;
+    get_query_param(query, "page", param, sizeof(param));
+    if (param[0]) {
+        page = strtol(param, NULL, 10);
+        get_query_param(query, "per_page", param, sizeof(param));
+        per_page = param[0] ? strtol(param, NULL, 10) : LISTING_PER_PAGE;
+        if (page < 1) page = 1;
+        if (per_page < 1 || per_page > LISTING_MAX_PER_PAGE) per_page = LISTING_PER_PAGE;
+        pages = ((long)listing->count + per_page - 1) / per_page;
+        if (pages < 1) pages = 1;
+        first = (size_t)(page - 1) * per_page;
+        if (first > listing->count) first = listing->count;
+        if (last - first > (size_t)per_page) last = first + per_page;
+    }
+
+    char header[BUFFER_SIZE];
     int header_len = snprintf(header, sizeof(header),
               "HTTP/1.1 200 OK\r\n"
-              "Content-Type: text/html; charset=utf-8\r\n"
-              "Content-Length: %zu\r\n"
+              "Content-Type: %s\r\n"
+              "%s"
               "Connection: close\r\n"
               "Server: Simple-C-Server/1.1\r\n"
               "\r\n",
-              strlen(body));
+              json ? "application/json" : "text/html; charset=utf-8",
+              chunked ? "Transfer-Encoding: chunked\r\n" : "");
+    send(client_socket, header, header_len, MSG_NOSIGNAL);
 
-    send(client_socket, header, header_len, 0);
-    send(client_socket, body, strlen(body), 0);
+    stream_writer_t *w = malloc(sizeof(*w));
+    if (!w) {
+        listing_release(listing);
+        return;
+    }
+    w->client_socket = client_socket;
+    w->chunked = chunked;
+    w->failed = 0;
+    w->len = 0;
+
+    if (json) {
+        writer_puts(w, "{\"path\":");
+        write_json_string(w, uri);
+        writer_printf(w, ",\"total\":%zu,\"page\":%ld,\"pages\":%ld,\"entries\":[", listing->count, page ? page : 1, pages);
+        for (size_t i = first; i < last && !w->failed; i++) {
+            dir_entry_t *e = &listing->entries[i];
+            writer_puts(w, i > first ? ",{\"name\":" : "{\"name\":");
+            write_json_string(w, e->name);
+            writer_printf(w, ",\"type\":\"%s\",\"size\":%jd,\"mtime\":%jd}",
+                          e->is_dir ? "dir" : "file", (intmax_t)e->size, (intmax_t)e->mtime);
+        }
+        writer_puts(w, "]}");
+    } else {
+        writer_puts(w, "<!doctype html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width,initial-scale=1'><title>Index of ");
+        write_html_escaped(w, uri);
+        writer_puts(w, "</title><style>body{font-family:Segoe UI,Roboto,Arial;background:#0D1117;color:#c9d1d9;padding:20px}a{color:#58a6ff}</style></head><body><h1>Index of ");
+        write_html_escaped(w, uri);
+        writer_puts(w, "</h1><ul>");
+
+        // build link: uri + "/" + name (careful with trailing slash)
+        int needs_slash = uri[strlen(uri) - 1] != '/';
+        for (size_t i = first; i < last && !w->failed; i++) {
+            dir_entry_t *e = &listing->entries[i];
+            writer_puts(w, "<li><a href=\"");
+            write_url_encoded(w, uri);
+            if (needs_slash) writer_puts(w, "/");
+            write_url_encoded(w, e->name);
+            if (e->is_dir) writer_puts(w, "/");
+            writer_puts(w, "\">");
+            write_html_escaped(w, e->name);
+            writer_puts(w, e->is_dir ? "/</a></li>" : "</a></li>");
+        }
+        writer_puts(w, "</ul>");
+
+        if (page) {
+            writer_printf(w, "<p>Page %ld of %ld (%zu entries)", page, pages, listing->count);
+            if (page > 1) writer_printf(w, " <a href=\"?page=%ld&amp;per_page=%ld\">Previous</a>", page - 1, per_page);
+            if (page < pages) writer_printf(w, " <a href=\"?page=%ld&amp;per_page=%ld\">Next</a>", page + 1, per_page);
+            writer_puts(w, "</p>");
+        }
+        writer_puts(w, "<hr><a href=\"/\">Home</a></body></html>");
+    }
+    writer_finish(w);
+
+    free(w);
+    listing_release(listing);
+}
+
+// Page template compiled once at startup: the static text is kept as
+// chunks and each {{field}} becomes a slot filled per request
+typedef struct {
+    const char *text;   // static chunk, NULL for a slot
+    size_t len;
+    int field;          // slot: index into the page's field list
+} template_segment_t;
+
+typedef struct {
+    char *source;       // file contents, which the chunks point into
+    size_t static_len;
+    int count;
+    template_segment_t segments[TEMPLATE_MAX_SEGMENTS];
+} page_template_t;
+
+enum { STATUS_UPTIME, STATUS_REQUESTS, STATUS_ACTIVE, STATUS_FIELD_COUNT };
+static const char *const status_fields[STATUS_FIELD_COUNT] = { "uptime", "requests", "active" };
+static page_template_t *status_template = NULL;
+
+static int template_add(page_template_t *t, const char *text, size_t len, int field) {
+    if (text && len == 0) return 0;
+    if (t->count == TEMPLATE_MAX_SEGMENTS) return -1;
+    t->segments[t->count].text = text;
+    t->segments[t->count].len = len;
+    t->segments[t->count].field = field;
+    t->count++;
+    if (text) t->static_len += len;
+    return 0;
+}
+
+// Reads webroot/templates/name and splits it into chunks and slots.
+// Returns NULL (after saying why) if it is missing or names an unknown field.
+static page_template_t *template_load(const char *webroot, const char *name,
+                                      const char *const *fields, int field_count) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s/%s", webroot, TEMPLATE_DIR, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Template %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    page_template_t *t = calloc(1, sizeof(page_template_t));
+    struct stat st;
+    if (!t || fstat(fileno(f), &st) < 0 || !(t->source = malloc(st.st_size + 1)) ||
+        fread(t->source, 1, st.st_size, f) != (size_t)st.st_size) {
+        fprintf(stderr, "Template %s: read failed\n", path);
+        goto fail;
+    }
+    t->source[st.st_size] = '\0';
+
+    const char *text = t->source;
+    const char *open;
+    while ((open = strstr(text, "{{")) != NULL) {
+        const char *close = strstr(open + 2, "}}");
+        int field = -1;
+        for (int i = 0; close && i < field_count; i++) {
+            size_t len = strlen(fields[i]);
+            if ((size_t)(close - open - 2) == len && strncmp(open + 2, fields[i], len) == 0) field = i;
+        }
+        if (field < 0) {
+            fprintf(stderr, "Template %s: unknown or unterminated placeholder at offset %ld\n",
+                    path, (long)(open - t->source));
+            goto fail;
+        }
+        if (template_add(t, text, open - text, -1) < 0 || template_add(t, NULL, 0, field) < 0) {
+            fprintf(stderr, "Template %s: more than %d segments\n", path, TEMPLATE_MAX_SEGMENTS);
+            goto fail;
+        }
+        text = close + 2;
+    }
+    if (template_add(t, text, strlen(text), -1) < 0) {
+        fprintf(stderr, "Template %s: more than %d segments\n", path, TEMPLATE_MAX_SEGMENTS);
+        goto fail;
+    }
+    fclose(f);
+    return t;
+
+fail:
+    fclose(f);
+    if (t) free(t->source);
+    free(t);
+    return NULL;
+}
+
+// Copies s into out with markup characters escaped; returns the length
+static size_t html_escape(const char *s, char *out, size_t out_len) {
+    size_t n = 0;
+    for (; *s; s++) {
+        const char *entity = NULL;
+        switch (*s) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&#39;"; break;
+        }
+        size_t len = entity ? strlen(entity) : 1;
+        if (n + len >= out_len) break;
+        memcpy(out + n, entity ? entity : s, len);
+        n += len;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Sends the header, the template's static chunks and the escaped values
+// in one writev() scatter list, looping over partial writes
+static void template_send(int client_socket, const page_template_t *t, const char *const *values) {
+    struct iovec iov[TEMPLATE_MAX_SEGMENTS + 1];
+    char escaped[BUFFER_SIZE];
+    size_t used = 0;
+    size_t body_len = t->static_len;
+
+    for (int i = 0; i < t->count; i++) {
+        const template_segment_t *seg = &t->segments[i];
+        if (seg->text) {
+            iov[i + 1].iov_base = (void *)seg->text;
+            iov[i + 1].iov_len = seg->len;
+        } else {
+            size_t len = html_escape(values[seg->field], escaped + used, sizeof(escaped) - used);
+            iov[i + 1].iov_base = escaped + used;
+            iov[i + 1].iov_len = len;
+            used += len + 1;
+            if (used >= sizeof(escaped)) used = sizeof(escaped) - 1;
+            body_len += len;
+        }
+    }
+
+    char header[512];
+    int header_len = snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\n"
+             "Content-Type: text/html; charset=utf-8\r\n"
+             "Content-Length: %zu\r\n"
+             "Connection: close\r\n"
+             "Server: Simple-C-Server/1.1\r\n"
+             "\r\n",
+             body_len);
+    iov[0].iov_base = header;
+    iov[0].iov_len = header_len;
+
+    struct iovec *next = iov;
+    int left = t->count + 1;
+    while (left > 0) {
+        ssize_t sent = writev(client_socket, next, left);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return;
+        while (left > 0 && (size_t)sent >= next->iov_len) {
+            sent -= next->iov_len;
+            next++;
+            left--;
+        }
+        if (left > 0) {
+            next->iov_base = (char *)next->iov_base + sent;
+            next->iov_len -= sent;
+        }
+    }
 }
 
 // Serve /status endpoint with simple stats page
 void send_status_page(int client_socket) {
-    char body[BUFFER_SIZE];
     time_t now = time(NULL);
     time_t uptime = now - server_start_time;
 
@@ -253,34 +743,20 @@ void send_status_page(int client_socket) {
     long active = active_connections;
     pthread_mutex_unlock(&stats_lock);
 
-    char upstr[128];
+    char upstr[128], reqstr[24], activestr[24];
     int days = uptime / 86400;
     int hours = (uptime % 86400) / 3600;
     int mins = (uptime % 3600) / 60;
     int secs = uptime % 60;
     snprintf(upstr, sizeof(upstr), "%dd %dh %dm %ds", days, hours, mins, secs);
-
-    int blen = snprintf(body, sizeof(body),
-        "<!doctype html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width,initial-scale=1'><title>Server Status</title>"
-        "<style>body{font-family:Segoe UI,Roboto,Arial;background:#0D1117;color:#c9d1d9;padding:20px} .card{background:#161b22;padding:20px;border-radius:8px;border:1px solid #30363d;max-width:700px} h1{color:#58a6ff}</style></head><body><div class='card'><h1>Server Status</h1>"
-        "<p><strong>Uptime:</strong> %s</p>"
-        "<p><strong>Total requests:</strong> %ld</p>"
-        "<p><strong>Active connections:</strong> %ld</p>"
-        "<p><a href='/'>Home</a></p></div></body></html>",
-        upstr, req, active);
-
-    char header[BUFFER_SIZE];
-    int header_len = snprintf(header, sizeof(header),
-             "HTTP/1.1 200 OK\r\n"
-             "Content-Type: text/html; charset=utf-8\r\n"
-             "Content-Length: %d\r\n"
-             "Connection: close\r\n"
-             "Server: Simple-C-Server/1.1\r\n"
-             "\r\n",
-             blen);
-
-    send(client_socket, header, header_len, 0);
-    send(client_socket, body, blen, 0);
+    snprintf(reqstr, sizeof(reqstr), "%ld", req);
+    snprintf(activestr, sizeof(activestr), "%ld", active);
+
+    const char *values[STATUS_FIELD_COUNT];
+    values[STATUS_UPTIME] = upstr;
+    values[STATUS_REQUESTS] = reqstr;
+    values[STATUS_ACTIVE] = activestr;
+    template_send(client_socket, status_template, values);
 }
 
 // Thread worker argument
@@ -345,6 +821,15 @@ void *worker_thread(void *arg) {
         return NULL;
     }
 
+    // split off the query string (used by directory listings)
+    const char *query = "";
+    char *question = strchr(uri, '?');
+    if (question) {
+        *question = '\0';
+        query = question + 1;
+    }
+    int chunked = strcmp(protocol, "HTTP/1.1") == 0;
+
     // decode URL into path (decoded buffer is PATH_MAX)
     char decoded[PATH_MAX];
     urldecode(decoded, uri);
@@ -358,6 +843,17 @@ void *worker_thread(void *arg) {
         return NULL;
     }
 
+    // page templates are only ever served rendered
+    size_t template_dir_len = strlen(TEMPLATE_DIR);
+    if (strncmp(decoded, TEMPLATE_DIR, template_dir_len) == 0 &&
+        (decoded[template_dir_len] == '\0' || decoded[template_dir_len] == '/')) {
+        send_error_response(client_socket, 404, "Not Found", w->webroot);
+        close(client_socket);
+        pthread_mutex_lock(&stats_lock); active_connections--; pthread_mutex_unlock(&stats_lock);
+        free(w);
+        return NULL;
+    }
+
     // map "/" to "/index.html"
     if (strcmp(decoded, "/") == 0) strcpy(decoded, "/index.html");
 
@@ -402,7 +898,7 @@ void *worker_thread(void *arg) {
 
         if (stat(maybe_dir, &st) == 0 && S_ISDIR(st.st_mode)) {
             // directory exists -> list it
-            send_directory_listing(client_socket, maybe_dir, decoded);
+            send_directory_listing(client_socket, maybe_dir, decoded, query, chunked);
             free(maybe_dir);
             goto cleanup_and_finish;
         }
@@ -447,7 +943,7 @@ void *worker_thread(void *arg) {
         else
             snprintf(uri_for_list, need_uri_for_list, "%s/", decoded);
 
-        send_directory_listing(client_socket, fullpath, uri_for_list);
+        send_directory_listing(client_socket, fullpath, uri_for_list, query, chunked);
         free(uri_for_list);
         goto cleanup_and_finish;
     }
@@ -469,6 +965,10 @@ int main(int argc, char *argv[]) {
 
     server_start_time = time(NULL);
 
+    // Templates are compiled before accepting, so a broken one stops the start
+    status_template = template_load(webroot, "status.html", status_fields, STATUS_FIELD_COUNT);
+    if (!status_template) exit(EXIT_FAILURE);
+
     // Signal
     signal(SIGINT, handle_sigint);
 
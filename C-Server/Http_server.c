@@ -5,83 +5,233 @@
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <time.h>
 #include <signal.h>
 #include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
 
-#define PORT 8080
-#define BUFFER_SIZE 4096
-#define MAX_HEADERS 50
-#define WEBROOT "./www"
-#define LOG_FILE "access.log"
-#define ERROR_LOG_FILE "error.log"
+#include "Http_server.h"
+#include "proxy.h"
+#include "cache.h"
+#include "tls.h"
+#include "http2.h"
+#include "assets.h"
+#include "resolve.h"
+#include "largefile.h"
+#include "outq.h"
+#include "body.h"
+#include "trace.h"
+#include "admin.h"
+#include "binlog.h"
+#include "push.h"
+#include "prefork.h"
+#include "offload.h"
+#include "admission.h"
+#include "unixsock.h"
+#include "template.h"
+#include "placement.h"
 
-// HTTP status codes
-#define HTTP_OK 200
-#define HTTP_NOT_FOUND 404
-#define HTTP_METHOD_NOT_ALLOWED 405
-#define HTTP_INTERNAL_SERVER_ERROR 500
-
-// Server statistics
-typedef struct {
-    time_t start_time;
-    unsigned long request_count;
-    unsigned long bytes_sent;
-    pthread_mutex_t mutex;
-} ServerStats;
+// Forward declarations for route handlers
+void handle_time(Connection *conn, HttpRequest *request, const char *client_ip);
+void handle_status(Connection *conn, HttpRequest *request, const char *client_ip);
+void handle_echo_form(Connection *conn, HttpRequest *request, const char *client_ip);
+void handle_static_file(Connection *conn, HttpRequest *request, const char *client_ip);
 
-// Global server statistics
-ServerStats server_stats = {0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+int log_level = LOG_LEVEL_INFO;
 
-// HTTP Header structure
-typedef struct {
-    char name[128];
-    char value[512];
-} HttpHeader;
-
-// Structure for HTTP request data
-typedef struct {
-    char method[8];
-    char path[256];
-    char version[16];
-    HttpHeader headers[MAX_HEADERS];
-    int header_count;
-    char *body;
-    size_t body_length;
-} HttpRequest;
-
-// Route handler function type
-typedef void (*RouteHandler)(int client_socket, HttpRequest *request, const char *client_ip);
-
-// Route structure
-typedef struct {
-    char path[256];
-    char methods[32];  // Comma-separated list of allowed methods
-    RouteHandler handler;
-} Route;
-
-// Forward declarations for route handlers
-void handle_time(int client_socket, HttpRequest *request, const char *client_ip);
-void handle_status(int client_socket, HttpRequest *request, const char *client_ip);
-void handle_echo_form(int client_socket, HttpRequest *request, const char *client_ip);
-void handle_static_file(int client_socket, HttpRequest *request, const char *client_ip);
+static AcceptStats accept_stats;
 
 // Dynamic routing table
-Route routes[] = {
-    {"/time", "GET,HEAD", handle_time},
-    {"/status", "GET,HEAD", handle_status},
-    {"/echo", "GET,POST,HEAD", handle_echo_form},
-    {"", "", NULL}  // Default route (must be last)
+Route routes[MAX_ROUTES] = {
+    {"/time", "GET,HEAD", handle_time, ROUTE_HANDLER, NULL, {0, 0, NULL, 0}, NULL, 0},
+    {"/status", "GET,HEAD", handle_status, ROUTE_HANDLER, NULL, {1000, 2000, NULL, 0}, NULL, 0},
+    {"/echo", "GET,POST,HEAD", handle_echo_form, ROUTE_HANDLER, NULL, {0, 0, NULL, 0}, NULL, 1},  // Spools uploads to disk
+    {"/events/time", "GET", push_subscribe, ROUTE_PUSH, NULL, {0, 0, NULL, 0}, &push_time_channel, 0},
+    {"/events/status", "GET", push_subscribe, ROUTE_PUSH, NULL, {0, 0, NULL, 0}, &push_status_channel, 0},
+    {"", "", NULL, ROUTE_HANDLER, NULL, {0, 0, NULL, 0}, NULL, 0}  // Default route (must be last)
 };
 
 /**
  * Updates server statistics
  */
 void update_stats(unsigned long bytes) {
-    pthread_mutex_lock(&server_stats.mutex);
-    server_stats.request_count++;
-    server_stats.bytes_sent += bytes;
-    pthread_mutex_unlock(&server_stats.mutex);
+    __atomic_add_fetch(&stats_slot->request_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats_slot->bytes_sent, bytes, __ATOMIC_RELAXED);
+    admin_conn_sent(bytes);
+    binlog_add_bytes(bytes);
+}
+
+/**
+ * Appends data to a growable buffer
+ */
+int buffer_append(ByteBuffer *buffer, const void *data, size_t len) {
+    if (buffer->len + len > buffer->cap) {
+        size_t new_cap = buffer->cap ? buffer->cap * 2 : BUFFER_SIZE;
+        while (new_cap < buffer->len + len) new_cap *= 2;
+        char *new_data = realloc(buffer->data, new_cap);
+        if (!new_data) return -1;
+        buffer->data = new_data;
+        buffer->cap = new_cap;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+/**
+ * Releases a buffer's storage
+ */
+void buffer_free(ByteBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->len = buffer->cap = 0;
+}
+
+/**
+ * Sends data to the client: collected when capturing, framed on an HTTP/2
+ * stream, queued when the connection has an output queue, otherwise
+ * written directly
+ */
+int conn_send(Connection *conn, const void *data, size_t len) {
+    if (conn->capture) {
+        return buffer_append(conn->capture, data, len);
+    }
+    if (conn->h2_stream) {
+        return http2_stream_send(conn->h2_stream, data, len);
+    }
+    if (conn->out) {
+        return outq_push(conn, data, len);
+    }
+    return conn_write(conn, data, len);
+}
+
+/**
+ * Sends a scatter list. On a plaintext queued connection it goes out with
+ * whatever is queued ahead of it in one gathered write; elsewhere each
+ * piece is sent in turn.
+ */
+int conn_sendv(Connection *conn, const struct iovec *iov, int count) {
+    if (conn->out && !conn->capture) {
+        return outq_pushv(conn, iov, count);
+    }
+    for (int i = 0; i < count; i++) {
+        if (conn_send(conn, iov[i].iov_base, iov[i].iov_len) < 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Writes all of data to the socket, waiting whenever a non-blocking socket
+ * is full
+ */
+int conn_write(Connection *conn, const void *data, size_t len) {
+    if (conn->ssl) {
+        return tls_send(conn, data, len);
+    }
+
+    const char *p = data;
+    while (len > 0) {
+        ssize_t sent = send(conn->fd, p, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && conn_wait(conn, POLLOUT) == 0) continue;
+            return -1;
+        }
+        p += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+/**
+ * Waits until the socket is ready for events. The wait is bounded by the
+ * socket's SO_SNDTIMEO or SO_RCVTIMEO, so timeouts set on a socket keep
+ * applying once it is non-blocking. Returns -1 with errno EAGAIN on timeout.
+ */
+int conn_wait(Connection *conn, short events) {
+    struct timeval tv = { 0, 0 };
+    socklen_t tv_len = sizeof(tv);
+    getsockopt(conn->fd, SOL_SOCKET, (events & POLLOUT) ? SO_SNDTIMEO : SO_RCVTIMEO, &tv, &tv_len);
+    int timeout = (tv.tv_sec || tv.tv_usec) ? (int)(tv.tv_sec * 1000 + tv.tv_usec / 1000) : -1;
+
+    struct pollfd pfd = { conn->fd, events, 0 };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return ready < 0 ? -1 : 0;
+}
+
+/**
+ * Receives data from the client. Queued output is flushed first, since the
+ * peer may be waiting for it before it sends anything more.
+ */
+ssize_t conn_recv(Connection *conn, void *buf, size_t len) {
+    if (conn->out && outq_flush(conn, 1) < 0) {
+        return -1;
+    }
+    if (conn->ssl) {
+        return tls_recv(conn, buf, len);
+    }
+
+    ssize_t n;
+    while ((n = recv(conn->fd, buf, len, 0)) < 0) {
+        if (errno == EINTR) continue;
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || conn_wait(conn, POLLIN) < 0) break;
+    }
+    if (n > 0) admin_conn_received(n);
+    return n;
+}
+
+/**
+ * Sends a range of a file: sendfile() for plaintext, the TLS path (kTLS
+ * sendfile when available) for HTTPS, and a copy when capturing. HTTP/2
+ * streams get the file a window at a time, as flow control admits it.
+ * Ranges below the large-file size are queued on connections with an
+ * output queue; large ranges go through the paced large-file path.
+ */
+int conn_sendfile(Connection *conn, int file_fd, off_t offset, size_t count) {
+    if (conn->capture || conn->h2_stream) {
+        char buffer[BUFFER_SIZE];
+        while (count > 0) {
+            ssize_t n = pread(file_fd, buffer, count < sizeof(buffer) ? count : sizeof(buffer), offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0 || conn_send(conn, buffer, n) < 0) return -1;
+            offset += n;
+            count -= n;
+        }
+        return 0;
+    }
+    if (conn->out) {
+        if (count < LARGE_FILE_MIN) {
+            return outq_push_file(conn, file_fd, offset, count);
+        }
+        if (outq_flush(conn, 1) < 0) return -1;
+    }
+    if (count >= LARGE_FILE_MIN) {
+        return largefile_send(conn, file_fd, offset, count);
+    }
+    if (conn->ssl) {
+        return tls_sendfile(conn, file_fd, offset, count);
+    }
+
+    while (count > 0) {
+        ssize_t sent = sendfile(conn->fd, file_fd, &offset, count);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && conn_wait(conn, POLLOUT) == 0) continue;
+        if (sent <= 0) return -1;
+        count -= sent;
+    }
+    return 0;
 }
 
 /**
@@ -133,34 +283,16 @@ void parse_form_data(const char *data, char *key, char *value, size_t max_len) {
     }
 }
 
-/**
- * MIME type detection
- */
-const char* get_mime_type(const char *path) {
-    const char *ext = strrchr(path, '.');
-    if (!ext) return "application/octet-stream";
-
-    if (strcmp(ext, ".html") == 0) return "text/html";
-    if (strcmp(ext, ".htm") == 0) return "text/html";
-    if (strcmp(ext, ".css") == 0) return "text/css";
-    if (strcmp(ext, ".js") == 0) return "application/javascript";
-    if (strcmp(ext, ".json") == 0) return "application/json";
-    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "image/jpeg";
-    if (strcmp(ext, ".png") == 0) return "image/png";
-    if (strcmp(ext, ".gif") == 0) return "image/gif";
-    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
-    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
-    if (strcmp(ext, ".txt") == 0) return "text/plain";
-    if (strcmp(ext, ".pdf") == 0) return "application/pdf";
-    if (strcmp(ext, ".zip") == 0) return "application/zip";
-
-    return "application/octet-stream";
-}
-
 /**
  * Logs an access request
  */
 void log_request(const char *client_ip, const char *method, const char *path, int status_code) {
+    if (__atomic_load_n(&log_level, __ATOMIC_RELAXED) < LOG_LEVEL_INFO) return;
+    if (binlog_active) {
+        binlog_append(client_ip, method, path, status_code);
+        return;
+    }
+
     FILE *log_file = fopen(LOG_FILE, "a");
     if (!log_file) return;
 
@@ -176,6 +308,8 @@ void log_request(const char *client_ip, const char *method, const char *path, in
  * Logs an error message
  */
 void log_error(const char *message) {
+    if (__atomic_load_n(&log_level, __ATOMIC_RELAXED) < LOG_LEVEL_ERROR) return;
+
     FILE *error_file = fopen(ERROR_LOG_FILE, "a");
     if (!error_file) return;
 
@@ -190,7 +324,7 @@ void log_error(const char *message) {
 /**
  * Parses an HTTP request string
  */
-void parse_http_request(const char *request_str, HttpRequest *request) {
+void parse_http_request(const char *request_str, size_t length, HttpRequest *request) {
     // Initialize request structure
     memset(request, 0, sizeof(HttpRequest));
     
@@ -236,14 +370,14 @@ void parse_http_request(const char *request_str, HttpRequest *request) {
         header_start = line_end + 2;
     }
     
-    // Find body (after empty line)
+    // Body bytes that arrived with the headers stay in the receive buffer;
+    // handlers read the full body through body_read()
     const char *body_start = strstr(request_str, "\r\n\r\n");
     if (body_start) {
         body_start += 4;
-        request->body_length = strlen(body_start);
+        request->body_length = length - (body_start - request_str);
         if (request->body_length > 0) {
-            request->body = malloc(request->body_length + 1);
-            strcpy(request->body, body_start);
+            request->body = (char*)body_start;
         }
     }
 }
@@ -261,19 +395,38 @@ const char* get_header_value(HttpRequest *request, const char *name) {
 }
 
 /**
- * Sends an HTTP response header
+ * Returns the status line text for a status code
  */
-void send_response_header(int client_socket, int status_code, const char *mime_type, size_t content_length) {
-    char header[BUFFER_SIZE];
-    const char *status_text;
-
+const char* get_status_text(int status_code) {
     switch (status_code) {
-        case HTTP_OK: status_text = "200 OK"; break;
-        case HTTP_NOT_FOUND: status_text = "404 Not Found"; break;
-        case HTTP_METHOD_NOT_ALLOWED: status_text = "405 Method Not Allowed"; break;
-        case HTTP_INTERNAL_SERVER_ERROR: status_text = "500 Internal Server Error"; break;
-        default: status_text = "500 Internal Server Error"; break;
+        case HTTP_OK: return "200 OK";
+        case HTTP_NOT_MODIFIED: return "304 Not Modified";
+        case HTTP_BAD_REQUEST: return "400 Bad Request";
+        case HTTP_NOT_FOUND: return "404 Not Found";
+        case HTTP_METHOD_NOT_ALLOWED: return "405 Method Not Allowed";
+        case HTTP_PAYLOAD_TOO_LARGE: return "413 Payload Too Large";
+        case HTTP_INTERNAL_SERVER_ERROR: return "500 Internal Server Error";
+        case HTTP_BAD_GATEWAY: return "502 Bad Gateway";
+        case HTTP_SERVICE_UNAVAILABLE: return "503 Service Unavailable";
+        case HTTP_GATEWAY_TIMEOUT: return "504 Gateway Timeout";
+        default: return "500 Internal Server Error";
     }
+}
+
+/**
+ * Sends an HTTP response header
+ */
+void send_response_header(Connection *conn, int status_code, const char *mime_type, size_t content_length) {
+    send_response_header_extra(conn, status_code, mime_type, content_length, "");
+}
+
+/**
+ * Sends HTTP response headers plus extra header lines (each ending in CRLF)
+ */
+void send_response_header_extra(Connection *conn, int status_code, const char *mime_type,
+                                size_t content_length, const char *extra_headers) {
+    char header[BUFFER_SIZE];
+    const char *status_text = get_status_text(status_code);
 
     time_t now = time(NULL);
     char date_str[128];
@@ -282,239 +435,573 @@ void send_response_header(int client_socket, int status_code, const char *mime_t
     snprintf(header, sizeof(header),
              "HTTP/1.1 %s\r\n"
              "Date: %s\r\n"
-             "Server: C-HTTP-Server/2.0\r\n"
+             "Server: " SERVER_VERSION "\r\n"
              "Content-Type: %s\r\n"
              "Content-Length: %zu\r\n"
+             "%s"
              "Connection: close\r\n"
              "\r\n",
-             status_text, date_str, mime_type, content_length);
+             status_text, date_str, mime_type, content_length, extra_headers);
+
+    conn_send(conn, header, strlen(header));
+}
+
+// Pages rendered from www/templates, compiled by load_page_templates()
+static Template *time_template;
+static Template *status_template;
+static Template *echo_form_template;
+static Template *echo_result_template;
+
+enum { TIME_TIME, TIME_TIMEZONE, TIME_FIELD_COUNT };
+static const char *const time_fields[] = { "time", "timezone" };
+
+enum {
+    STATUS_UPTIME_HOURS, STATUS_UPTIME_MINUTES, STATUS_UPTIME_SECONDS, STATUS_REQUESTS, STATUS_BYTES_SENT,
+    STATUS_VERSION, STATUS_PORT, STATUS_WORKERS,
+    STATUS_TLS_HANDSHAKES, STATUS_TLS_RESUMED, STATUS_TLS_KTLS, STATUS_TLS_FAILURES,
+    STATUS_PATH_HITS, STATUS_PATH_MISSES, STATUS_PATH_ENTRIES,
+    STATUS_LARGE_SPLICE, STATUS_LARGE_READ, STATUS_LARGE_SENDFILE, STATUS_LARGE_WINDOWS, STATUS_LARGE_PACED,
+    STATUS_OUTQ_FLUSHES, STATUS_OUTQ_PARTIAL, STATUS_OUTQ_WAITS, STATUS_OUTQ_CAP_STALLS, STATUS_OUTQ_PEAK,
+    STATUS_ACCEPTED, STATUS_ACCEPT_WAKEUPS, STATUS_ACCEPT_MAX_BATCH, STATUS_ACCEPT_ERRORS, STATUS_ACCEPT_FD_SHED,
+    STATUS_LISTEN_OVERFLOWS, STATUS_LISTEN_DROPS,
+    STATUS_BINLOG_RECORDS, STATUS_BINLOG_DROPPED, STATUS_BINLOG_SEGMENTS, STATUS_BINLOG_PATHS,
+    STATUS_PUSH_SUBSCRIBERS, STATUS_PUSH_PUBLISHED, STATUS_PUSH_DELIVERED, STATUS_PUSH_DROPPED,
+    STATUS_OFFLOAD_THREADS, STATUS_OFFLOAD_JOBS, STATUS_OFFLOAD_STOLEN, STATUS_OFFLOAD_QUEUED, STATUS_OFFLOAD_INLINE,
+    STATUS_OFFLOAD_TIMED_OUT,
+    STATUS_ADMISSION_STATE, STATUS_ADMISSION_TARGET, STATUS_ADMISSION_MIN_DELAY, STATUS_ADMISSION_ADMITTED,
+    STATUS_ADMISSION_SHED, STATUS_ADMISSION_SHED_CHEAP, STATUS_ADMISSION_SHED_AT_ACCEPT, STATUS_ADMISSION_OVERLOADS,
+    STATUS_NUMA,
+    STATUS_FIELD_COUNT
+};
+static const char *const status_fields[] = {
+    "uptime_hours", "uptime_minutes", "uptime_seconds", "requests", "bytes_sent",
+    "version", "port", "workers",
+    "tls_handshakes", "tls_resumed", "tls_ktls", "tls_failures",
+    "path_hits", "path_misses", "path_entries",
+    "large_splice", "large_read", "large_sendfile", "large_windows", "large_paced",
+    "outq_flushes", "outq_partial", "outq_waits", "outq_cap_stalls", "outq_peak",
+    "accepted", "accept_wakeups", "accept_max_batch", "accept_errors", "accept_fd_shed",
+    "listen_overflows", "listen_drops",
+    "binlog_records", "binlog_dropped", "binlog_segments", "binlog_paths",
+    "push_subscribers", "push_published", "push_delivered", "push_dropped",
+    "offload_threads", "offload_jobs", "offload_stolen", "offload_queued", "offload_inline",
+    "offload_timed_out",
+    "admission_state", "admission_target", "admission_min_delay", "admission_admitted",
+    "admission_shed", "admission_shed_cheap", "admission_shed_at_accept", "admission_overloads",
+    "numa"
+};
+
+enum { ECHO_NAME, ECHO_MESSAGE, ECHO_FILES, ECHO_FIELD_COUNT };
+static const char *const echo_fields[] = { "name", "message", "files" };
 
-    send(client_socket, header, strlen(header), 0);
+/**
+ * Compiles the templates of the dynamic pages, replacing any compiled
+ * before. Returns -1 if one is missing or uses a field its handler does
+ * not fill.
+ */
+int load_page_templates(void) {
+    template_free(time_template);
+    template_free(status_template);
+    template_free(echo_form_template);
+    template_free(echo_result_template);
+    time_template = template_load("time.html", time_fields, TIME_FIELD_COUNT);
+    status_template = template_load("status.html", status_fields, STATUS_FIELD_COUNT);
+    echo_form_template = template_load("echo_form.html", echo_fields, 0);
+    echo_result_template = template_load("echo_result.html", echo_fields, ECHO_FIELD_COUNT);
+    return time_template && status_template && echo_form_template && echo_result_template ? 0 : -1;
 }
 
 /**
  * Route handler for /time endpoint
  */
-void handle_time(int client_socket, HttpRequest *request, const char *client_ip) {
+void handle_time(Connection *conn, HttpRequest *request, const char *client_ip) {
     time_t now = time(NULL);
-    char *time_str = ctime(&now);
-    char response[BUFFER_SIZE];
-    
-    snprintf(response, sizeof(response),
-             "<!DOCTYPE html>"
-             "<html>"
-             "<head>"
-             "<title>Server Time</title>"
-             "<link rel=\"stylesheet\" href=\"/style.css\">"
-             "</head>"
-             "<body>"
-             "<div class=\"container\">"
-             "<h1>Current Server Time</h1>"
-             "<p class=\"time\">%s</p>"
-             "<p>Timezone: %s</p>"
-             "<a href=\"/\">Back to Home</a>"
-             "</div>"
-             "</body>"
-             "</html>",
-             time_str, tzname[0]);
-    
-    send_response_header(client_socket, HTTP_OK, "text/html", strlen(response));
-    
+    char time_str[32];
+    ctime_r(&now, time_str);
+
+    TemplateRender render;
+    template_begin(&render, time_template);
+    template_set(&render, TIME_TIME, time_str);
+    template_set(&render, TIME_TIMEZONE, tzname[0]);
+
     // Send body only if not HEAD request
-    if (strcmp(request->method, "HEAD") != 0) {
-        send(client_socket, response, strlen(response), 0);
-    }
-    
-    update_stats(strlen(response));
+    size_t length = template_send(conn, &render, HTTP_OK, strcmp(request->method, "HEAD") == 0);
+
+    update_stats(length);
     log_request(client_ip, request->method, request->path, HTTP_OK);
 }
 
+/**
+ * Reads the kernel's ListenOverflows and ListenDrops counters (all
+ * listeners on the host) from /proc/net/netstat
+ */
+static void read_listen_overflows(unsigned long *overflows, unsigned long *drops) {
+    FILE *fp = fopen("/proc/net/netstat", "r");
+    if (!fp) return;
+
+    // TcpExt appears as a line of names followed by a line of values
+    char names[4096], values[4096];
+    while (fgets(names, sizeof(names), fp) && fgets(values, sizeof(values), fp)) {
+        if (strncmp(names, "TcpExt:", 7) != 0 || strncmp(values, "TcpExt:", 7) != 0) continue;
+
+        char *name_save, *value_save;
+        char *name = strtok_r(names + 7, " \n", &name_save);
+        char *value = strtok_r(values + 7, " \n", &value_save);
+        for (; name && value; name = strtok_r(NULL, " \n", &name_save), value = strtok_r(NULL, " \n", &value_save)) {
+            if (strcmp(name, "ListenOverflows") == 0) *overflows = strtoul(value, NULL, 10);
+            if (strcmp(name, "ListenDrops") == 0) *drops = strtoul(value, NULL, 10);
+        }
+        break;
+    }
+    fclose(fp);
+}
+
+/**
+ * Summarizes the server processes: the single process, or each prefork
+ * worker's pid, request count and restarts. Counters other than requests
+ * and bytes on the status page belong to the worker that served it.
+ */
+static void describe_workers(char *out, size_t out_len) {
+    if (server_stats->process_count == 1 && stats_slot->respawns == 0) {
+        snprintf(out, out_len, "1 (pid %d)", (int)getpid());
+        return;
+    }
+
+    int used = snprintf(out, out_len, "%d workers, this page from pid %d", server_stats->process_count, (int)getpid());
+    for (int i = 0; i < server_stats->process_count && used > 0 && (size_t)used < out_len; i++) {
+        StatsSlot *slot = &server_stats->slots[i];
+        unsigned long respawns = __atomic_load_n(&slot->respawns, __ATOMIC_RELAXED);
+        used += snprintf(out + used, out_len - used, "%s #%d pid %d: %lu req", i == 0 ? ";" : ",", i,
+                         __atomic_load_n(&slot->pid, __ATOMIC_RELAXED),
+                         __atomic_load_n(&slot->request_count, __ATOMIC_RELAXED));
+        if (respawns > 0 && used > 0 && (size_t)used < out_len) {
+            used += snprintf(out + used, out_len - used, " (restarted %lu)", respawns);
+        }
+    }
+}
+
 /**
  * Route handler for /status endpoint
  */
-void handle_status(int client_socket, HttpRequest *request, const char *client_ip) {
-    time_t uptime = time(NULL) - server_stats.start_time;
+void handle_status(Connection *conn, HttpRequest *request, const char *client_ip) {
+    time_t uptime = time(NULL) - server_stats->start_time;
     int hours = uptime / 3600;
     int minutes = (uptime % 3600) / 60;
     int seconds = uptime % 60;
     
-    char response[BUFFER_SIZE];
-    
-    pthread_mutex_lock(&server_stats.mutex);
-    snprintf(response, sizeof(response),
-             "<!DOCTYPE html>"
-             "<html>"
-             "<head>"
-             "<title>Server Status</title>"
-             "<link rel=\"stylesheet\" href=\"/style.css\">"
-             "</head>"
-             "<body>"
-             "<div class=\"container\">"
-             "<h1>Server Status</h1>"
-             "<table style=\"margin: 0 auto; text-align: left;\">"
-             "<tr><td><strong>Uptime:</strong></td><td>%d hours, %d minutes, %d seconds</td></tr>"
-             "<tr><td><strong>Total Requests:</strong></td><td>%lu</td></tr>"
-             "<tr><td><strong>Bytes Sent:</strong></td><td>%lu</td></tr>"
-             "<tr><td><strong>Server Version:</strong></td><td>C-HTTP-Server/2.0</td></tr>"
-             "<tr><td><strong>Port:</strong></td><td>%d</td></tr>"
-             "</table>"
-             "<a href=\"/\">Back to Home</a>"
-             "</div>"
-             "</body>"
-             "</html>",
-             hours, minutes, seconds,
-             server_stats.request_count,
-             server_stats.bytes_sent,
-             PORT);
-    pthread_mutex_unlock(&server_stats.mutex);
-    
-    send_response_header(client_socket, HTTP_OK, "text/html", strlen(response));
-    
-    if (strcmp(request->method, "HEAD") != 0) {
-        send(client_socket, response, strlen(response), 0);
-    }
-    
-    update_stats(strlen(response));
+    TlsStats tls;
+    tls_get_stats(&tls);
+    ResolveStats paths;
+    resolve_get_stats(&paths);
+    LargeFileStats large;
+    largefile_get_stats(&large);
+    OutqStats queues;
+    outq_get_stats(&queues);
+    BinlogStats binlog;
+    binlog_get_stats(&binlog);
+    PushStats push;
+    push_get_stats(&push);
+    OffloadStats offload;
+    offload_get_stats(&offload);
+    AdmissionStats admission;
+    admission_get_stats(&admission);
+    unsigned long requests, bytes_sent;
+    stats_totals(&requests, &bytes_sent);
+    char workers[512];
+    describe_workers(workers, sizeof(workers));
+    char numa[512];
+    placement_describe(numa, sizeof(numa));
+    unsigned long listen_overflows = 0, listen_drops = 0;
+    read_listen_overflows(&listen_overflows, &listen_drops);
+
+    TemplateRender render;
+    template_begin(&render, status_template);
+    template_set_ulong(&render, STATUS_UPTIME_HOURS, hours);
+    template_set_ulong(&render, STATUS_UPTIME_MINUTES, minutes);
+    template_set_ulong(&render, STATUS_UPTIME_SECONDS, seconds);
+    template_set_ulong(&render, STATUS_REQUESTS, requests);
+    template_set_ulong(&render, STATUS_BYTES_SENT, bytes_sent);
+    template_set(&render, STATUS_VERSION, SERVER_VERSION);
+    template_set_ulong(&render, STATUS_PORT, PORT);
+    template_set(&render, STATUS_WORKERS, workers);
+    template_set_ulong(&render, STATUS_TLS_HANDSHAKES, tls.handshakes);
+    template_set_ulong(&render, STATUS_TLS_RESUMED, tls.resumed);
+    template_set_ulong(&render, STATUS_TLS_KTLS, tls.ktls_send);
+    template_set_ulong(&render, STATUS_TLS_FAILURES, tls.failures);
+    template_set_ulong(&render, STATUS_PATH_HITS, paths.hits);
+    template_set_ulong(&render, STATUS_PATH_MISSES, paths.misses);
+    template_set_ulong(&render, STATUS_PATH_ENTRIES, paths.entries);
+    template_set_ulong(&render, STATUS_LARGE_SPLICE, large.splice);
+    template_set_ulong(&render, STATUS_LARGE_READ, large.read);
+    template_set_ulong(&render, STATUS_LARGE_SENDFILE, large.sendfile);
+    template_set_ulong(&render, STATUS_LARGE_WINDOWS, large.windows);
+    template_set_ulong(&render, STATUS_LARGE_PACED, large.paced_sleeps);
+    template_set_ulong(&render, STATUS_OUTQ_FLUSHES, queues.flushes);
+    template_set_ulong(&render, STATUS_OUTQ_PARTIAL, queues.partial_writes);
+    template_set_ulong(&render, STATUS_OUTQ_WAITS, queues.waits);
+    template_set_ulong(&render, STATUS_OUTQ_CAP_STALLS, queues.cap_stalls);
+    template_set_ulong(&render, STATUS_OUTQ_PEAK, queues.peak_buffered);
+    template_set_ulong(&render, STATUS_ACCEPTED, __atomic_load_n(&accept_stats.accepted, __ATOMIC_RELAXED));
+    template_set_ulong(&render, STATUS_ACCEPT_WAKEUPS, __atomic_load_n(&accept_stats.wakeups, __ATOMIC_RELAXED));
+    template_set_ulong(&render, STATUS_ACCEPT_MAX_BATCH, __atomic_load_n(&accept_stats.max_batch, __ATOMIC_RELAXED));
+    template_set_ulong(&render, STATUS_ACCEPT_ERRORS, __atomic_load_n(&accept_stats.errors, __ATOMIC_RELAXED));
+    template_set_ulong(&render, STATUS_ACCEPT_FD_SHED, __atomic_load_n(&accept_stats.fd_shed, __ATOMIC_RELAXED));
+    template_set_ulong(&render, STATUS_LISTEN_OVERFLOWS, listen_overflows);
+    template_set_ulong(&render, STATUS_LISTEN_DROPS, listen_drops);
+    template_set_ulong(&render, STATUS_BINLOG_RECORDS, binlog.records);
+    template_set_ulong(&render, STATUS_BINLOG_DROPPED, binlog.dropped);
+    template_set_ulong(&render, STATUS_BINLOG_SEGMENTS, binlog.segments);
+    template_set_ulong(&render, STATUS_BINLOG_PATHS, binlog.paths);
+    template_set_ulong(&render, STATUS_PUSH_SUBSCRIBERS, push.subscribers);
+    template_set_ulong(&render, STATUS_PUSH_PUBLISHED, push.published);
+    template_set_ulong(&render, STATUS_PUSH_DELIVERED, push.delivered);
+    template_set_ulong(&render, STATUS_PUSH_DROPPED, push.dropped);
+    template_set_ulong(&render, STATUS_OFFLOAD_THREADS, offload.threads);
+    template_set_ulong(&render, STATUS_OFFLOAD_JOBS, offload.submitted);
+    template_set_ulong(&render, STATUS_OFFLOAD_STOLEN, offload.stolen);
+    template_set_ulong(&render, STATUS_OFFLOAD_QUEUED, offload.queued);
+    template_set_ulong(&render, STATUS_OFFLOAD_INLINE, offload.inline_runs);
+    template_set_ulong(&render, STATUS_OFFLOAD_TIMED_OUT, offload.timed_out);
+    template_set(&render, STATUS_ADMISSION_STATE,
+                 admission.target_ms == 0 ? "off" : admission.overloaded ? "shedding" : "ok");
+    template_set_ulong(&render, STATUS_ADMISSION_TARGET, admission.target_ms);
+    template_set_ulong(&render, STATUS_ADMISSION_MIN_DELAY, admission.min_delay_us);
+    template_set_ulong(&render, STATUS_ADMISSION_ADMITTED, admission.admitted);
+    template_set_ulong(&render, STATUS_ADMISSION_SHED, admission.shed);
+    template_set_ulong(&render, STATUS_ADMISSION_SHED_CHEAP, admission.shed_cheap);
+    template_set_ulong(&render, STATUS_ADMISSION_SHED_AT_ACCEPT, admission.shed_at_accept);
+    template_set_ulong(&render, STATUS_ADMISSION_OVERLOADS, admission.overload_intervals);
+    template_set(&render, STATUS_NUMA, numa);
+
+    size_t length = template_send(conn, &render, HTTP_OK, strcmp(request->method, "HEAD") == 0);
+
+    update_stats(length);
     log_request(client_ip, request->method, request->path, HTTP_OK);
 }
 
+// Fields and uploads collected by /echo from a multipart body
+typedef struct {
+    char name[256];
+    char message[512];
+    char uploads[1024];  // One list item per uploaded file
+    Spool file;          // Contents of the upload being received
+} EchoForm;
+
 /**
- * Route handler for /echo endpoint (demonstrates POST handling)
+ * Replaces characters that would be markup so client-supplied names can be
+ * echoed into the page
  */
-void handle_echo_form(int client_socket, HttpRequest *request, const char *client_ip) {
-    char response[BUFFER_SIZE];
-    
-    if (strcmp(request->method, "POST") == 0 && request->body) {
-        // Parse POST data
-        char name[256] = "";
-        char message[512] = "";
-        
+static void strip_markup(char *text) {
+    for (; *text; text++) {
+        if (strchr("<>&\"'", *text)) *text = '_';
+    }
+}
+
+/**
+ * Multipart callback for /echo: text fields are kept up to the size of their
+ * buffers, uploaded files are spooled and summarized
+ */
+static int echo_form_part(MultipartPart *part, const char *data, size_t len, int final, void *arg) {
+    EchoForm *form = arg;
+
+    if (part->filename[0]) {
+        if (spool_write(&form->file, data, len) < 0) return -1;
+        if (final) {
+            strip_markup(part->filename);
+            strip_markup(part->content_type);
+            size_t used = strlen(form->uploads);
+            snprintf(form->uploads + used, sizeof(form->uploads) - used,
+                     "<li>%s (%s, %zu bytes%s)</li>", part->filename,
+                     part->content_type[0] ? part->content_type : "application/octet-stream",
+                     form->file.len, form->file.fd >= 0 ? ", spooled to disk" : "");
+            spool_free(&form->file);
+        }
+        return 0;
+    }
+
+    char *field = NULL;
+    size_t size = 0;
+    if (strcmp(part->name, "name") == 0) {
+        field = form->name;
+        size = sizeof(form->name);
+    } else if (strcmp(part->name, "message") == 0) {
+        field = form->message;
+        size = sizeof(form->message);
+    }
+    if (field) {
+        size_t used = strlen(field);
+        size_t copy = len < size - 1 - used ? len : size - 1 - used;
+        memcpy(field + used, data, copy);
+        field[used + copy] = '\0';
+    }
+    return 0;
+}
+
+/**
+ * Reads the /echo form from the body: multipart bodies are parsed as they
+ * stream in, URL-encoded ones are spooled (and refused if they outgrow
+ * memory, since the form only has two short fields)
+ */
+static int read_echo_form(HttpRequest *request, EchoForm *form) {
+    memset(form, 0, sizeof(*form));
+    spool_init(&form->file);
+
+    const char *content_type = get_header_value(request, "Content-Type");
+    if (content_type && strncasecmp(content_type, "multipart/form-data", 19) == 0) {
+        int result = multipart_parse(request, echo_form_part, form);
+        int error = errno;
+        spool_free(&form->file);
+        errno = error;
+        return result;
+    }
+
+    Spool body;
+    spool_init(&body);
+    int result = body_spool(request, &body);
+    if (result == 0 && body.fd >= 0) {
+        errno = EFBIG;
+        result = -1;
+    }
+    if (result == 0 && buffer_append(&body.memory, "", 1) == 0) {
         // Simple form parsing (expects name=value&name=value format)
-        char *name_start = strstr(request->body, "name=");
-        char *message_start = strstr(request->body, "message=");
+        char *name_start = strstr(body.memory.data, "name=");
+        char *message_start = strstr(body.memory.data, "message=");
         
         if (name_start) {
-            parse_form_data(name_start, name, name, sizeof(name));
+            parse_form_data(name_start, form->name, form->name, sizeof(form->name));
         }
         if (message_start) {
-            parse_form_data(message_start, message, message, sizeof(message));
+            parse_form_data(message_start, form->message, form->message, sizeof(form->message));
+        }
+    }
+    int error = errno;
+    spool_free(&body);
+    errno = error;
+    return result;
+}
+
+/**
+ * Route handler for /echo endpoint (demonstrates POST handling)
+ */
+void handle_echo_form(Connection *conn, HttpRequest *request, const char *client_ip) {
+    TemplateRender render;
+    EchoForm form;
+    char files[sizeof(form.uploads) + 64];
+
+    if (strcmp(request->method, "POST") == 0) {
+        if (read_echo_form(request, &form) < 0) {
+            char response[64];
+            int status_code = errno == EFBIG ? HTTP_PAYLOAD_TOO_LARGE : HTTP_BAD_REQUEST;
+            snprintf(response, sizeof(response), "<h1>%s</h1>", get_status_text(status_code));
+            send_response_header(conn, status_code, "text/html", strlen(response));
+            conn_send(conn, response, strlen(response));
+            log_request(client_ip, request->method, request->path, status_code);
+            return;
+        }
+
+        // Name and message are escaped by the template; the file list is
+        // markup built from names already stripped of it
+        template_begin(&render, echo_result_template);
+        template_set(&render, ECHO_NAME, form.name[0] ? form.name : "(not provided)");
+        template_set(&render, ECHO_MESSAGE, form.message[0] ? form.message : "(not provided)");
+        if (form.uploads[0]) {
+            snprintf(files, sizeof(files), "<p><strong>Files:</strong></p><ul>%s</ul>", form.uploads);
+            template_set(&render, ECHO_FILES, files);
         }
-        
-        snprintf(response, sizeof(response),
-                 "<!DOCTYPE html>"
-                 "<html>"
-                 "<head>"
-                 "<title>Echo Response</title>"
-                 "<link rel=\"stylesheet\" href=\"/style.css\">"
-                 "</head>"
-                 "<body>"
-                 "<div class=\"container\">"
-                 "<h1>Echo Response</h1>"
-                 "<p><strong>Name:</strong> %s</p>"
-                 "<p><strong>Message:</strong> %s</p>"
-                 "<a href=\"/echo\">Submit Another</a> | "
-                 "<a href=\"/\">Home</a>"
-                 "</div>"
-                 "</body>"
-                 "</html>",
-                 name[0] ? name : "(not provided)",
-                 message[0] ? message : "(not provided)");
     } else {
         // Show form for GET request
-        snprintf(response, sizeof(response),
-                 "<!DOCTYPE html>"
-                 "<html>"
-                 "<head>"
-                 "<title>Echo Form</title>"
-                 "<link rel=\"stylesheet\" href=\"/style.css\">"
-                 "</head>"
-                 "<body>"
-                 "<div class=\"container\">"
-                 "<h1>Echo Form</h1>"
-                 "<form method=\"POST\" action=\"/echo\">"
-                 "<label>Name: <input type=\"text\" name=\"name\" required></label><br><br>"
-                 "<label>Message: <textarea name=\"message\" rows=\"4\" cols=\"40\" required></textarea></label><br><br>"
-                 "<input type=\"submit\" value=\"Submit\">"
-                 "</form>"
-                 "<a href=\"/\">Back to Home</a>"
-                 "</div>"
-                 "</body>"
-                 "</html>");
-    }
-    
-    send_response_header(client_socket, HTTP_OK, "text/html", strlen(response));
-    
-    if (strcmp(request->method, "HEAD") != 0) {
-        send(client_socket, response, strlen(response), 0);
+        template_begin(&render, echo_form_template);
     }
-    
-    update_stats(strlen(response));
+
+    size_t length = template_send(conn, &render, HTTP_OK, strcmp(request->method, "HEAD") == 0);
+
+    update_stats(length);
     log_request(client_ip, request->method, request->path, HTTP_OK);
 }
 
 /**
- * Sends a static file to the client
+ * Returns 1 if an Accept-Encoding value allows the coding: listed, or
+ * covered by "*", with a q-value above zero. An explicit entry overrides "*".
  */
-void handle_static_file(int client_socket, HttpRequest *request, const char *client_ip) {
-    char full_path[512];
-    
-    // If root requested, serve index.html
-    if (strcmp(request->path, "/") == 0) {
-        snprintf(full_path, sizeof(full_path), "%s/index.html", WEBROOT);
+static int accepts_coding(const char *accept_encoding, const char *coding) {
+    int wildcard = 0;
+    const char *p = accept_encoding;
+    while (*p) {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, " \t;,");
+        const char *end = p + strcspn(p, ",");
+
+        // Parameters: only q matters, "q=0" (or 0.0, 0.000) refuses the coding
+        double q = 1.0;
+        for (const char *param = p + len; param < end; param++) {
+            if (*param != ';') continue;
+            const char *name = param + 1 + strspn(param + 1, " \t");
+            if (name < end && (*name == 'q' || *name == 'Q') && name[1] == '=') q = strtod(name + 2, NULL);
+        }
+
+        if (len > 0 && len == strlen(coding) && strncasecmp(p, coding, len) == 0) return q > 0;
+        if (len == 1 && *p == '*') wildcard = q > 0;
+        p = end;
+    }
+    return wildcard;
+}
+
+/**
+ * Returns 1 if an If-None-Match value matches the entity tag: "*", or a
+ * listed tag equal to it under weak comparison (a W/ prefix is ignored)
+ */
+static int etag_list_matches(const char *list, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+    while (*p) {
+        p += strspn(p, " \t,");
+        if (*p == '*' && (p[1] == '\0' || strchr(" \t,", p[1]))) return 1;
+        if (strncmp(p, "W/", 2) == 0) p += 2;
+
+        const char *end = p + strcspn(p, ",");
+        if (*p == '"') {
+            const char *close = strchr(p + 1, '"');
+            if (!close) return 0;
+            end = close + 1;
+            if ((size_t)(end - p) == etag_len && strncmp(p, etag, etag_len) == 0 &&
+                (*end == '\0' || strchr(" \t,", *end))) return 1;
+        }
+        // Skip the rest of the entry, including a malformed one
+        p = end + strcspn(end, ",");
+    }
+    return 0;
+}
+
+/**
+ * Sends a file compiled into the binary. 200 responses carry the ETag of
+ * the variant sent (the gzip one has its own) and honour If-None-Match
+ * for either; the gzip variant is used when the client accepts it.
+ */
+static void send_embedded_asset(Connection *conn, HttpRequest *request, const char *client_ip,
+                                const EmbeddedAsset *asset, int status_code) {
+    const unsigned char *body = asset->data;
+    size_t length = asset->len;
+    const char *accept_encoding = get_header_value(request, "Accept-Encoding");
+    int gzip = asset->gzip_data && accept_encoding && accepts_coding(accept_encoding, "gzip");
+    if (gzip) {
+        body = asset->gzip_data;
+        length = asset->gzip_len;
+    }
+
+    char extra_headers[256] = "";
+    if (status_code == HTTP_OK) {
+        snprintf(extra_headers, sizeof(extra_headers), "ETag: %s\r\n", gzip ? asset->gzip_etag : asset->etag);
+
+        const char *if_none_match = get_header_value(request, "If-None-Match");
+        if (if_none_match && (etag_list_matches(if_none_match, asset->etag) ||
+                              (asset->gzip_etag && etag_list_matches(if_none_match, asset->gzip_etag)))) {
+            status_code = HTTP_NOT_MODIFIED;
+        }
+    }
+    if (asset->gzip_data) strcat(extra_headers, "Vary: Accept-Encoding\r\n");
+    if (gzip) strcat(extra_headers, "Content-Encoding: gzip\r\n");
+
+    send_response_header_extra(conn, status_code, asset->mime_type, length, extra_headers);
+
+    // 304 and HEAD responses carry no body
+    if (status_code != HTTP_NOT_MODIFIED && strcmp(request->method, "HEAD") != 0) {
+        conn_send(conn, body, length);
+        update_stats(length);
     } else {
-        snprintf(full_path, sizeof(full_path), "%s%s", WEBROOT, request->path);
+        update_stats(0);
+    }
+    log_request(client_ip, request->method, request->path, status_code);
+}
+
+/**
+ * Returns 1 if a resolved path is a regular file that can be sent
+ */
+static int is_servable(ResolvedPath *resolved) {
+    return resolved && resolved->fd >= 0 && S_ISREG(resolved->st.st_mode);
+}
+
+/**
+ * Handles static file serving: embedded assets first, then the webroot on disk
+ */
+void handle_static_file(Connection *conn, HttpRequest *request, const char *client_ip) {
+    char path[RESOLVE_PATH_SIZE];
+    if (canonicalize_path(request->path, path, sizeof(path)) < 0) {
+        const char *bad_request = "<h1>400 Bad Request</h1>";
+        send_response_header(conn, HTTP_BAD_REQUEST, "text/html", strlen(bad_request));
+        if (strcmp(request->method, "HEAD") != 0) {
+            conn_send(conn, bad_request, strlen(bad_request));
+        }
+        log_request(client_ip, request->method, request->path, HTTP_BAD_REQUEST);
+        return;
     }
     
-    // Check if file exists
-    struct stat st;
-    if (stat(full_path, &st) != 0) {
-        // Try to serve 404.html
-        snprintf(full_path, sizeof(full_path), "%s/404.html", WEBROOT);
-        if (stat(full_path, &st) != 0) {
+    // If root requested, serve index.html
+    if (strcmp(path, "/") == 0) {
+        snprintf(path, sizeof(path), "/index.html");
+    }
+
+    // Page templates are only ever served rendered
+    int hidden = strncmp(path, TEMPLATE_DIR "/", strlen(TEMPLATE_DIR) + 1) == 0;
+
+    const EmbeddedAsset *asset = hidden ? NULL : asset_lookup(path);
+    if (asset) {
+        send_embedded_asset(conn, request, client_ip, asset, HTTP_OK);
+        return;
+    }
+
+    // Resolved beneath the pinned webroot, usually straight from the path cache
+    int status_code = HTTP_OK;
+    ResolvedPath *resolved = hidden ? NULL : resolve_path(path);
+    if (!is_servable(resolved)) {
+        resolve_release(resolved);
+
+        // Serve the 404 page, from memory when it was embedded
+        asset = asset_lookup("/404.html");
+        if (asset) {
+            send_embedded_asset(conn, request, client_ip, asset, HTTP_NOT_FOUND);
+            return;
+        }
+        resolved = resolve_path("/404.html");
+        if (!is_servable(resolved)) {
+            resolve_release(resolved);
             const char *not_found = "<h1>404 Not Found</h1>";
-            send_response_header(client_socket, HTTP_NOT_FOUND, "text/html", strlen(not_found));
+            send_response_header(conn, HTTP_NOT_FOUND, "text/html", strlen(not_found));
             if (strcmp(request->method, "HEAD") != 0) {
-                send(client_socket, not_found, strlen(not_found), 0);
+                conn_send(conn, not_found, strlen(not_found));
             }
             log_request(client_ip, request->method, request->path, HTTP_NOT_FOUND);
             return;
         }
+        status_code = HTTP_NOT_FOUND;
     }
     
-    const char *mime_type = get_mime_type(full_path);
-    send_response_header(client_socket, HTTP_OK, mime_type, st.st_size);
+    send_response_header(conn, status_code, resolved->mime_type, resolved->st.st_size);
     
-    // Send body only if not HEAD request
+    // Send body only if not HEAD request; the shared fd is read by offset
     if (strcmp(request->method, "HEAD") != 0) {
-        FILE *file = fopen(full_path, "rb");
-        if (file) {
-            char buffer[BUFFER_SIZE];
-            size_t bytes_read;
-            while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, file)) > 0) {
-                send(client_socket, buffer, bytes_read, 0);
-            }
-            fclose(file);
-        }
+        conn_sendfile(conn, resolved->fd, 0, resolved->st.st_size);
     }
     
-    update_stats(st.st_size);
-    log_request(client_ip, request->method, request->path, HTTP_OK);
+    update_stats(resolved->st.st_size);
+    log_request(client_ip, request->method, request->path, status_code);
+    resolve_release(resolved);
 }
 
 /**
  * Check if method is allowed for route
  */
 int is_method_allowed(const char *methods, const char *method) {
-    return strstr(methods, method) != NULL;
+    return strcmp(methods, "*") == 0 || strstr(methods, method) != NULL;
 }
 
 /**
  * Find matching route
  */
 Route* find_route(const char *path, const char *method) {
-    // Check exact matches first
+    // Check exact matches first; the query string is not part of the route
+    size_t path_len = strcspn(path, "?");
     for (int i = 0; routes[i].handler != NULL; i++) {
-        if (strcmp(routes[i].path, path) == 0) {
+        if (strlen(routes[i].path) == path_len && strncmp(routes[i].path, path, path_len) == 0) {
             if (is_method_allowed(routes[i].methods, method)) {
                 return &routes[i];
             }
@@ -522,71 +1009,207 @@ Route* find_route(const char *path, const char *method) {
         }
     }
     
+    // Longest matching prefix route ("/api/" also matches "/api")
+    Route *best = NULL;
+    size_t best_len = 0;
+    for (int i = 0; routes[i].handler != NULL; i++) {
+        if (routes[i].kind != ROUTE_PROXY) continue;
+
+        size_t len = strlen(routes[i].path);
+        int matches = strncmp(routes[i].path, path, len) == 0 ||
+                      (len > 1 && strncmp(routes[i].path, path, len - 1) == 0 &&
+                       (path[len - 1] == '\0' || path[len - 1] == '?'));
+        if (matches && len > best_len && is_method_allowed(routes[i].methods, method)) {
+            best = &routes[i];
+            best_len = len;
+        }
+    }
+    if (best) return best;
+
     // Default route (static file handler)
     return NULL;
 }
 
+/**
+ * Adds a route before the default route entry
+ */
+int add_route(const Route *route) {
+    int i = 0;
+    while (routes[i].handler != NULL) i++;
+    if (i + 1 >= MAX_ROUTES) return -1;
+
+    routes[i] = *route;
+    memset(&routes[i + 1], 0, sizeof(Route));
+    return 0;
+}
+
+/**
+ * Routes a parsed request to its handler (HTTP/1.1 connections and HTTP/2 streams)
+ */
+void dispatch_request(Connection *conn, HttpRequest *request, const char *client_ip) {
+    binlog_request_start();
+
+    // Find matching route
+    TRACE_SPAN_START(dispatch_start);
+    Route *route = find_route(request->path, request->method);
+    request->route = route;
+    TRACE_SPAN_END(TRACE_DISPATCH, dispatch_start);
+    TRACE_PROBE2(route_dispatch, request->path, route);
+
+    // Under overload, refuse work that has already queued too long
+    if (!admission_admit(conn, request)) {
+        admission_reject(conn, request, client_ip);
+        return;
+    }
+
+    TRACE_SPAN_START(handler_start);
+    TRACE_PROBE1(handler_start, request->path);
+
+    if (route && route->kind == ROUTE_PROXY) {
+        // Proxy routes forward any method to their upstream group
+        route->handler(conn, request, client_ip);
+    } else if (strcmp(request->method, "GET") != 0 && 
+        strcmp(request->method, "POST") != 0 && 
+        strcmp(request->method, "HEAD") != 0) {
+        const char *method_not_allowed = "<h1>405 Method Not Allowed</h1>";
+        send_response_header(conn, HTTP_METHOD_NOT_ALLOWED, "text/html", strlen(method_not_allowed));
+        conn_send(conn, method_not_allowed, strlen(method_not_allowed));
+        log_request(client_ip, request->method, request->path, HTTP_METHOD_NOT_ALLOWED);
+    } else {
+        if (route && route->handler && route->cache.ttl_ms > 0) {
+            // Dynamic route with a response cache in front of it
+            cache_handle_request(conn, request, client_ip);
+        } else if (route && route->handler) {
+            // Dynamic route found
+            offload_run(conn, request, client_ip);
+        } else if (!route) {
+            // Try static file serving for GET/HEAD
+            if (strcmp(request->method, "GET") == 0 || strcmp(request->method, "HEAD") == 0) {
+                handle_static_file(conn, request, client_ip);
+            } else {
+                const char *method_not_allowed = "<h1>405 Method Not Allowed</h1>";
+                send_response_header(conn, HTTP_METHOD_NOT_ALLOWED, "text/html", strlen(method_not_allowed));
+                conn_send(conn, method_not_allowed, strlen(method_not_allowed));
+                log_request(client_ip, request->method, request->path, HTTP_METHOD_NOT_ALLOWED);
+            }
+        } else {
+            // Route exists but method not allowed
+            const char *method_not_allowed = "<h1>405 Method Not Allowed</h1>";
+            send_response_header(conn, HTTP_METHOD_NOT_ALLOWED, "text/html", strlen(method_not_allowed));
+            conn_send(conn, method_not_allowed, strlen(method_not_allowed));
+            log_request(client_ip, request->method, request->path, HTTP_METHOD_NOT_ALLOWED);
+        }
+    }
+    TRACE_PROBE1(handler_end, request->path);
+    TRACE_SPAN_END(TRACE_HANDLER, handler_start);
+}
+
+/**
+ * Sends whatever the handlers left queued
+ */
+static void finish_response(Connection *conn) {
+    admin_conn_state(CONN_SENDING, NULL);
+    TRACE_SPAN_START(send_start);
+    int result = outq_flush(conn, 1);
+    TRACE_SPAN_END(TRACE_SEND, send_start);
+    TRACE_PROBE2(send_done, conn->fd, result);
+}
+
 /**
  * Thread function to handle each client
  */
 void* handle_client(void *arg) {
-    int client_socket = *(int*)arg;
+    Connection conn = *(Connection*)arg;
+    int client_socket = conn.fd;
     free(arg);
 
-    struct sockaddr_in client_addr;
+    // The socket is non-blocking: responses are queued and a client that
+    // stops reading is dropped after SEND_TIMEOUT, one that stops sending
+    // its request after RECV_TIMEOUT
+    OutputQueue out;
+    outq_init(&out);
+    conn.out = &out;
+    struct timeval send_timeout = { SEND_TIMEOUT, 0 };
+    struct timeval recv_timeout = { RECV_TIMEOUT, 0 };
+    setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+
+    // Unix domain peers have no address; their pid and uid are logged instead
+    struct sockaddr_storage client_addr;
     socklen_t addr_size = sizeof(client_addr);
-    getpeername(client_socket, (struct sockaddr*)&client_addr, &addr_size);
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
+    char client_ip[INET6_ADDRSTRLEN] = "-";
+    if (getpeername(client_socket, (struct sockaddr*)&client_addr, &addr_size) == 0) {
+        if (client_addr.ss_family == AF_UNIX) {
+            unixsock_peer(client_socket, client_ip, sizeof(client_ip));
+        } else {
+            inet_ntop(AF_INET, &((struct sockaddr_in*)&client_addr)->sin_addr, client_ip, sizeof(client_ip));
+        }
+    }
+    admin_conn_open(client_socket, client_ip, &out, conn.ssl ? CONN_HANDSHAKE : CONN_READING);
+
+    trace_request_start();
+    if (trace_sampled) trace_record(TRACE_ACCEPT, conn.accepted_at, trace_cycles());
+    unsigned long long thread_started_ns = admission_now();
+
+    if (conn.ssl && tls_handshake(&conn) < 0) {
+        admin_conn_close();
+        tls_close(&conn);
+        close(client_socket);
+        return NULL;
+    }
+
+    // HTTP/2 negotiated through ALPN: the client preface follows the handshake
+    if (conn.ssl && tls_alpn_selected(&conn, "h2")) {
+        admin_conn_state(CONN_HTTP2, NULL);
+        http2_serve(&conn, NULL, 0, NULL, client_ip);
+        finish_response(&conn);
+        admin_conn_close();
+        outq_discard(&out);
+        tls_close(&conn);
+        close(client_socket);
+        return NULL;
+    }
 
     char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_socket, buffer, BUFFER_SIZE - 1, 0);
-    if (bytes_received > 0) {
+    admin_conn_state(CONN_READING, NULL);
+    TRACE_SPAN_START(recv_start);
+    int bytes_received = conn_recv(&conn, buffer, BUFFER_SIZE - 1);
+    TRACE_SPAN_END(TRACE_RECV, recv_start);
+    if (bytes_received > 0 && http2_is_preface(buffer, bytes_received)) {
+        // Cleartext HTTP/2 with prior knowledge
+        admin_conn_state(CONN_HTTP2, NULL);
+        http2_serve(&conn, buffer, bytes_received, NULL, client_ip);
+    } else if (bytes_received > 0) {
         buffer[bytes_received] = '\0';
 
         HttpRequest request;
-        parse_http_request(buffer, &request);
+        TRACE_PROBE1(parse_start, bytes_received);
+        TRACE_SPAN_START(parse_start);
+        parse_http_request(buffer, bytes_received, &request);
+        TRACE_SPAN_END(TRACE_PARSE, parse_start);
+        TRACE_PROBE2(parse_end, request.method, request.path);
 
-        // Check for supported methods
-        if (strcmp(request.method, "GET") != 0 && 
-            strcmp(request.method, "POST") != 0 && 
-            strcmp(request.method, "HEAD") != 0) {
-            const char *method_not_allowed = "<h1>405 Method Not Allowed</h1>";
-            send_response_header(client_socket, HTTP_METHOD_NOT_ALLOWED, "text/html", strlen(method_not_allowed));
-            send(client_socket, method_not_allowed, strlen(method_not_allowed), 0);
-            log_request(client_ip, request.method, request.path, HTTP_METHOD_NOT_ALLOWED);
+        if (!conn.ssl && http2_wants_upgrade(&request)) {
+            admin_conn_state(CONN_HTTP2, &request);
+            http2_serve(&conn, NULL, 0, &request, client_ip);
         } else {
-            // Find matching route
-            Route *route = find_route(request.path, request.method);
-            
-            if (route && route->handler) {
-                // Dynamic route found
-                route->handler(client_socket, &request, client_ip);
-            } else if (!route) {
-                // Try static file serving for GET/HEAD
-                if (strcmp(request.method, "GET") == 0 || strcmp(request.method, "HEAD") == 0) {
-                    handle_static_file(client_socket, &request, client_ip);
-                } else {
-                    const char *method_not_allowed = "<h1>405 Method Not Allowed</h1>";
-                    send_response_header(client_socket, HTTP_METHOD_NOT_ALLOWED, "text/html", strlen(method_not_allowed));
-                    send(client_socket, method_not_allowed, strlen(method_not_allowed), 0);
-                    log_request(client_ip, request.method, request.path, HTTP_METHOD_NOT_ALLOWED);
-                }
-            } else {
-                // Route exists but method not allowed
-                const char *method_not_allowed = "<h1>405 Method Not Allowed</h1>";
-                send_response_header(client_socket, HTTP_METHOD_NOT_ALLOWED, "text/html", strlen(method_not_allowed));
-                send(client_socket, method_not_allowed, strlen(method_not_allowed), 0);
-                log_request(client_ip, request.method, request.path, HTTP_METHOD_NOT_ALLOWED);
+            BodyReader *body_reader = malloc(sizeof(BodyReader));
+            if (body_reader) {
+                // Admission control counts time spent waiting on the server,
+                // not on the client: skip the handshake and request read
+                conn.accepted_ns = admission_now() - (thread_started_ns - conn.accepted_ns);
+                admin_conn_state(CONN_HANDLING, &request);
+                body_reader_init(body_reader, &conn, &request);
+                dispatch_request(&conn, &request, client_ip);
+                free(body_reader);
             }
         }
-        
-        // Clean up request
-        if (request.body) {
-            free(request.body);
-        }
     }
 
+    finish_response(&conn);
+    admin_conn_close();
+    outq_discard(&out);
+    tls_close(&conn);
     close(client_socket);
     return NULL;
 }
@@ -602,33 +1225,12 @@ void handle_signal(int sig) {
 }
 
 /**
- * Main entry point
+ * Creates a non-blocking listening TCP socket on the given port. With
+ * reuseport every process binds its own socket and the kernel spreads
+ * connections across them.
  */
-int main(int argc, char *argv[]) {
-    int port = PORT;
-    
-    // Parse command line arguments
-    if (argc > 1) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) {
-            fprintf(stderr, "Invalid port number. Using default: %d\n", PORT);
-            port = PORT;
-        }
-    }
-    
-    // Initialize server statistics
-    server_stats.start_time = time(NULL);
-    server_stats.request_count = 0;
-    server_stats.bytes_sent = 0;
-    
-    // Set up signal handler
-    signal(SIGINT, handle_signal);
-    
-    int server_fd, *client_socket;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+int create_listener(int port, int backlog, int reuseport) {
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_fd == -1) {
         perror("Socket creation failed");
         exit(EXIT_FAILURE);
@@ -641,7 +1243,14 @@ int main(int argc, char *argv[]) {
         close(server_fd);
         exit(EXIT_FAILURE);
     }
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
 
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(port);
@@ -652,34 +1261,402 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 10) < 0) {
+    if (listen(server_fd, backlog) < 0) {
         perror("Listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
+    return server_fd;
+}
+
+// The accept loop and main are left out when benchmarks link this file
+// with their own main (see bench/micro_bench.c)
+#ifndef SERVER_NO_MAIN
+static int reserve_fd = -1;  // Spare descriptor given up to shed connections on EMFILE
+
+/**
+ * Gives up the reserve descriptor to accept one pending connection and
+ * close it at once, so a full fd table sheds load instead of leaving the
+ * listener readable forever. Returns -1 when there is no reserve.
+ */
+static int shed_connection(int listen_fd) {
+    if (reserve_fd < 0) return -1;
+    close(reserve_fd);
+    int client_socket = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client_socket >= 0) {
+        close(client_socket);
+        __atomic_add_fetch(&accept_stats.fd_shed, 1, __ATOMIC_RELAXED);
+    }
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return client_socket >= 0 ? 0 : -1;
+}
+
+/**
+ * Accepts up to ACCEPT_BATCH pending connections from a non-blocking
+ * listener and starts a thread for each
+ */
+static void accept_connections(int listen_fd, int tls) {
+    unsigned long batch = 0;
+    while (batch < ACCEPT_BATCH) {
+        int client_socket = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            __atomic_add_fetch(&accept_stats.errors, 1, __ATOMIC_RELAXED);
+            if (errno == ECONNABORTED) continue;
+            if ((errno == EMFILE || errno == ENFILE) && shed_connection(listen_fd) == 0) continue;
+
+            // Out of descriptors with no reserve left, or out of memory:
+            // pause so a readable listener does not turn into a busy loop
+            log_error(strerror(errno));
+            struct timespec pause = { 0, 10000000 };
+            nanosleep(&pause, NULL);
+            break;
+        }
+
+        batch++;
+        TRACE_PROBE1(accept, client_socket);
+        if (placement_active) placement_note_accept(client_socket);
+        unsigned long long arrival_ns = admission_arrival(client_socket);
+        if (!tls && admission_screen(client_socket, arrival_ns)) {
+            close(client_socket);
+            continue;
+        }
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (!conn) {
+            close(client_socket);
+            continue;
+        }
+        conn->fd = client_socket;
+        conn->accepted_at = trace_cycles();
+        conn->accepted_ns = arrival_ns;
+        if (tls && tls_new_session(conn) < 0) {
+            close(client_socket);
+            free(conn);
+            continue;
+        }
+
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, NULL, handle_client, conn) != 0) {
+            log_error("Could not start a connection thread");
+            tls_close(conn);
+            close(client_socket);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread_id);
+    }
+
+    if (batch > 0) {
+        __atomic_add_fetch(&accept_stats.accepted, batch, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&accept_stats.wakeups, 1, __ATOMIC_RELAXED);
+        if (batch > accept_stats.max_batch) __atomic_store_n(&accept_stats.max_batch, batch, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Main entry point
+ */
+int main(int argc, char *argv[]) {
+    int port = PORT;
+    int tls_port = 0;
+    int admin_port = 0;
+    int backlog = LISTEN_BACKLOG;
+    int workers = 0;
+    int reuseport = 0;
+    int numa = 0;
+    int offload_threads = OFFLOAD_THREADS;
+    int admission_target = ADMISSION_TARGET_MS;
+    const char *binlog_dir = NULL;
+    const char *unix_specs[MAX_UNIX_LISTENERS];
+    int unix_count = 0;
+    const char *cert_file = NULL;
+    const char *key_file = NULL;
+    
+    // Parse command line options
+    int opt_char;
+    while ((opt_char = getopt(argc, argv, "A:L:NO:P:Q:RS:U:b:c:k:r:T:w:")) != -1) {
+        switch (opt_char) {
+            case 'S':
+                tls_port = atoi(optarg);
+                if (tls_port <= 0 || tls_port > 65535) {
+                    fprintf(stderr, "Invalid HTTPS port: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'A':
+                admin_port = atoi(optarg);
+                if (admin_port <= 0 || admin_port > 65535) {
+                    fprintf(stderr, "Invalid admin port: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                backlog = atoi(optarg);
+                if (backlog <= 0) {
+                    fprintf(stderr, "Invalid listen backlog: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                // Prefork: a master supervising this many worker processes
+                workers = atoi(optarg);
+                if (workers <= 0 || workers > MAX_WORKERS) {
+                    fprintf(stderr, "Invalid worker count: %s (1-%d)\n", optarg, MAX_WORKERS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'O':
+                // Threads running the routes flagged as blocking
+                offload_threads = atoi(optarg);
+                if (offload_threads < 0 || offload_threads > OFFLOAD_MAX_THREADS) {
+                    fprintf(stderr, "Invalid offload pool size: %s (0-%d)\n", optarg, OFFLOAD_MAX_THREADS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'Q':
+                // Queueing delay target for admission control
+                admission_target = atoi(optarg);
+                if (admission_target < 0) {
+                    fprintf(stderr, "Invalid admission target: %s ms\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'R':
+                reuseport = 1;
+                break;
+            case 'N':
+                // Workers grouped per NUMA node, each with node-local memory and listener
+                numa = 1;
+                break;
+            case 'U':
+                // Extra listener on a Unix domain socket, '@name' for the abstract namespace
+                if (unix_count == MAX_UNIX_LISTENERS) {
+                    fprintf(stderr, "At most %d Unix socket listeners\n", MAX_UNIX_LISTENERS);
+                    exit(EXIT_FAILURE);
+                }
+                unix_specs[unix_count++] = optarg;
+                break;
+            case 'L':
+                // Binary access log segments instead of access.log
+                binlog_dir = optarg;
+                break;
+            case 'c':
+                cert_file = optarg;
+                break;
+            case 'k':
+                key_file = optarg;
+                break;
+            case 'r': {
+                // Per-connection rate for large files, with an optional K/M/G suffix
+                char *end;
+                unsigned long long rate = strtoull(optarg, &end, 10);
+                const char *units = "KMG";
+                const char *unit = *end ? strchr(units, toupper((unsigned char)*end)) : NULL;
+                if (unit) {
+                    rate <<= 10 * (unit - units + 1);
+                    end++;
+                }
+                if (end == optarg || *end != '\0') {
+                    fprintf(stderr, "Invalid rate: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                largefile_set_rate(rate);
+                break;
+            }
+            case 'T':
+                // Sample every Nth request into the /trace rings
+                trace_init((unsigned int)atoi(optarg));
+                break;
+            case 'P':
+                if (proxy_add_route(optarg) < 0) {
+                    fprintf(stderr, "Invalid proxy route: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-P /prefix/=host:port[,host:port...][;balance=round_robin|least_conn][;health=/path]]\n"
+                                "          [-S https_port -c cert.pem -k key.pem] [-r bytes_per_sec[K|M|G]] [-T sample_every]\n"
+                                "          [-A admin_port] [-L binary_log_dir] [-b backlog] [-O offload_threads] [-Q target_ms]\n"
+                                "          [-U /path.sock|@abstract] [-w workers [-R]] [-N] [port]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    // Remaining argument is the port
+    if (optind < argc) {
+        port = atoi(argv[optind]);
+        if (port <= 0 || port > 65535) {
+            fprintf(stderr, "Invalid port number. Using default: %d\n", PORT);
+            port = PORT;
+        }
+    }
+    
+    // NUMA mode: by default one worker per node, each accepting on its own
+    // SO_REUSEPORT listener, which a steering program picks for connections
+    // whose packets arrive on that node
+    if (numa) {
+        int nodes = placement_init();
+        if (workers == 0) workers = nodes < MAX_WORKERS ? nodes : MAX_WORKERS;
+        reuseport = 1;
+    }
+
+    // Initialize server statistics (shared with the workers in prefork mode)
+    if (stats_init(workers > 0 ? workers : 1) < 0) {
+        perror("Statistics setup failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Set up signal handler
+    signal(SIGINT, handle_signal);
+    signal(SIGPIPE, SIG_IGN);  // Peers closing mid-response must not kill the server
+    
+    if (resolve_init(WEBROOT) < 0) {
+        fprintf(stderr, "Warning: webroot %s not found, only embedded files will be served\n", WEBROOT);
+    }
+    if (load_page_templates() < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (tls_port > 0 && (!cert_file || !key_file || tls_init(cert_file, key_file) < 0)) {
+        fprintf(stderr, "HTTPS needs a valid certificate (-c) and private key (-k)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Workers inherit one shared socket per port, unless each of them binds
+    // its own with SO_REUSEPORT after the fork
+    int server_fd = -1;
+    int tls_fd = -1;
+    int numa_fds[MAX_WORKERS];
+    int numa_tls_fds[MAX_WORKERS];
+    if (!reuseport || workers == 0) {
+        server_fd = create_listener(port, backlog, reuseport);
+        if (tls_port > 0) tls_fd = create_listener(tls_port, backlog, reuseport);
+    } else if (numa) {
+        // The master binds every worker's listener in worker order, so each
+        // one's index in the reuseport group is its worker, which is what the
+        // steering program returns. Holding them all keeps that order (and
+        // a restarting worker's queue) when a worker dies.
+        for (int i = 0; i < workers; i++) {
+            numa_fds[i] = create_listener(port, backlog, 1);
+            if (tls_port > 0) numa_tls_fds[i] = create_listener(tls_port, backlog, 1);
+        }
+        if (placement_steer(numa_fds[0], workers) < 0 ||
+            (tls_port > 0 && placement_steer(numa_tls_fds[0], workers) < 0)) {
+            perror("Warning: NUMA steering program not attached, connections are spread by hash");
+        }
+    } else {
+        // Fail here rather than in every worker if a port is taken
+        close(create_listener(port, backlog, 1));
+        if (tls_port > 0) close(create_listener(tls_port, backlog, 1));
+    }
+
+    // Unix sockets cannot be balanced by SO_REUSEPORT, so workers always
+    // share them
+    int unix_fds[MAX_UNIX_LISTENERS];
+    for (int i = 0; i < unix_count; i++) {
+        unix_fds[i] = unixsock_listen(unix_specs[i], backlog);
+        if (unix_fds[i] < 0) {
+            fprintf(stderr, "Could not listen on Unix socket %s: %s\n", unix_specs[i], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
     printf("Server running on port %d...\n", port);
     printf("Available endpoints:\n");
     printf("  - http://localhost:%d/ (Homepage)\n", port);
     printf("  - http://localhost:%d/time (Server time)\n", port);
     printf("  - http://localhost:%d/status (Server status)\n", port);
     printf("  - http://localhost:%d/echo (Form demo)\n", port);
+    printf("  - http://localhost:%d/events/time, /events/status (SSE or WebSocket push)\n", port);
+    for (int i = 0; routes[i].handler != NULL; i++) {
+        if (routes[i].kind == ROUTE_PROXY) {
+            printf("  - http://localhost:%d%s (Proxy, %d upstream%s)\n", port, routes[i].path,
+                   routes[i].upstream->server_count, routes[i].upstream->server_count == 1 ? "" : "s");
+        }
+    }
+    if (tls_port > 0) {
+        printf("  - https://localhost:%d/ (HTTPS)\n", tls_port);
+    }
+    if (admin_port > 0) {
+        printf("  - http://127.0.0.1:%d/ (Admin, localhost only)\n", admin_port);
+    }
+    for (int i = 0; i < unix_count; i++) {
+        printf("  - unix:%s (Unix socket)\n", unix_specs[i]);
+    }
     printf("\nPress Ctrl+C to stop the server.\n\n");
 
+    int worker = 0;
+    if (workers > 0) {
+        worker = prefork_start(workers);
+        if (numa) {
+            if (placement_bind(worker, workers) < 0) {
+                perror("NUMA placement failed");
+            }
+            // Recompiled so the pages every request reads are node-local
+            if (load_page_templates() < 0) exit(EXIT_FAILURE);
+        }
+        if (numa) {
+            for (int i = 0; i < workers; i++) {
+                if (i == worker) continue;
+                close(numa_fds[i]);
+                if (tls_port > 0) close(numa_tls_fds[i]);
+            }
+            server_fd = numa_fds[worker];
+            if (tls_port > 0) tls_fd = numa_tls_fds[worker];
+        } else if (reuseport) {
+            server_fd = create_listener(port, backlog, 1);
+            if (tls_port > 0) tls_fd = create_listener(tls_port, backlog, 1);
+        }
+    }
+
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (binlog_dir && binlog_open(binlog_dir) < 0) {
+        fprintf(stderr, "Could not open the binary access log in %s\n", binlog_dir);
+        exit(EXIT_FAILURE);
+    }
+    // Only one process can own the admin port
+    if (admin_port > 0 && worker == 0 && admin_start(admin_port) < 0) {
+        fprintf(stderr, "Could not start the admin listener on 127.0.0.1:%d\n", admin_port);
+        exit(EXIT_FAILURE);
+    }
+
+    proxy_start_health_checks();
+    push_start();
+    admission_init(admission_target, ADMISSION_INTERVAL_MS);
+    if (offload_start(offload_threads) < 0) {
+        fprintf(stderr, "Could not start the offload pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct pollfd listeners[2 + MAX_UNIX_LISTENERS] = {
+        { server_fd, POLLIN, 0 },
+        { tls_fd, POLLIN, 0 }  // Negative fd is ignored by poll()
+    };
+    int listener_count = 2;
+    for (int i = 0; i < unix_count; i++) {
+        listeners[listener_count].fd = unix_fds[i];
+        listeners[listener_count++].events = POLLIN;
+    }
+
     while (1) {
-        client_socket = malloc(sizeof(int));
-        *client_socket = accept(server_fd, (struct sockaddr*)&client_addr, &addr_len);
-        if (*client_socket < 0) {
-            perror("Accept failed");
-            free(client_socket);
+        // The timeout keeps path-cache maintenance going while no one connects
+        int ready = poll(listeners, listener_count, RESOLVE_MAINTAIN_MS);
+        resolve_maintain();
+        if (ready < 0) {
+            if (errno != EINTR) perror("Poll failed");
             continue;
         }
 
-        pthread_t thread_id;
-        pthread_create(&thread_id, NULL, handle_client, client_socket);
-        pthread_detach(thread_id);
+        for (int i = 0; i < listener_count; i++) {
+            if (listeners[i].revents & POLLIN) {
+                accept_connections(listeners[i].fd, listeners[i].fd == tls_fd);
+            }
+        }
     }
 
     close(server_fd);
     return 0;
 }
+#endif
@@ -0,0 +1,180 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#define PORT 8080
+#define BUFFER_SIZE 4096
+#define MAX_HEADERS 50
+#define MAX_ROUTES 64
+#define MAX_WORKERS 64  // Most processes in prefork mode
+#define WEBROOT "./www"
+#define LOG_FILE "access.log"
+#define ERROR_LOG_FILE "error.log"
+#define SERVER_VERSION "C-HTTP-Server/2.0"
+#define SEND_TIMEOUT 30  // Seconds a client may leave the socket full before it is dropped
+#define RECV_TIMEOUT 30  // Seconds a client may pause while sending its request
+#define LISTEN_BACKLOG 1024  // Default listen() backlog (the kernel caps it at somaxconn)
+#define ACCEPT_BATCH 64      // Connections accepted per listener per wakeup
+
+// HTTP status codes
+#define HTTP_OK 200
+#define HTTP_NOT_MODIFIED 304
+#define HTTP_BAD_REQUEST 400
+#define HTTP_NOT_FOUND 404
+#define HTTP_METHOD_NOT_ALLOWED 405
+#define HTTP_PAYLOAD_TOO_LARGE 413
+#define HTTP_INTERNAL_SERVER_ERROR 500
+#define HTTP_BAD_GATEWAY 502
+#define HTTP_SERVICE_UNAVAILABLE 503
+#define HTTP_GATEWAY_TIMEOUT 504
+
+// Counters of one server process, each on its own cache line
+typedef struct {
+    unsigned long request_count;
+    unsigned long bytes_sent;
+    int pid;                // 0 while the process is not running
+    int respawns;           // Times the master restarted this worker
+    int numa_node;          // Node table index the worker is placed on (-N)
+    unsigned long local_accepts;   // Connections whose packets were processed on that node
+    unsigned long remote_accepts;  // ... and on another one
+} __attribute__((aligned(64))) StatsSlot;
+
+// Server statistics, in memory shared by the master and its workers
+typedef struct {
+    time_t start_time;
+    int process_count;      // Slots in use
+    StatsSlot slots[MAX_WORKERS];
+} ServerStats;
+
+// Global server statistics, and the calling process's slot (see prefork.c)
+extern ServerStats *server_stats;
+extern StatsSlot *stats_slot;
+
+// Accept loop counters, written by the main thread only
+typedef struct {
+    unsigned long accepted;
+    unsigned long wakeups;       // Poll wakeups that accepted at least one connection
+    unsigned long max_batch;     // Most connections accepted in one wakeup
+    unsigned long errors;        // Failed accept4() calls other than EAGAIN
+    unsigned long fd_shed;       // Connections closed at once because fds ran out
+} AcceptStats;
+
+// Logging verbosity, changeable at runtime from the admin listener
+typedef enum {
+    LOG_LEVEL_OFF = 0,
+    LOG_LEVEL_ERROR,   // Error log only
+    LOG_LEVEL_INFO     // Error and access logs
+} LogLevel;
+
+extern int log_level;
+
+// HTTP Header structure
+typedef struct {
+    char name[128];
+    char value[512];
+} HttpHeader;
+
+struct Route;
+struct BodyReader;
+
+// Structure for HTTP request data
+typedef struct {
+    char method[8];
+    char path[256];
+    char version[16];
+    HttpHeader headers[MAX_HEADERS];
+    int header_count;
+    char *body;           // Body bytes received with the headers (not copied or terminated)
+    size_t body_length;
+    struct BodyReader *body_reader;  // Streams the whole body, see body.h
+    struct Route *route;  // Matched route, set before the handler runs
+} HttpRequest;
+
+// Growable byte buffer
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} ByteBuffer;
+
+struct ssl_st;
+struct OutputQueue;
+struct H2Stream;
+
+// Client connection that handlers write their response to
+typedef struct {
+    int fd;
+    ByteBuffer *capture;  // When set, output is collected here instead of sent
+    struct ssl_st *ssl;   // TLS session for HTTPS connections, NULL for plaintext
+    struct OutputQueue *out;  // When set, output is queued and flushed as the socket drains
+    unsigned long long accepted_at;  // Cycle count at accept(), for tracing
+    unsigned long long accepted_ns;  // Monotonic arrival time, for admission control (0 if not applicable)
+    struct H2Stream *h2_stream;  // When set, output is framed as DATA on this HTTP/2 stream
+} Connection;
+
+// Route handler function type
+typedef void (*RouteHandler)(Connection *conn, HttpRequest *request, const char *client_ip);
+
+// Kind of route: in-process C handler or forwarded to an upstream group
+typedef enum {
+    ROUTE_HANDLER = 0,
+    ROUTE_PROXY,
+    ROUTE_PUSH       // Long-lived SSE or WebSocket subscription to a broadcast channel
+} RouteKind;
+
+struct UpstreamGroup;
+struct PushChannel;
+
+// Opt-in response caching for a route
+typedef struct {
+    int ttl_ms;          // 0 disables caching
+    int stale_ms;        // Extra time an expired response may be served while refreshing
+    const char *vary;    // Comma-separated request headers that are part of the cache key
+    int by_query;        // 1 if the query string is part of the key; ignored otherwise
+} RouteCachePolicy;
+
+// Route structure
+typedef struct Route {
+    char path[256];
+    char methods[32];  // Comma-separated list of allowed methods, "*" for any
+    RouteHandler handler;
+    RouteKind kind;
+    struct UpstreamGroup *upstream;  // Only for ROUTE_PROXY
+    RouteCachePolicy cache;
+    struct PushChannel *channel;     // Only for ROUTE_PUSH
+    int blocking;                    // Handler may block on disk or upstreams: run it on the offload pool
+} Route;
+
+// Dynamic routing table, terminated by an entry with a NULL handler
+extern Route routes[MAX_ROUTES];
+
+void update_stats(unsigned long bytes);
+void log_request(const char *client_ip, const char *method, const char *path, int status_code);
+void log_error(const char *message);
+const char* get_header_value(HttpRequest *request, const char *name);
+int buffer_append(ByteBuffer *buffer, const void *data, size_t len);
+void buffer_free(ByteBuffer *buffer);
+int conn_send(Connection *conn, const void *data, size_t len);
+int conn_sendv(Connection *conn, const struct iovec *iov, int count);
+int conn_write(Connection *conn, const void *data, size_t len);
+int conn_wait(Connection *conn, short events);
+ssize_t conn_recv(Connection *conn, void *buf, size_t len);
+int conn_sendfile(Connection *conn, int file_fd, off_t offset, size_t count);
+void send_response_header(Connection *conn, int status_code, const char *mime_type, size_t content_length);
+void send_response_header_extra(Connection *conn, int status_code, const char *mime_type,
+                                size_t content_length, const char *extra_headers);
+const char* get_status_text(int status_code);
+const char* get_mime_type(const char *path);
+int add_route(const Route *route);
+void parse_http_request(const char *request_str, size_t length, HttpRequest *request);
+void url_decode(char *dst, const char *src);
+Route* find_route(const char *path, const char *method);
+void dispatch_request(Connection *conn, HttpRequest *request, const char *client_ip);
+int load_page_templates(void);
+
+#endif
@@ -0,0 +1,615 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "admin.h"
+#include "cache.h"
+#include "resolve.h"
+#include "outq.h"
+#include "assets.h"
+#include "trace.h"
+
+// Registry record of one client connection. The owning thread is the only
+// writer; the admin thread reads counters with relaxed atomics and the
+// request strings under a sequence counter, so neither side ever waits.
+typedef struct ConnSlot {
+    unsigned int seq;         // Odd while the owner rewrites the strings below
+    int in_use;               // Owned by a live connection
+    int fd;
+    int state;
+    char client_ip[INET6_ADDRSTRLEN];
+    char method[8];
+    char path[ADMIN_PATH_SIZE];
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long requests;
+    unsigned long queued;     // Output queue depth at the owner's last update
+    long long opened_ms;
+    struct ConnSlot *next;
+} ConnSlot;
+
+// Snapshot of a slot taken by the admin thread
+typedef struct {
+    int fd;
+    int state;
+    char client_ip[INET6_ADDRSTRLEN];
+    char method[8];
+    char path[ADMIN_PATH_SIZE];
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long requests;
+    unsigned long queued;
+    long long opened_ms;
+} ConnView;
+
+// One admin endpoint
+typedef struct {
+    const char *path;
+    const char *method;
+    void (*handler)(Connection *conn, const char *query);
+} AdminRoute;
+
+static const char *state_names[CONN_STATE_COUNT] = {
+    "handshake", "reading", "handling", "sending", "http2", "push"
+};
+
+static const char *level_names[] = { "off", "error", "info" };
+
+static int admin_enabled = 0;
+static ConnSlot *slots = NULL;
+static __thread ConnSlot *thread_slot = NULL;
+static __thread struct OutputQueue *thread_out = NULL;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Claims a free slot, adding one when every slot is taken
+ */
+static ConnSlot* claim_slot(void) {
+    ConnSlot *slot;
+    for (slot = __atomic_load_n(&slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&slot->in_use, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return slot;
+        }
+    }
+
+    slot = calloc(1, sizeof(ConnSlot));
+    if (!slot) return NULL;
+    slot->in_use = 1;
+    slot->next = __atomic_load_n(&slots, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&slots, &slot->next, slot, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return slot;
+}
+
+/**
+ * Rewrites a slot's strings; readers that overlap the write retry
+ */
+static void set_request(ConnSlot *slot, const char *method, const char *path) {
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    snprintf(slot->method, sizeof(slot->method), "%s", method);
+    // Paths longer than the slot are cut and marked, the view is for people
+    if (snprintf(slot->path, sizeof(slot->path), "%s", path) >= (int)sizeof(slot->path)) {
+        memcpy(slot->path + sizeof(slot->path) - 4, "...", 4);
+    }
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Registers the calling thread's connection
+ */
+void admin_conn_open(int fd, const char *client_ip, struct OutputQueue *out, ConnState state) {
+    if (!__atomic_load_n(&admin_enabled, __ATOMIC_RELAXED)) return;
+
+    ConnSlot *slot = claim_slot();
+    if (!slot) return;
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    snprintf(slot->client_ip, sizeof(slot->client_ip), "%s", client_ip);
+    slot->method[0] = '\0';
+    slot->path[0] = '\0';
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&slot->fd, fd, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->state, state, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bytes_in, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bytes_out, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->requests, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->queued, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->opened_ms, now_ms(), __ATOMIC_RELAXED);
+    thread_slot = slot;
+    thread_out = out;
+}
+
+/**
+ * Records what the connection is doing, and the request it is serving
+ */
+void admin_conn_state(ConnState state, const HttpRequest *request) {
+    ConnSlot *slot = thread_slot;
+    if (!slot) return;
+    if (request) set_request(slot, request->method, request->path);
+    __atomic_store_n(&slot->state, state, __ATOMIC_RELAXED);
+    if (thread_out) __atomic_store_n(&slot->queued, thread_out->pending, __ATOMIC_RELAXED);
+}
+
+void admin_conn_received(size_t bytes) {
+    ConnSlot *slot = thread_slot;
+    if (!slot) return;
+    __atomic_store_n(&slot->bytes_in, slot->bytes_in + bytes, __ATOMIC_RELAXED);
+}
+
+void admin_conn_sent(size_t bytes) {
+    ConnSlot *slot = thread_slot;
+    if (!slot) return;
+    __atomic_store_n(&slot->bytes_out, slot->bytes_out + bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->requests, slot->requests + 1, __ATOMIC_RELAXED);
+    if (thread_out) __atomic_store_n(&slot->queued, thread_out->pending, __ATOMIC_RELAXED);
+}
+
+/**
+ * Returns the calling thread's slot to the registry
+ */
+void admin_conn_close(void) {
+    ConnSlot *slot = thread_slot;
+    if (!slot) return;
+    thread_slot = NULL;
+    thread_out = NULL;
+    __atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copies a live slot. Returns 0 when the slot is free.
+ */
+static int read_slot(ConnSlot *slot, ConnView *view) {
+    if (!__atomic_load_n(&slot->in_use, __ATOMIC_ACQUIRE)) return 0;
+
+    unsigned int seq;
+    do {
+        while ((seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) & 1) sched_yield();
+        memcpy(view->client_ip, slot->client_ip, sizeof(view->client_ip));
+        memcpy(view->method, slot->method, sizeof(view->method));
+        memcpy(view->path, slot->path, sizeof(view->path));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq);
+    view->client_ip[sizeof(view->client_ip) - 1] = '\0';
+    view->method[sizeof(view->method) - 1] = '\0';
+    view->path[sizeof(view->path) - 1] = '\0';
+
+    view->fd = __atomic_load_n(&slot->fd, __ATOMIC_RELAXED);
+    view->state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+    view->bytes_in = __atomic_load_n(&slot->bytes_in, __ATOMIC_RELAXED);
+    view->bytes_out = __atomic_load_n(&slot->bytes_out, __ATOMIC_RELAXED);
+    view->requests = __atomic_load_n(&slot->requests, __ATOMIC_RELAXED);
+    view->queued = __atomic_load_n(&slot->queued, __ATOMIC_RELAXED);
+    view->opened_ms = __atomic_load_n(&slot->opened_ms, __ATOMIC_RELAXED);
+    if (view->state < 0 || view->state >= CONN_STATE_COUNT) view->state = CONN_HANDLING;
+    return 1;
+}
+
+/**
+ * Appends formatted text to a JSON document
+ */
+static int json_printf(ByteBuffer *out, const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (len < 0) return -1;
+    if ((size_t)len >= sizeof(text)) len = sizeof(text) - 1;
+    return buffer_append(out, text, len);
+}
+
+/**
+ * Appends a quoted, escaped JSON string
+ */
+static int json_string(ByteBuffer *out, const char *value) {
+    if (buffer_append(out, "\"", 1) < 0) return -1;
+    for (const unsigned char *p = (const unsigned char*)value; *p; p++) {
+        char escaped[8];
+        int len;
+        if (*p == '"' || *p == '\\') {
+            len = snprintf(escaped, sizeof(escaped), "\\%c", *p);
+        } else if (*p < 0x20) {
+            len = snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+        } else {
+            escaped[0] = *p;
+            len = 1;
+        }
+        if (buffer_append(out, escaped, len) < 0) return -1;
+    }
+    return buffer_append(out, "\"", 1);
+}
+
+/**
+ * Copies the value of a query parameter. Returns 0 when it is absent.
+ */
+static int query_param(const char *query, const char *name, char *value, size_t value_len) {
+    size_t name_len = strlen(name);
+    for (const char *p = query; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+        if (strncmp(p, name, name_len) != 0 || p[name_len] != '=') continue;
+        const char *start = p + name_len + 1;
+        size_t len = strcspn(start, "&");
+        if (len >= value_len) len = value_len - 1;
+        memcpy(value, start, len);
+        value[len] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Sends a complete admin response
+ */
+static void admin_reply(Connection *conn, int status_code, const char *mime_type, const char *body, size_t len) {
+    send_response_header(conn, status_code, mime_type, len);
+    conn_send(conn, body, len);
+}
+
+static void admin_error(Connection *conn, int status_code, const char *message) {
+    char body[256];
+    int len = snprintf(body, sizeof(body), "{\"error\":\"%s\"}\n", message);
+    admin_reply(conn, status_code, "application/json", body, len);
+}
+
+static void admin_json(Connection *conn, ByteBuffer *json, int result) {
+    if (result < 0) {
+        admin_error(conn, HTTP_INTERNAL_SERVER_ERROR, "out of memory");
+    } else {
+        admin_reply(conn, HTTP_OK, "application/json", json->data, json->len);
+    }
+    buffer_free(json);
+}
+
+/**
+ * GET /connections: every open client connection
+ */
+static void admin_connections(Connection *conn, const char *query) {
+    (void)query;
+    ByteBuffer json = {NULL, 0, 0};
+    long long now = now_ms();
+    int result = buffer_append(&json, "{\"connections\":[", 16);
+    int first = 1;
+
+    for (ConnSlot *slot = __atomic_load_n(&slots, __ATOMIC_ACQUIRE); slot && result == 0; slot = slot->next) {
+        ConnView view;
+        if (!read_slot(slot, &view)) continue;
+
+        result |= json_printf(&json, "%s{\"fd\":%d,\"client_ip\":", first ? "" : ",", view.fd);
+        result |= json_string(&json, view.client_ip);
+        result |= json_printf(&json, ",\"state\":\"%s\",\"method\":", state_names[view.state]);
+        result |= json_string(&json, view.method);
+        result |= json_printf(&json, ",\"path\":");
+        result |= json_string(&json, view.path);
+        result |= json_printf(&json, ",\"requests\":%lu,\"bytes_in\":%lu,\"bytes_out\":%lu,"
+                                     "\"queued_bytes\":%lu,\"age_ms\":%lld}",
+                              view.requests, view.bytes_in, view.bytes_out, view.queued, now - view.opened_ms);
+        first = 0;
+    }
+    if (result == 0) result = buffer_append(&json, "]}\n", 3);
+    admin_json(conn, &json, result);
+}
+
+/**
+ * GET /workers: connection threads by state and their output queue depths
+ */
+static void admin_workers(Connection *conn, const char *query) {
+    (void)query;
+    int threads = 0;
+    int by_state[CONN_STATE_COUNT] = {0};
+    unsigned long queued = 0, max_queued = 0;
+
+    for (ConnSlot *slot = __atomic_load_n(&slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+        ConnView view;
+        if (!read_slot(slot, &view)) continue;
+        threads++;
+        by_state[view.state]++;
+        queued += view.queued;
+        if (view.queued > max_queued) max_queued = view.queued;
+    }
+
+    OutqStats outq;
+    outq_get_stats(&outq);
+
+    ByteBuffer json = {NULL, 0, 0};
+    int result = json_printf(&json, "{\"model\":\"thread-per-connection\",\"threads\":%d,\"states\":{", threads);
+    for (int i = 0; i < CONN_STATE_COUNT; i++) {
+        result |= json_printf(&json, "%s\"%s\":%d", i ? "," : "", state_names[i], by_state[i]);
+    }
+    result |= json_printf(&json, "},\"queued_bytes\":%lu,\"max_queued_bytes\":%lu,"
+                                 "\"output_queues\":{\"flushes\":%lu,\"partial_writes\":%lu,\"waits\":%lu,"
+                                 "\"cap_stalls\":%lu,\"peak_buffered\":%zu}}\n",
+                          queued, max_queued, outq.flushes, outq.partial_writes, outq.waits,
+                          outq.cap_stalls, outq.peak_buffered);
+    admin_json(conn, &json, result);
+}
+
+// Accumulates a cache listing, bounded by ADMIN_MAX_ENTRIES
+typedef struct {
+    ByteBuffer *json;
+    int listed;
+    int result;
+} CacheListing;
+
+static void list_response(const char *key, size_t len, long long expires_in_ms, void *arg) {
+    CacheListing *listing = arg;
+    if (listing->result < 0 || listing->listed >= ADMIN_MAX_ENTRIES) return;
+    listing->result |= json_printf(listing->json, "%s{\"key\":", listing->listed ? "," : "");
+    listing->result |= json_string(listing->json, key);
+    listing->result |= json_printf(listing->json, ",\"bytes\":%zu,\"expires_in_ms\":%lld}", len, expires_in_ms);
+    listing->listed++;
+}
+
+static void list_path(const ResolvedPath *resolved, long long expires_in_ms, void *arg) {
+    CacheListing *listing = arg;
+    if (listing->result < 0 || listing->listed >= ADMIN_MAX_ENTRIES) return;
+    listing->result |= json_printf(listing->json, "%s{\"path\":", listing->listed ? "," : "");
+    listing->result |= json_string(listing->json, resolved->path);
+    if (resolved->fd >= 0) {
+        listing->result |= json_printf(listing->json, ",\"bytes\":%lld,\"mime_type\":",
+                                       (long long)resolved->st.st_size);
+        listing->result |= json_string(listing->json, resolved->mime_type ? resolved->mime_type : "");
+    } else {
+        listing->result |= json_printf(listing->json, ",\"error\":");
+        listing->result |= json_string(listing->json, strerror(resolved->error));
+    }
+    listing->result |= json_printf(listing->json, ",\"expires_in_ms\":%lld}", expires_in_ms);
+    listing->listed++;
+}
+
+static double hit_ratio(unsigned long hits, unsigned long misses) {
+    return hits + misses ? (double)hits / (hits + misses) : 0.0;
+}
+
+/**
+ * GET /caches: response cache, path cache and embedded assets
+ */
+static void admin_caches(Connection *conn, const char *query) {
+    (void)query;
+    CacheStats cache;
+    ResolveStats resolve;
+    cache_get_stats(&cache);
+    resolve_get_stats(&resolve);
+
+    ByteBuffer json = {NULL, 0, 0};
+    CacheListing listing = { &json, 0, 0 };
+    listing.result = json_printf(&json, "{\"responses\":{\"hits\":%lu,\"stale_hits\":%lu,\"misses\":%lu,"
+                                        "\"coalesced\":%lu,\"hit_ratio\":%.4f,\"entries\":%d,\"keys\":[",
+                                 cache.hits, cache.stale_hits, cache.misses, cache.coalesced,
+                                 hit_ratio(cache.hits + cache.stale_hits, cache.misses), cache.entries);
+    cache_for_each(list_response, &listing);
+
+    listing.result |= json_printf(&json, "]},\"paths\":{\"hits\":%lu,\"misses\":%lu,\"hit_ratio\":%.4f,"
+                                         "\"entries\":%d,\"items\":[",
+                                  resolve.hits, resolve.misses, hit_ratio(resolve.hits, resolve.misses),
+                                  resolve.entries);
+    listing.listed = 0;
+    resolve_for_each(list_path, &listing);
+
+    listing.result |= json_printf(&json, "]},\"embedded_assets\":%zu}\n", embedded_asset_count);
+    admin_json(conn, &json, listing.result);
+}
+
+/**
+ * POST /cache/purge?target=all|responses|paths
+ */
+static void admin_cache_purge(Connection *conn, const char *query) {
+    char target[16] = "all";
+    query_param(query, "target", target, sizeof(target));
+
+    int responses = strcmp(target, "all") == 0 || strcmp(target, "responses") == 0;
+    int paths = strcmp(target, "all") == 0 || strcmp(target, "paths") == 0;
+    if (!responses && !paths) {
+        admin_error(conn, HTTP_BAD_REQUEST, "target must be all, responses or paths");
+        return;
+    }
+
+    int responses_purged = 0, paths_purged = 0;
+    if (responses) {
+        CacheStats before, after;
+        cache_get_stats(&before);
+        cache_purge();
+        cache_get_stats(&after);
+        responses_purged = before.entries - after.entries;
+    }
+    if (paths) {
+        paths_purged = resolve_purge();
+    }
+
+    char body[128];
+    int len = snprintf(body, sizeof(body), "{\"target\":\"%s\",\"responses_purged\":%d,\"paths_purged\":%d}\n",
+                       target, responses_purged, paths_purged);
+    admin_reply(conn, HTTP_OK, "application/json", body, len);
+}
+
+static void reply_log_level(Connection *conn) {
+    int current = __atomic_load_n(&log_level, __ATOMIC_RELAXED);
+    char body[64];
+    int len = snprintf(body, sizeof(body), "{\"level\":\"%s\"}\n", level_names[current]);
+    admin_reply(conn, HTTP_OK, "application/json", body, len);
+}
+
+/**
+ * GET /log-level
+ */
+static void admin_log_level(Connection *conn, const char *query) {
+    (void)query;
+    reply_log_level(conn);
+}
+
+/**
+ * POST /log-level?level=off|error|info
+ */
+static void admin_set_log_level(Connection *conn, const char *query) {
+    char level[16] = "";
+    query_param(query, "level", level, sizeof(level));
+
+    for (int i = 0; i <= LOG_LEVEL_INFO; i++) {
+        if (strcmp(level, level_names[i]) == 0) {
+            __atomic_store_n(&log_level, i, __ATOMIC_RELAXED);
+            reply_log_level(conn);
+            return;
+        }
+    }
+    admin_error(conn, HTTP_BAD_REQUEST, "level must be off, error or info");
+}
+
+/**
+ * GET /trace: sampled request phases as Chrome trace JSON
+ */
+static void admin_trace(Connection *conn, const char *query) {
+    (void)query;
+    ByteBuffer json = {NULL, 0, 0};
+    admin_json(conn, &json, trace_dump_json(&json));
+}
+
+static const AdminRoute admin_routes[] = {
+    {"/connections", "GET", admin_connections},
+    {"/workers", "GET", admin_workers},
+    {"/caches", "GET", admin_caches},
+    {"/cache/purge", "POST", admin_cache_purge},
+    {"/log-level", "GET", admin_log_level},
+    {"/log-level", "POST", admin_set_log_level},
+    {"/trace", "GET", admin_trace},
+    {NULL, NULL, NULL}
+};
+
+/**
+ * GET /: the endpoint list
+ */
+static void admin_index(Connection *conn) {
+    ByteBuffer json = {NULL, 0, 0};
+    int result = buffer_append(&json, "{\"endpoints\":[", 14);
+    for (int i = 0; admin_routes[i].path; i++) {
+        result |= json_printf(&json, "%s\"%s %s\"", i ? "," : "", admin_routes[i].method, admin_routes[i].path);
+    }
+    result |= buffer_append(&json, "]}\n", 3);
+    admin_json(conn, &json, result);
+}
+
+/**
+ * Reads one request from an admin client and answers it
+ */
+static void serve_admin_client(int client_fd) {
+    struct timeval timeout = { ADMIN_TIMEOUT, 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char buffer[BUFFER_SIZE];
+    size_t len = 0;
+    while (len < sizeof(buffer) - 1) {
+        ssize_t n = recv(client_fd, buffer + len, sizeof(buffer) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+        buffer[len] = '\0';
+        if (strstr(buffer, "\r\n\r\n")) break;
+    }
+    if (len == 0) return;
+    buffer[len] = '\0';
+
+    Connection conn = { client_fd, NULL, NULL, NULL, 0, 0, NULL };
+    HttpRequest request;
+    parse_http_request(buffer, len, &request);
+    if (request.method[0] == '\0') {
+        admin_error(&conn, HTTP_BAD_REQUEST, "malformed request");
+        return;
+    }
+
+    char *query = strchr(request.path, '?');
+    if (query) *query++ = '\0';
+
+    if (strcmp(request.path, "/") == 0) {
+        admin_index(&conn);
+        return;
+    }
+
+    int path_found = 0;
+    for (int i = 0; admin_routes[i].path; i++) {
+        if (strcmp(admin_routes[i].path, request.path) != 0) continue;
+        path_found = 1;
+        if (strcmp(admin_routes[i].method, request.method) == 0) {
+            admin_routes[i].handler(&conn, query);
+            return;
+        }
+    }
+    if (path_found) {
+        admin_error(&conn, HTTP_METHOD_NOT_ALLOWED, "method not allowed");
+    } else {
+        admin_error(&conn, HTTP_NOT_FOUND, "not found");
+    }
+}
+
+/**
+ * Admin thread: one client at a time, so a burst of admin requests can
+ * never take threads or CPU away from the data path
+ */
+static void* admin_thread(void *arg) {
+    int listen_fd = (int)(long)arg;
+    int failing = 0;
+    while (1) {
+        int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            // Out of descriptors (EMFILE/ENFILE) or memory: the connection stays
+            // pending, so pause rather than spin, and log once per failing run
+            if (!failing) log_error("Admin accept failed");
+            failing = 1;
+            struct timespec pause = { 0, 10000000 };
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        failing = 0;
+        serve_admin_client(client_fd);
+        close(client_fd);
+    }
+    return NULL;
+}
+
+/**
+ * Starts the admin listener on 127.0.0.1:port and enables the connection
+ * registry
+ */
+int admin_start(int port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return -1;
+
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 8) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+
+    __atomic_store_n(&admin_enabled, 1, __ATOMIC_RELAXED);
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, admin_thread, (void*)(long)listen_fd) != 0) {
+        __atomic_store_n(&admin_enabled, 0, __ATOMIC_RELAXED);
+        close(listen_fd);
+        return -1;
+    }
+    pthread_detach(thread_id);
+    return 0;
+}
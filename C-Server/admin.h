@@ -0,0 +1,31 @@
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#include "Http_server.h"
+
+#define ADMIN_MAX_ENTRIES 256   // Cache entries listed per cache by /caches
+#define ADMIN_TIMEOUT 5         // Seconds an admin client may take to send its request
+#define ADMIN_PATH_SIZE 128     // Request path kept per connection for /connections
+
+// What a client connection's thread is doing, shown by /connections
+typedef enum {
+    CONN_HANDSHAKE = 0,
+    CONN_READING,
+    CONN_HANDLING,
+    CONN_SENDING,
+    CONN_HTTP2,
+    CONN_PUSH,          // Subscribed to an SSE or WebSocket channel
+    CONN_STATE_COUNT
+} ConnState;
+
+int admin_start(int port);
+
+// Connection registry, updated by each connection's own thread. These are
+// no-ops unless the admin listener was started.
+void admin_conn_open(int fd, const char *client_ip, struct OutputQueue *out, ConnState state);
+void admin_conn_state(ConnState state, const HttpRequest *request);
+void admin_conn_received(size_t bytes);
+void admin_conn_sent(size_t bytes);
+void admin_conn_close(void);
+
+#endif
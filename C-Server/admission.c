@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "admission.h"
+
+#define ADMISSION_STRINGIFY_(x) #x
+#define ADMISSION_STRINGIFY(x) ADMISSION_STRINGIFY_(x)
+
+static unsigned long long target_ns = 0;
+static unsigned long long interval_ns = 0;
+
+// Current interval, shared by every connection thread
+static unsigned long long interval_end_ns;
+static unsigned long long interval_min_ns = ~0ULL;
+static int overloaded;
+static unsigned long long last_min_ns;
+
+static unsigned long admitted_count;
+static unsigned long shed_count;
+static unsigned long shed_cheap_count;
+static unsigned long overload_count;
+static unsigned long screened_count;
+
+/**
+ * Sets the queueing delay target. A target of 0 admits everything.
+ */
+void admission_init(int target_ms, int interval_ms) {
+    target_ns = (unsigned long long)target_ms * 1000000ULL;
+    interval_ns = (unsigned long long)interval_ms * 1000000ULL;
+    interval_end_ns = admission_now() + interval_ns;
+}
+
+/**
+ * Monotonic clock in nanoseconds, stamped on connections at accept()
+ */
+unsigned long long admission_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Estimates when a just-accepted connection reached the server. Under
+ * overload the wait happens mostly in the kernel's accept queue, so the
+ * accept time is moved back by the age of the last packet received from
+ * the client (the handshake ACK, or the request if it is already in).
+ */
+unsigned long long admission_arrival(int fd) {
+    unsigned long long now = admission_now();
+    if (target_ns == 0) return now;
+
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) return now;
+    unsigned long long age = (unsigned long long)info.tcpi_last_ack_recv * 1000000ULL;
+    return age < now ? now - age : now;
+}
+
+/**
+ * Static files and routes answered from the response cache cost little
+ * more than the 503 would
+ */
+static int is_cheap(const char *method, const Route *route) {
+    if (!route) {
+        return strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0;
+    }
+    return route->kind == ROUTE_HANDLER && route->cache.ttl_ms > 0 && !route->blocking;
+}
+
+/**
+ * Folds one request's queueing delay into the current interval, closing
+ * the interval first if it has ended. Returns whether the server counts as
+ * overloaded: even the lowest delay of the last interval exceeded the
+ * target, so a standing queue has formed.
+ */
+static int sample(unsigned long long now, unsigned long long delay) {
+    // The first request past the end of an interval closes it, judged on
+    // the requests seen during it
+    unsigned long long end = __atomic_load_n(&interval_end_ns, __ATOMIC_RELAXED);
+    if (now >= end && __atomic_compare_exchange_n(&interval_end_ns, &end, now + interval_ns, 0,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        unsigned long long last = __atomic_exchange_n(&interval_min_ns, ~0ULL, __ATOMIC_RELAXED);
+        int above = last != ~0ULL && last > target_ns;
+        __atomic_store_n(&last_min_ns, last == ~0ULL ? 0 : last, __ATOMIC_RELAXED);
+        __atomic_store_n(&overloaded, above, __ATOMIC_RELAXED);
+        if (above) __atomic_add_fetch(&overload_count, 1, __ATOMIC_RELAXED);
+    }
+
+    unsigned long long min = __atomic_load_n(&interval_min_ns, __ATOMIC_RELAXED);
+    while (delay < min && !__atomic_compare_exchange_n(&interval_min_ns, &min, delay, 1,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return __atomic_load_n(&overloaded, __ATOMIC_RELAXED);
+}
+
+/**
+ * Whether a request that waited delay should be shed: while overloaded,
+ * anything that waited past the target, and cheap requests only once they
+ * have waited a whole interval
+ */
+static int should_shed(int is_overloaded, unsigned long long delay, int cheap) {
+    if (!is_overloaded || delay <= (cheap ? interval_ns : target_ns)) return 0;
+    __atomic_add_fetch(&shed_count, 1, __ATOMIC_RELAXED);
+    if (cheap) __atomic_add_fetch(&shed_cheap_count, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * Screens a plaintext connection in the accept loop, before a thread is
+ * spent on it. While overloaded, a connection that queued past the target
+ * gets a canned 503 straight away unless the request line already received
+ * names a cheap route. Returns 1 if the connection was answered and should
+ * be closed.
+ */
+int admission_screen(int fd, unsigned long long arrival_ns) {
+    if (target_ns == 0 || !__atomic_load_n(&overloaded, __ATOMIC_RELAXED)) return 0;
+
+    unsigned long long now = admission_now();
+    unsigned long long delay = now > arrival_ns ? now - arrival_ns : 0;
+    if (delay <= target_ns) return 0;
+
+    char buffer[512];
+    char method[8] = "";
+    char path[256] = "";
+    ssize_t n = recv(fd, buffer, sizeof(buffer) - 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) {
+        buffer[n] = '\0';
+        sscanf(buffer, "%7s %255s", method, path);
+    }
+    int cheap = method[0] && path[0] && is_cheap(method, find_route(path, method));
+    if (!should_shed(sample(now, delay), delay, cheap)) return 0;
+
+    static const char response[] =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Server: " SERVER_VERSION "\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: 32\r\n"
+        "Retry-After: " ADMISSION_STRINGIFY(ADMISSION_RETRY_AFTER) "\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "<h1>503 Service Unavailable</h1>";
+    send(fd, response, sizeof(response) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    // Consume what was received so close() sends a FIN rather than a reset
+    // that could destroy the response before the client reads it
+    if (n > 0) recv(fd, buffer, n, MSG_DONTWAIT);
+    shutdown(fd, SHUT_WR);
+    __atomic_add_fetch(&screened_count, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * CoDel-style admission at handler start, for requests that made it past
+ * the accept loop (and all HTTPS requests). Returns 1 to serve the request.
+ */
+int admission_admit(const Connection *conn, const HttpRequest *request) {
+    if (target_ns == 0 || conn->accepted_ns == 0) return 1;
+
+    unsigned long long now = admission_now();
+    unsigned long long delay = now > conn->accepted_ns ? now - conn->accepted_ns : 0;
+    if (should_shed(sample(now, delay), delay, is_cheap(request->method, request->route))) return 0;
+
+    __atomic_add_fetch(&admitted_count, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * Answers a shed request with a short 503 instead of running its handler
+ */
+void admission_reject(Connection *conn, HttpRequest *request, const char *client_ip) {
+    const char *body = "<h1>503 Service Unavailable</h1><p>Server overloaded, try again shortly.</p>";
+    char extra[64];
+    snprintf(extra, sizeof(extra), "Retry-After: %d\r\n", ADMISSION_RETRY_AFTER);
+    int head_only = strcmp(request->method, "HEAD") == 0;
+    send_response_header_extra(conn, HTTP_SERVICE_UNAVAILABLE, "text/html", strlen(body), extra);
+    if (!head_only) conn_send(conn, body, strlen(body));
+    log_request(client_ip, request->method, request->path, HTTP_SERVICE_UNAVAILABLE);
+}
+
+void admission_get_stats(AdmissionStats *stats) {
+    stats->target_ms = (int)(target_ns / 1000000ULL);
+    stats->overloaded = __atomic_load_n(&overloaded, __ATOMIC_RELAXED);
+    stats->min_delay_us = __atomic_load_n(&last_min_ns, __ATOMIC_RELAXED) / 1000;
+    stats->admitted = __atomic_load_n(&admitted_count, __ATOMIC_RELAXED);
+    stats->shed = __atomic_load_n(&shed_count, __ATOMIC_RELAXED);
+    stats->shed_cheap = __atomic_load_n(&shed_cheap_count, __ATOMIC_RELAXED);
+    stats->shed_at_accept = __atomic_load_n(&screened_count, __ATOMIC_RELAXED);
+    stats->overload_intervals = __atomic_load_n(&overload_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,30 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "Http_server.h"
+
+#define ADMISSION_TARGET_MS 5       // Default queueing delay target (-Q to change, 0 disables shedding)
+#define ADMISSION_INTERVAL_MS 100   // Window over which the minimum delay is taken
+#define ADMISSION_RETRY_AFTER 1     // Seconds clients are told to wait after a 503
+
+// Admission control counters
+typedef struct {
+    int target_ms;
+    int overloaded;                   // The last complete interval stayed above the target
+    unsigned long long min_delay_us;  // Lowest accept-to-handler delay in the last complete interval
+    unsigned long admitted;
+    unsigned long shed;
+    unsigned long shed_cheap;         // Of those, static files and cached routes
+    unsigned long shed_at_accept;     // Of those, answered by the accept loop without a thread
+    unsigned long overload_intervals;
+} AdmissionStats;
+
+void admission_init(int target_ms, int interval_ms);
+unsigned long long admission_now(void);
+unsigned long long admission_arrival(int fd);
+int admission_screen(int fd, unsigned long long arrival_ns);
+int admission_admit(const Connection *conn, const HttpRequest *request);
+void admission_reject(Connection *conn, HttpRequest *request, const char *client_ip);
+void admission_get_stats(AdmissionStats *stats);
+
+#endif
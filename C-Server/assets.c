@@ -0,0 +1,15 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "assets.h"
+
+static int compare_asset(const void *key, const void *entry) {
+    return strcmp(key, ((const EmbeddedAsset*)entry)->path);
+}
+
+/**
+ * Finds an embedded file by request path (binary search over the sorted table)
+ */
+const EmbeddedAsset* asset_lookup(const char *path) {
+    return bsearch(path, embedded_assets, embedded_asset_count, sizeof(EmbeddedAsset), compare_asset);
+}
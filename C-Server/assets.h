@@ -0,0 +1,24 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <stddef.h>
+
+// A webroot file compiled into the binary (see tools/embed_assets.c)
+typedef struct {
+    const char *path;                  // Request path, e.g. "/index.html"
+    const unsigned char *data;
+    size_t len;
+    const unsigned char *gzip_data;    // NULL when gzip would not be smaller
+    size_t gzip_len;
+    const char *etag;                  // Quoted, derived from the contents
+    const char *gzip_etag;             // The same with a "-gz" suffix, NULL without gzip_data
+    const char *mime_type;
+} EmbeddedAsset;
+
+// Generated table, sorted by path
+extern const EmbeddedAsset embedded_assets[];
+extern const size_t embedded_asset_count;
+
+const EmbeddedAsset* asset_lookup(const char *path);
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * Read-scaling microbenchmark: RcuMap versus the same chained table behind
+ * one mutex. Reader threads look up random keys for a fixed time while a
+ * writer replaces one entry per millisecond.
+ *
+ * Usage: map_bench [max_threads] [seconds_per_run]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../rcu.h"
+
+#define KEY_COUNT 1024
+#define BUCKETS 1024
+
+// Mutex-guarded baseline with the same layout as RcuMap
+typedef struct LockedNode {
+    struct LockedNode *next;
+    unsigned long hash;
+    void *value;
+    char key[64];
+} LockedNode;
+
+static LockedNode *locked_buckets[BUCKETS];
+static pthread_mutex_t locked_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static RcuMap rcu_map;
+static char keys[KEY_COUNT][64];
+static int values[KEY_COUNT];
+static volatile int stop;
+static int use_rcu;
+
+static unsigned long hash_key(const char *key) {
+    unsigned long hash = 2166136261UL;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static void* locked_lookup(const char *key) {
+    unsigned long hash = hash_key(key);
+    void *value = NULL;
+    pthread_mutex_lock(&locked_mutex);
+    for (LockedNode *node = locked_buckets[hash % BUCKETS]; node; node = node->next) {
+        if (node->hash == hash && strcmp(node->key, key) == 0) {
+            value = node->value;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&locked_mutex);
+    return value;
+}
+
+static void locked_insert(const char *key, void *value) {
+    unsigned long hash = hash_key(key);
+    pthread_mutex_lock(&locked_mutex);
+    LockedNode *node = locked_buckets[hash % BUCKETS];
+    while (node && strcmp(node->key, key) != 0) node = node->next;
+    if (!node) {
+        node = calloc(1, sizeof(LockedNode));
+        snprintf(node->key, sizeof(node->key), "%s", key);
+        node->hash = hash;
+        node->next = locked_buckets[hash % BUCKETS];
+        locked_buckets[hash % BUCKETS] = node;
+    }
+    node->value = value;
+    pthread_mutex_unlock(&locked_mutex);
+}
+
+static void* reader(void *arg) {
+    unsigned long *ops = arg;
+    unsigned int seed = (unsigned int)(unsigned long)arg;
+    unsigned long count = 0, sum = 0;
+
+    while (!stop) {
+        for (int i = 0; i < 1024; i++) {
+            const char *key = keys[rand_r(&seed) % KEY_COUNT];
+            if (use_rcu) {
+                rcu_read_lock();
+                int *value = rcu_map_lookup(&rcu_map, key);
+                if (value) sum += *value;
+                rcu_read_unlock();
+            } else {
+                int *value = locked_lookup(key);
+                if (value) sum += *value;
+            }
+        }
+        count += 1024;
+    }
+    *ops = count + (sum & 0);
+    return NULL;
+}
+
+static void* writer(void *arg) {
+    (void)arg;
+    unsigned int seed = 1;
+    while (!stop) {
+        int i = rand_r(&seed) % KEY_COUNT;
+        if (use_rcu) {
+            rcu_map_insert(&rcu_map, keys[i], &values[i]);
+        } else {
+            locked_insert(keys[i], &values[i]);
+        }
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static double run(int threads, int seconds) {
+    pthread_t tids[threads + 1];
+    unsigned long ops[threads];
+
+    stop = 0;
+    for (int i = 0; i < threads; i++) {
+        ops[i] = i + 1;
+        pthread_create(&tids[i], NULL, reader, &ops[i]);
+    }
+    pthread_create(&tids[threads], NULL, writer, NULL);
+    sleep(seconds);
+    stop = 1;
+
+    unsigned long total = 0;
+    for (int i = 0; i <= threads; i++) pthread_join(tids[i], NULL);
+    for (int i = 0; i < threads; i++) total += ops[i];
+    return total / (seconds * 1e6);
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN) * 2;
+    int seconds = argc > 2 ? atoi(argv[2]) : 1;
+    if (max_threads < 1) max_threads = 1;
+    if (seconds < 1) seconds = 1;
+
+    rcu_map_init(&rcu_map, BUCKETS, NULL);
+    for (int i = 0; i < KEY_COUNT; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "/assets/file-%04d.css", i);
+        values[i] = i;
+        rcu_map_insert(&rcu_map, keys[i], &values[i]);
+        locked_insert(keys[i], &values[i]);
+    }
+
+    printf("%ld online CPUs, %d keys, 1 writer at ~1000 updates/s\n",
+           sysconf(_SC_NPROCESSORS_ONLN), KEY_COUNT);
+    printf("%8s %16s %16s %8s\n", "threads", "rcu Mlookups/s", "mutex Mlookups/s", "ratio");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        use_rcu = 1;
+        double rcu = run(threads, seconds);
+        use_rcu = 0;
+        double locked = run(threads, seconds);
+        printf("%8d %16.2f %16.2f %7.1fx\n", threads, rcu, locked, locked > 0 ? rcu / locked : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+/**
+ * Microbenchmarks for the CPU-bound request path: request parsing, URL
+ * decoding, MIME lookup, routing and response header formatting. Reports
+ * ns/op and heap allocations per op (counted through the linker's --wrap
+ * of malloc/calloc/realloc) as JSON, one case per line, so the output of
+ * two commits can be compared with -c.
+ *
+ * Usage: micro_bench [-t ms_per_sample] [-c baseline.json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../Http_server.h"
+
+#define SAMPLES 5
+
+// Allocation counters, bumped by the wrappers below
+static unsigned long alloc_calls;
+static unsigned long alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    alloc_calls++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    alloc_calls++;
+    alloc_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    alloc_calls++;
+    alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+// Keeps results alive so the compiler cannot drop the work
+static volatile unsigned long sink;
+
+static const char *curl_request =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char *browser_request =
+    "GET /assets/app.js?v=3 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/dashboard\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-GB,en-US;q=0.9,en;q=0.8\r\n"
+    "Cookie: session=6f1c2a9e4b7d40c8a3e5f6a7b8c9d0e1; theme=dark; _ga=GA1.1.1234567890.1700000000\r\n"
+    "If-None-Match: \"5f2b-18c3a9d7e40\"\r\n"
+    "\r\n";
+
+static const char *form_request =
+    "POST /echo HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 46\r\n"
+    "Origin: http://localhost:8080\r\n"
+    "\r\n"
+    "name=Jane+Doe&message=Hello%2C+world%21+%E2%9C%93";
+
+static const char *form_plain = "name=Jane+Doe&message=Hello+there+from+the+benchmark";
+static const char *form_escaped = "q=%E6%97%A5%E6%9C%AC%E8%AA%9E%20%2F%20caf%C3%A9%20%26%20cr%C3%A8me%20br%C3%BBl%C3%A9e";
+
+static const char *mime_paths[] = {
+    "/index.html", "/style.css", "/assets/app.js", "/images/logo.png",
+    "/fonts/inter.woff2", "/downloads/archive.tar.gz", "/README", "/data/report.json"
+};
+
+static HttpRequest request;
+static char decoded[256];
+static char path_last[256];
+
+static void bench_parse(const char *raw, unsigned long iterations) {
+    size_t len = strlen(raw);
+    for (unsigned long i = 0; i < iterations; i++) {
+        parse_http_request(raw, len, &request);
+        sink += request.header_count;
+    }
+}
+
+static void bench_parse_curl(unsigned long n) { bench_parse(curl_request, n); }
+static void bench_parse_browser(unsigned long n) { bench_parse(browser_request, n); }
+static void bench_parse_form(unsigned long n) { bench_parse(form_request, n); }
+
+static void bench_decode_plain(unsigned long n) {
+    for (unsigned long i = 0; i < n; i++) {
+        url_decode(decoded, form_plain);
+        sink += decoded[0];
+    }
+}
+
+static void bench_decode_escaped(unsigned long n) {
+    for (unsigned long i = 0; i < n; i++) {
+        url_decode(decoded, form_escaped);
+        sink += decoded[0];
+    }
+}
+
+static void bench_mime(unsigned long n) {
+    size_t count = sizeof(mime_paths) / sizeof(mime_paths[0]);
+    for (unsigned long i = 0; i < n; i++) {
+        sink += (unsigned long)get_mime_type(mime_paths[i % count]);
+    }
+}
+
+static void bench_route_first(unsigned long n) {
+    for (unsigned long i = 0; i < n; i++) {
+        sink += (unsigned long)find_route("/time", "GET");
+    }
+}
+
+static void bench_route_last(unsigned long n) {
+    for (unsigned long i = 0; i < n; i++) {
+        sink += (unsigned long)find_route(path_last, "GET");
+    }
+}
+
+static void bench_route_miss(unsigned long n) {
+    for (unsigned long i = 0; i < n; i++) {
+        sink += (unsigned long)find_route("/assets/app.js", "GET");
+    }
+}
+
+static void bench_response_header(unsigned long n) {
+    ByteBuffer captured = {NULL, 0, 0};
+    Connection conn = { .fd = -1, .capture = &captured };
+    for (unsigned long i = 0; i < n; i++) {
+        captured.len = 0;
+        send_response_header(&conn, HTTP_OK, "text/html", 2048);
+        sink += captured.len;
+    }
+    buffer_free(&captured);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(unsigned long iterations);
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+    unsigned long iterations;
+} BenchCase;
+
+static BenchCase cases[] = {
+    { "parse_http_request/curl", bench_parse_curl, 0, 0, 0, 0 },
+    { "parse_http_request/browser", bench_parse_browser, 0, 0, 0, 0 },
+    { "parse_http_request/post_form", bench_parse_form, 0, 0, 0, 0 },
+    { "url_decode/plain", bench_decode_plain, 0, 0, 0, 0 },
+    { "url_decode/escaped", bench_decode_escaped, 0, 0, 0, 0 },
+    { "get_mime_type/mixed", bench_mime, 0, 0, 0, 0 },
+    { "find_route/first", bench_route_first, 0, 0, 0, 0 },
+    { "find_route/last", bench_route_last, 0, 0, 0, 0 },
+    { "find_route/miss", bench_route_miss, 0, 0, 0, 0 },
+    { "send_response_header/200", bench_response_header, 0, 0, 0, 0 },
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Sizes the iteration count to about sample_ms per sample, then takes the
+ * median ns/op of SAMPLES samples
+ */
+static void measure(BenchCase *bench, int sample_ms) {
+    unsigned long iterations = 1000;
+    double elapsed;
+    while (1) {
+        double start = now_ns();
+        bench->run(iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= sample_ms * 1e6 / 4 || iterations >= (1UL << 40)) break;
+        iterations *= 2;
+    }
+    iterations = (unsigned long)(iterations * (sample_ms * 1e6 / elapsed));
+    if (iterations == 0) iterations = 1;
+
+    double samples[SAMPLES];
+    unsigned long calls_before = alloc_calls, bytes_before = alloc_bytes;
+    for (int i = 0; i < SAMPLES; i++) {
+        double start = now_ns();
+        bench->run(iterations);
+        samples[i] = (now_ns() - start) / iterations;
+    }
+    qsort(samples, SAMPLES, sizeof(double), compare_double);
+
+    bench->iterations = iterations;
+    bench->ns_per_op = samples[SAMPLES / 2];
+    bench->allocs_per_op = (double)(alloc_calls - calls_before) / ((double)iterations * SAMPLES);
+    bench->bytes_per_op = (double)(alloc_bytes - bytes_before) / ((double)iterations * SAMPLES);
+}
+
+/**
+ * Fills the routing table to capacity with API-style routes, so lookups
+ * that miss or match late walk a realistic worst case
+ */
+static int fill_routes(void) {
+    int count = 0;
+    while (routes[count].handler != NULL) count++;
+    RouteHandler handler = routes[0].handler;
+
+    int added = 0;
+    for (int i = 0; count + added + 1 < MAX_ROUTES; i++) {
+        Route route;
+        memset(&route, 0, sizeof(route));
+        snprintf(route.path, sizeof(route.path), "/api/v1/resource-%02d", i);
+        snprintf(route.methods, sizeof(route.methods), "GET,POST,HEAD");
+        route.handler = handler;
+        route.kind = ROUTE_HANDLER;
+        if (add_route(&route) < 0) break;
+        snprintf(path_last, sizeof(path_last), "%s", route.path);
+        added++;
+    }
+    return count + added;
+}
+
+/**
+ * Prints the baseline's ns/op next to this run's for every case in both
+ */
+static int compare(const char *baseline_file) {
+    FILE *fp = fopen(baseline_file, "r");
+    if (!fp) {
+        perror(baseline_file);
+        return 1;
+    }
+    printf("%-32s %12s %12s %8s %10s\n", "case", "base ns/op", "ns/op", "change", "allocs/op");
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        char name[64];
+        double base_ns;
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_op\": %lf", name, &base_ns) != 2) continue;
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            if (strcmp(cases[i].name, name) != 0) continue;
+            printf("%-32s %12.1f %12.1f %+7.1f%% %10.2f\n", name, base_ns, cases[i].ns_per_op,
+                   base_ns > 0 ? (cases[i].ns_per_op - base_ns) * 100 / base_ns : 0, cases[i].allocs_per_op);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int sample_ms = 100;
+    const char *baseline = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:")) != -1) {
+        switch (opt) {
+            case 'c': baseline = optarg; break;
+            case 't': sample_ms = atoi(optarg) > 0 ? atoi(optarg) : 100; break;
+            default:
+                fprintf(stderr, "Usage: %s [-t ms_per_sample] [-c baseline.json]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    int route_count = fill_routes();
+    size_t case_count = sizeof(cases) / sizeof(cases[0]);
+    for (size_t i = 0; i < case_count; i++) {
+        measure(&cases[i], sample_ms);
+    }
+
+    if (baseline) return compare(baseline);
+
+    printf("{\n  \"benchmark\": \"micro\",\n  \"compiler\": \"%s\",\n  \"routes\": %d,\n  \"cases\": [\n",
+           __VERSION__, route_count);
+    for (size_t i = 0; i < case_count; i++) {
+        printf("    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f, \"iterations\": %lu}%s\n",
+               cases[i].name, cases[i].ns_per_op, cases[i].allocs_per_op, cases[i].bytes_per_op,
+               cases[i].iterations, i + 1 < case_count ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
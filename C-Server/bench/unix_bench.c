@@ -0,0 +1,198 @@
+/**
+ * Compares a Unix domain socket listener with loopback TCP on the same
+ * running server: each client thread opens a connection, sends one GET,
+ * reads the response until the server closes and starts over, which is
+ * what a co-located proxy without keep-alive does. Prints requests per
+ * second and latency percentiles for each transport.
+ *
+ * Usage: unix_bench [-n requests] [-c connections] [-p path] tcp_port unix_socket
+ * (unix_socket may be '@name' for the abstract namespace)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MAX_CONNECTIONS 64
+#define WARMUP_REQUESTS 200
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    const char *request;
+    size_t request_len;
+} Target;
+
+typedef struct {
+    const Target *target;
+    double *latencies_us;       // One slot per request this thread makes
+    int count;
+    int failed;
+} Client;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * Makes one request on a fresh connection and reads the whole response.
+ * Returns 0 if a 200 came back.
+ */
+static int fetch(const Target *target) {
+    int fd = socket(target->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (target->addr.ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (connect(fd, (const struct sockaddr *)&target->addr, target->addr_len) < 0 ||
+        send(fd, target->request, target->request_len, MSG_NOSIGNAL) != (ssize_t)target->request_len) {
+        close(fd);
+        return -1;
+    }
+
+    char buffer[16384];
+    ssize_t n;
+    size_t total = 0;
+    int ok = 0;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0 || (n < 0 && errno == EINTR)) {
+        if (n <= 0) continue;
+        if (total == 0) ok = n >= 12 && memcmp(buffer + 9, "200", 3) == 0;
+        total += n;
+    }
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static void *client_thread(void *arg) {
+    Client *client = arg;
+    for (int i = 0; i < client->count; i++) {
+        double start = now_us();
+        if (fetch(client->target) < 0) {
+            client->failed++;
+            client->latencies_us[i] = -1;
+            continue;
+        }
+        client->latencies_us[i] = now_us() - start;
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Runs requests spread over connections client threads against one
+ * transport and prints a result row
+ */
+static int run(const char *name, const Target *target, int requests, int connections) {
+    for (int i = 0; i < WARMUP_REQUESTS; i++) {
+        if (fetch(target) < 0) {
+            fprintf(stderr, "%s: warm-up request failed, is the server running?\n", name);
+            return -1;
+        }
+    }
+
+    double *latencies = malloc(sizeof(double) * requests);
+    Client clients[MAX_CONNECTIONS];
+    pthread_t threads[MAX_CONNECTIONS];
+    if (!latencies) return -1;
+
+    double start = now_us();
+    int offset = 0;
+    for (int i = 0; i < connections; i++) {
+        clients[i].target = target;
+        clients[i].latencies_us = latencies + offset;
+        clients[i].count = requests / connections + (i < requests % connections);
+        clients[i].failed = 0;
+        offset += clients[i].count;
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        failed += clients[i].failed;
+    }
+    double elapsed_s = (now_us() - start) / 1e6;
+
+    // Failed requests sort first as -1 and are skipped
+    qsort(latencies, requests, sizeof(double), compare_double);
+    double *ok = latencies + failed;
+    int done = requests - failed;
+    if (done == 0) {
+        printf("%-6s %10s   all %d requests failed\n", name, "-", requests);
+        free(latencies);
+        return -1;
+    }
+    printf("%-6s %10.0f %9.1f %9.1f %9.1f %9.1f %7d\n", name, done / elapsed_s,
+           ok[done / 2], ok[(int)(done * 0.9)], ok[(int)(done * 0.99)], ok[done - 1], failed);
+    free(latencies);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int requests = 5000;
+    int connections = 1;
+    const char *path = "/";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:p:")) != -1) {
+        switch (opt) {
+            case 'n': requests = atoi(optarg); break;
+            case 'c': connections = atoi(optarg); break;
+            case 'p': path = optarg; break;
+            default: goto usage;
+        }
+    }
+    if (optind + 2 != argc || requests <= 0 || connections <= 0 || connections > MAX_CONNECTIONS) goto usage;
+
+    char request[512];
+    int request_len = snprintf(request, sizeof(request),
+                               "GET %.400s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", path);
+
+    Target tcp;
+    memset(&tcp, 0, sizeof(tcp));
+    struct sockaddr_in *in = (struct sockaddr_in *)&tcp.addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((unsigned short)atoi(argv[optind]));
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    tcp.addr_len = sizeof(*in);
+    tcp.request = request;
+    tcp.request_len = request_len;
+
+    Target local;
+    memset(&local, 0, sizeof(local));
+    struct sockaddr_un *un = (struct sockaddr_un *)&local.addr;
+    const char *spec = argv[optind + 1];
+    size_t name_len = strlen(spec);
+    if (name_len == 0 || name_len >= sizeof(un->sun_path)) goto usage;
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, spec, name_len);
+    if (spec[0] == '@') un->sun_path[0] = '\0';
+    local.addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + name_len + (spec[0] != '@'));
+    local.request = request;
+    local.request_len = request_len;
+
+    printf("GET %s, %d requests over %d connection%s, one connection per request\n",
+           path, requests, connections, connections == 1 ? "" : "s");
+    printf("%-6s %10s %9s %9s %9s %9s %7s\n", "", "req/s", "p50 us", "p90 us", "p99 us", "max us", "failed");
+    int result = run("tcp", &tcp, requests, connections);
+    result |= run("unix", &local, requests, connections);
+    return result < 0 ? 1 : 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-n requests] [-c connections] [-p path] tcp_port unix_socket|@abstract\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Http_server.h"
+#include "binlog.h"
+#include "rcu.h"
+
+#define BINLOG_PATH_BUCKETS 4096
+
+// Mapped segment file. Appenders claim record slots with an atomic counter
+// and copy into the mapping; the kernel writes the pages back.
+typedef struct BinlogSegment {
+    int fd;
+    size_t map_len;
+    BinlogHeader *header;
+    BinlogRecord *records;
+    unsigned long reserved;        // Slots claimed so far, may pass capacity
+    struct BinlogSegment *retired_next;
+} BinlogSegment;
+
+int binlog_active = 0;
+
+static char log_dir[256];
+static time_t run_started;
+static unsigned int next_sequence;
+
+static BinlogSegment *current = NULL;
+static BinlogSegment *spare = NULL;      // Prepared by the writer thread
+static BinlogSegment *retired = NULL;    // Full segments waiting to be unmapped
+static pthread_mutex_t rotate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rotate_cond = PTHREAD_COND_INITIALIZER;
+
+static RcuMap path_ids;
+static pthread_mutex_t path_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t next_path_id = 1;
+static int path_fd = -1;
+
+static BinlogStats binlog_stats;
+static __thread uint64_t request_started_ns;
+static __thread unsigned long response_bytes;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Creates and maps the next segment file of this run. The pages are
+ * populated here, off the request path, so appends never fault.
+ */
+static BinlogSegment* create_segment(void) {
+    char name[512];
+    unsigned int sequence = next_sequence++;
+    snprintf(name, sizeof(name), "%s/access-%010lld-%d-%06u.blog",
+             log_dir, (long long)run_started, (int)getpid(), sequence);
+
+    BinlogSegment *segment = calloc(1, sizeof(BinlogSegment));
+    if (!segment) return NULL;
+    segment->map_len = sizeof(BinlogHeader) + (size_t)BINLOG_SEGMENT_RECORDS * sizeof(BinlogRecord);
+
+    segment->fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (segment->fd < 0 || ftruncate(segment->fd, segment->map_len) < 0) {
+        if (segment->fd >= 0) close(segment->fd);
+        free(segment);
+        return NULL;
+    }
+    posix_fallocate(segment->fd, 0, segment->map_len);
+
+    void *map = mmap(NULL, segment->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, segment->fd, 0);
+    if (map == MAP_FAILED) {
+        close(segment->fd);
+        free(segment);
+        return NULL;
+    }
+
+    segment->header = map;
+    segment->records = (BinlogRecord*)((char*)map + sizeof(BinlogHeader));
+    memcpy(segment->header->magic, BINLOG_MAGIC, sizeof(BINLOG_MAGIC));
+    segment->header->version = BINLOG_VERSION;
+    segment->header->record_size = sizeof(BinlogRecord);
+    segment->header->capacity = BINLOG_SEGMENT_RECORDS;
+    segment->header->run_started = run_started;
+    segment->header->pid = getpid();
+    segment->header->sequence = sequence;
+    __atomic_add_fetch(&binlog_stats.segments, 1, __ATOMIC_RELAXED);
+    return segment;
+}
+
+/**
+ * Writes back and unmaps a segment no appender can still reach
+ */
+static void close_segment(BinlogSegment *segment) {
+    msync(segment->header, segment->map_len, MS_ASYNC);
+    munmap(segment->header, segment->map_len);
+    close(segment->fd);
+    free(segment);
+}
+
+/**
+ * Writer thread: keeps a spare segment ready and unmaps full ones once
+ * every appender that might still be copying into them has finished
+ */
+static void* writer_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&rotate_lock);
+    while (1) {
+        while (spare && !retired) pthread_cond_wait(&rotate_cond, &rotate_lock);
+        int need_spare = spare == NULL;
+        BinlogSegment *full = retired;
+        retired = NULL;
+        pthread_mutex_unlock(&rotate_lock);
+
+        BinlogSegment *fresh = need_spare ? create_segment() : NULL;
+        if (full) {
+            rcu_synchronize();
+            while (full) {
+                BinlogSegment *next = full->retired_next;
+                close_segment(full);
+                full = next;
+            }
+        }
+        if (need_spare && !fresh) {
+            log_error("Binary log: could not create a segment");
+            sleep(1);
+        }
+
+        pthread_mutex_lock(&rotate_lock);
+        if (fresh) spare = fresh;
+    }
+    return NULL;
+}
+
+/**
+ * Replaces a full segment with the spare. Returns 0 when no spare is ready.
+ */
+static int rotate(BinlogSegment *full) {
+    int rotated = 1;
+    pthread_mutex_lock(&rotate_lock);
+    if (__atomic_load_n(&current, __ATOMIC_RELAXED) == full) {
+        if (spare) {
+            __atomic_store_n(&current, spare, __ATOMIC_RELEASE);
+            spare = NULL;
+            full->retired_next = retired;
+            retired = full;
+        } else {
+            rotated = 0;
+        }
+        pthread_cond_signal(&rotate_cond);
+    }
+    pthread_mutex_unlock(&rotate_lock);
+    return rotated;
+}
+
+/**
+ * Returns the id of a path, interning it (and recording it in the run's
+ * path table) the first time it is seen
+ */
+static uint32_t intern_path(const char *path) {
+    char key[256];
+    size_t len = strcspn(path, "?");
+    if (len >= sizeof(key)) len = sizeof(key) - 1;
+    memcpy(key, path, len);
+    key[len] = '\0';
+
+    rcu_read_lock();
+    uint32_t id = (uint32_t)(uintptr_t)rcu_map_lookup(&path_ids, key);
+    rcu_read_unlock();
+    if (id) return id;
+
+    pthread_mutex_lock(&path_lock);
+    id = (uint32_t)(uintptr_t)rcu_map_lookup(&path_ids, key);
+    if (!id && next_path_id <= BINLOG_MAX_PATHS) {
+        char line[300];
+        int line_len = snprintf(line, sizeof(line), "%u %s\n", next_path_id, key);
+        if (write(path_fd, line, line_len) == line_len &&
+            rcu_map_insert(&path_ids, key, (void*)(uintptr_t)next_path_id) == 0) {
+            id = next_path_id++;
+        }
+    }
+    pthread_mutex_unlock(&path_lock);
+    return id ? id : BINLOG_PATH_OTHER;
+}
+
+/**
+ * Starts binary access logging into dir (created if missing)
+ */
+int binlog_open(const char *dir) {
+    if (snprintf(log_dir, sizeof(log_dir), "%s", dir) >= (int)sizeof(log_dir)) return -1;
+    if (mkdir(log_dir, 0755) < 0 && errno != EEXIST) return -1;
+    run_started = time(NULL);
+
+    char name[512];
+    snprintf(name, sizeof(name), "%s/paths-%010lld-%d.idx", log_dir, (long long)run_started, (int)getpid());
+    path_fd = open(name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (path_fd < 0 || rcu_map_init(&path_ids, BINLOG_PATH_BUCKETS, NULL) < 0) return -1;
+
+    current = create_segment();
+    if (!current) return -1;
+
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, writer_thread, NULL) != 0) return -1;
+    pthread_detach(thread_id);
+    __atomic_store_n(&binlog_active, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Marks the start of the calling thread's request, for the latency field
+ */
+void binlog_request_start(void) {
+    if (!binlog_active) return;
+    request_started_ns = clock_ns(CLOCK_MONOTONIC);
+    response_bytes = 0;
+}
+
+uint64_t binlog_request_time(void) {
+    return request_started_ns;
+}
+
+/**
+ * Continues the calling thread's current request on another thread (see
+ * offload.c), so its latency still counts from when it was received
+ */
+void binlog_request_resume(uint64_t started_ns) {
+    request_started_ns = started_ns;
+    response_bytes = 0;
+}
+
+void binlog_add_bytes(unsigned long bytes) {
+    response_bytes += bytes;
+}
+
+/**
+ * Appends one access record. Only a segment switch takes a lock; the
+ * copy itself goes straight into the mapped file.
+ */
+void binlog_append(const char *client_ip, const char *method, const char *path, int status_code) {
+    BinlogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.bytes = response_bytes;
+    record.path_id = intern_path(path);
+    record.status = (uint16_t)status_code;
+    record.method = binlog_method_id(method);
+    if (inet_pton(AF_INET, client_ip, record.ip) == 1) {
+        record.family = 4;
+    } else if (inet_pton(AF_INET6, client_ip, record.ip) == 1) {
+        record.family = 6;
+    } else if (strncmp(client_ip, "unix", 4) == 0) {
+        uint32_t peer[2] = { 0, 0 };
+        sscanf(client_ip, "unix:pid=%u,uid=%u", &peer[0], &peer[1]);
+        memcpy(record.ip, peer, sizeof(peer));
+        record.family = BINLOG_FAMILY_UNIX;
+    }
+    if (request_started_ns) {
+        record.latency_us = (uint32_t)((clock_ns(CLOCK_MONOTONIC) - request_started_ns) / 1000);
+    }
+    uint64_t timestamp = clock_ns(CLOCK_REALTIME);
+    request_started_ns = 0;
+    response_bytes = 0;
+
+    rcu_read_lock();
+    while (1) {
+        BinlogSegment *segment = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+        unsigned long slot = __atomic_fetch_add(&segment->reserved, 1, __ATOMIC_RELAXED);
+        if (slot < BINLOG_SEGMENT_RECORDS) {
+            // The timestamp goes in last, so readers skip half-written slots
+            memcpy(&segment->records[slot], &record, sizeof(record));
+            __atomic_store_n(&segment->records[slot].timestamp_ns, timestamp, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&binlog_stats.records, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (!rotate(segment)) {
+            __atomic_add_fetch(&binlog_stats.dropped, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    rcu_read_unlock();
+}
+
+void binlog_get_stats(BinlogStats *stats) {
+    stats->records = __atomic_load_n(&binlog_stats.records, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&binlog_stats.dropped, __ATOMIC_RELAXED);
+    stats->segments = __atomic_load_n(&binlog_stats.segments, __ATOMIC_RELAXED);
+    stats->paths = binlog_active ? rcu_map_count(&path_ids) : 0;
+}
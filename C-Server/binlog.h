@@ -0,0 +1,87 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define BINLOG_MAGIC "CSBLOG1"
+#define BINLOG_VERSION 1
+#define BINLOG_SEGMENT_RECORDS (256 * 1024)  // Records per segment file (12 MB)
+#define BINLOG_MAX_PATHS 65536               // Distinct paths interned per run
+#define BINLOG_PATH_OTHER 0                  // Id logged once the path table is full
+#define BINLOG_FAMILY_UNIX 1                 // Client connected over a Unix domain socket
+
+/*
+ * On-disk format. A run of the server writes segment files named
+ * access-<start>-<pid>-<seq>.blog, each a BinlogHeader followed by
+ * fixed-width records, plus paths-<start>-<pid>.idx with one "<id> <path>"
+ * line per interned path. Integers are in host byte order.
+ */
+typedef struct {
+    char magic[8];           // BINLOG_MAGIC
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;       // Records the segment has room for
+    int64_t run_started;     // Unix time the server started, names the path table
+    int32_t pid;
+    uint32_t sequence;       // Segment number within the run
+    char reserved[24];
+} BinlogHeader;
+
+typedef struct {
+    uint64_t timestamp_ns;   // Wall clock; 0 marks a slot that was never written
+    uint64_t bytes;          // Response body bytes
+    uint32_t latency_us;     // Dispatch until the request was logged
+    uint32_t path_id;        // Query strings are not part of the path
+    uint16_t status;
+    uint8_t method;          // BinlogMethod
+    uint8_t family;          // 4 or 6, or BINLOG_FAMILY_UNIX
+    uint8_t ip[16];          // Unix domain peers: pid and uid as two uint32_t
+    uint32_t reserved;
+} BinlogRecord;
+
+typedef enum {
+    BINLOG_METHOD_OTHER = 0,
+    BINLOG_METHOD_GET,
+    BINLOG_METHOD_HEAD,
+    BINLOG_METHOD_POST,
+    BINLOG_METHOD_PUT,
+    BINLOG_METHOD_DELETE,
+    BINLOG_METHOD_OPTIONS,
+    BINLOG_METHOD_PATCH,
+    BINLOG_METHOD_COUNT
+} BinlogMethod;
+
+static const char *const binlog_method_names[BINLOG_METHOD_COUNT] = {
+    "-", "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH"
+};
+
+/**
+ * Maps a method name to its record id
+ */
+static inline uint8_t binlog_method_id(const char *method) {
+    for (int i = 1; i < BINLOG_METHOD_COUNT; i++) {
+        if (strcmp(method, binlog_method_names[i]) == 0) return (uint8_t)i;
+    }
+    return BINLOG_METHOD_OTHER;
+}
+
+// Binary log counters
+typedef struct {
+    unsigned long records;
+    unsigned long dropped;    // Records lost because no fresh segment was ready
+    unsigned long segments;
+    int paths;
+} BinlogStats;
+
+extern int binlog_active;
+
+int binlog_open(const char *dir);
+void binlog_request_start(void);
+uint64_t binlog_request_time(void);
+void binlog_request_resume(uint64_t started_ns);
+void binlog_add_bytes(unsigned long bytes);
+void binlog_append(const char *client_ip, const char *method, const char *path, int status_code);
+void binlog_get_stats(BinlogStats *stats);
+
+#endif
@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "body.h"
+
+/**
+ * Prepares the reader for a parsed request. request->body holds the bytes
+ * received along with the headers; with a NULL conn it is the whole body.
+ */
+void body_reader_init(BodyReader *reader, Connection *conn, HttpRequest *request) {
+    memset(reader, 0, sizeof(*reader));
+    reader->conn = conn;
+    reader->spool_fd = -1;
+    reader->data = request->body;
+    reader->len = request->body ? request->body_length : 0;
+
+    const char *transfer_encoding = get_header_value(request, "Transfer-Encoding");
+    const char *content_length = get_header_value(request, "Content-Length");
+    if (!conn) {
+        reader->remaining = reader->len;
+    } else if (transfer_encoding && strcasecmp(transfer_encoding, "chunked") == 0) {
+        reader->chunked = 1;
+    } else if (content_length) {
+        char *end;
+        reader->remaining = strtoull(content_length, &end, 10);
+        while (*end == ' ' || *end == '\t') end++;
+        if (end == content_length || *end != '\0') reader->failed = EINVAL;
+        if (reader->remaining > (unsigned long long)BODY_MAX_SIZE) reader->failed = EFBIG;
+    }
+
+    const char *expect = get_header_value(request, "Expect");
+    reader->expect_continue = conn && expect && strcasecmp(expect, "100-continue") == 0;
+    request->body_reader = reader;
+}
+
+/**
+ * Makes received bytes available, reading from the connection once the
+ * buffered ones are used up. Returns the number available, 0 at EOF.
+ */
+static ssize_t reader_fill(BodyReader *reader) {
+    if (reader->pos < reader->len) return reader->len - reader->pos;
+    if (reader->spool_fd >= 0) {
+        ssize_t n;
+        while ((n = read(reader->spool_fd, reader->buf, sizeof(reader->buf))) < 0 && errno == EINTR);
+        if (n <= 0) return n;
+        reader->data = reader->buf;
+        reader->pos = 0;
+        reader->len = n;
+        return n;
+    }
+    if (!reader->conn) return 0;
+
+    if (reader->expect_continue) {
+        const char *go_ahead = "HTTP/1.1 100 Continue\r\n\r\n";
+        reader->expect_continue = 0;
+        if (conn_send(reader->conn, go_ahead, strlen(go_ahead)) < 0) return -1;
+    }
+
+    ssize_t n = conn_recv(reader->conn, reader->buf, sizeof(reader->buf));
+    if (n <= 0) return n;
+    reader->data = reader->buf;
+    reader->pos = 0;
+    reader->len = n;
+    return n;
+}
+
+/**
+ * Reads one CRLF-terminated line of chunked framing
+ */
+static int reader_read_line(BodyReader *reader, char *line, size_t max_len) {
+    size_t used = 0;
+    while (1) {
+        if (reader_fill(reader) <= 0) return -1;
+        char c = reader->data[reader->pos++];
+        if (c == '\n') break;
+        if (used + 1 >= max_len) return -1;
+        if (c != '\r') line[used++] = c;
+    }
+    line[used] = '\0';
+    return (int)used;
+}
+
+/**
+ * Moves to the next chunk: consumes the CRLF after the previous chunk and
+ * parses the size line; a zero size ends the body after its trailers
+ */
+static int next_chunk(BodyReader *reader) {
+    char line[128];
+    if (reader->in_chunk && reader_read_line(reader, line, sizeof(line)) != 0) return -1;
+    reader->in_chunk = 1;
+
+    if (reader_read_line(reader, line, sizeof(line)) < 0) return -1;
+    char *end;
+    unsigned long long size = strtoull(line, &end, 16);
+    if (end == line || (*end != '\0' && *end != ';' && *end != ' ')) return -1;
+
+    if (size == 0) {
+        while (1) {
+            int len = reader_read_line(reader, line, sizeof(line));
+            if (len < 0) return -1;
+            if (len == 0) break;
+        }
+        reader->done = 1;
+        return 0;
+    }
+    if (reader->total + size > (unsigned long long)BODY_MAX_SIZE) {
+        reader->failed = EFBIG;
+        return -1;
+    }
+    reader->remaining = size;
+    return 0;
+}
+
+/**
+ * Reads up to len bytes of the decoded body. Returns 0 once the body has
+ * been read, and -1 with errno set when it is malformed (EINVAL), larger
+ * than BODY_MAX_SIZE (EFBIG) or the client went away.
+ */
+ssize_t body_read(HttpRequest *request, void *buf, size_t len) {
+    BodyReader *reader = request->body_reader;
+    if (!reader || reader->done) return 0;
+    if (reader->failed) {
+        errno = reader->failed;
+        return -1;
+    }
+
+    while (reader->chunked && reader->remaining == 0 && !reader->done) {
+        if (next_chunk(reader) < 0) {
+            if (!reader->failed) reader->failed = EINVAL;
+            errno = reader->failed;
+            return -1;
+        }
+    }
+    if (reader->done || reader->remaining == 0) {
+        reader->done = 1;
+        return 0;
+    }
+
+    ssize_t available = reader_fill(reader);
+    if (available <= 0) {
+        reader->failed = available == 0 ? ECONNRESET : (errno ? errno : ECONNRESET);
+        errno = reader->failed;
+        return -1;
+    }
+
+    size_t n = len;
+    if (n > (size_t)available) n = available;
+    if (n > reader->remaining) n = reader->remaining;
+    memcpy(buf, reader->data + reader->pos, n);
+    reader->pos += n;
+    reader->remaining -= n;
+    reader->total += n;
+    return n;
+}
+
+void spool_init(Spool *spool) {
+    memset(spool, 0, sizeof(*spool));
+    spool->fd = -1;
+}
+
+/**
+ * Opens an unnamed temporary file; filesystems without O_TMPFILE get a
+ * named one that is unlinked straight away
+ */
+static int open_spool_file(void) {
+    int fd = open(BODY_SPOOL_DIR, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) return fd;
+
+    char path[] = BODY_SPOOL_DIR "/c-server-body-XXXXXX";
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) unlink(path);
+    return fd;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Appends to the spool, moving its contents to a temporary file when they
+ * outgrow BODY_MEMORY_LIMIT
+ */
+int spool_write(Spool *spool, const void *data, size_t len) {
+    if (spool->fd < 0 && spool->len + len > BODY_MEMORY_LIMIT) {
+        spool->fd = open_spool_file();
+        if (spool->fd < 0) return -1;
+        if (write_all(spool->fd, spool->memory.data, spool->memory.len) < 0) return -1;
+        buffer_free(&spool->memory);
+    }
+
+    if (spool->fd >= 0) {
+        if (write_all(spool->fd, data, len) < 0) return -1;
+    } else if (buffer_append(&spool->memory, data, len) < 0) {
+        return -1;
+    }
+    spool->len += len;
+    return 0;
+}
+
+void spool_free(Spool *spool) {
+    buffer_free(&spool->memory);
+    if (spool->fd >= 0) close(spool->fd);
+    spool->fd = -1;
+    spool->len = 0;
+}
+
+/**
+ * Reads the rest of the body into the spool
+ */
+int body_spool(HttpRequest *request, Spool *spool) {
+    char buf[BODY_READ_SIZE];
+    ssize_t n;
+    while ((n = body_read(request, buf, sizeof(buf))) > 0) {
+        if (spool_write(spool, buf, n) < 0) return -1;
+    }
+    return n < 0 ? -1 : 0;
+}
+
+/**
+ * Reads the rest of the request's body into the spool on the calling
+ * thread and points the request at reader, which returns it from there.
+ * Handlers run elsewhere then never wait on the client. A failed read is
+ * kept and reported by the first body_read().
+ */
+void body_buffer(HttpRequest *request, BodyReader *reader, Spool *spool) {
+    int failed = 0;
+    if (body_spool(request, spool) < 0) failed = errno ? errno : EIO;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->spool_fd = -1;
+    reader->failed = failed;
+    reader->remaining = spool->len;
+    if (spool->fd >= 0) {
+        reader->spool_fd = spool->fd;
+        if (lseek(spool->fd, 0, SEEK_SET) < 0) reader->failed = errno;
+    } else {
+        reader->data = spool->memory.data;
+        reader->len = spool->memory.len;
+    }
+    request->body_reader = reader;
+    request->body = NULL;
+    request->body_length = 0;
+}
+
+/**
+ * Copies a parameter of a header value, e.g. name="field" in
+ * Content-Disposition; quotes are removed
+ */
+static void header_param(const char *value, const char *param, char *out, size_t out_len) {
+    out[0] = '\0';
+    size_t param_len = strlen(param);
+    for (const char *p = value; (p = strcasestr(p, param)) != NULL; p += param_len) {
+        if (p != value && p[-1] != ' ' && p[-1] != ';' && p[-1] != '\t') continue;
+        if (p[param_len] != '=') continue;
+
+        const char *start = p + param_len + 1;
+        const char *end;
+        if (*start == '"') {
+            start++;
+            end = strchr(start, '"');
+            if (!end) end = start + strlen(start);
+        } else {
+            end = start + strcspn(start, "; \t");
+        }
+        size_t len = end - start;
+        if (len >= out_len) len = out_len - 1;
+        memcpy(out, start, len);
+        out[len] = '\0';
+        return;
+    }
+}
+
+/**
+ * Parses a part's header block (without the blank line that ends it)
+ */
+static void parse_part_headers(char *headers, MultipartPart *part) {
+    memset(part, 0, sizeof(*part));
+    char *line = headers;
+    while (line && *line) {
+        char *next = strstr(line, "\r\n");
+        if (next) {
+            *next = '\0';
+            next += 2;
+        }
+        char *colon = strchr(line, ':');
+        if (colon) {
+            *colon = '\0';
+            const char *value = colon + 1;
+            while (*value == ' ' || *value == '\t') value++;
+            if (strcasecmp(line, "Content-Disposition") == 0) {
+                header_param(value, "name", part->name, sizeof(part->name));
+                header_param(value, "filename", part->filename, sizeof(part->filename));
+            } else if (strcasecmp(line, "Content-Type") == 0) {
+                snprintf(part->content_type, sizeof(part->content_type), "%s", value);
+            }
+        }
+        line = next;
+    }
+}
+
+// Streaming multipart/form-data parser state
+typedef struct {
+    HttpRequest *request;
+    char delimiter[80];         // "\r\n--" followed by the boundary
+    size_t delimiter_len;
+    char window[BODY_READ_SIZE + MULTIPART_HEADER_SIZE];
+    size_t len;
+    int eof;
+} MultipartParser;
+
+/**
+ * Reads more of the body into the window; returns -1 on read errors
+ */
+static int parser_fill(MultipartParser *parser) {
+    if (parser->eof || parser->len == sizeof(parser->window)) return 0;
+    ssize_t n = body_read(parser->request, parser->window + parser->len, sizeof(parser->window) - parser->len);
+    if (n < 0) return -1;
+    if (n == 0) parser->eof = 1;
+    parser->len += n;
+    return 0;
+}
+
+static void parser_consume(MultipartParser *parser, size_t n) {
+    memmove(parser->window, parser->window + n, parser->len - n);
+    parser->len -= n;
+}
+
+/**
+ * Parses a multipart/form-data body as it arrives. Each part's contents are
+ * handed to handler in pieces, so memory stays at one window no matter how
+ * large the uploaded files are. Returns -1 with errno EINVAL for malformed
+ * bodies, or the error of the failing read or handler.
+ */
+int multipart_parse(HttpRequest *request, MultipartHandler handler, void *arg) {
+    const char *content_type = get_header_value(request, "Content-Type");
+    if (!content_type || strncasecmp(content_type, "multipart/form-data", 19) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    MultipartParser *parser = malloc(sizeof(MultipartParser));
+    if (!parser) return -1;
+    parser->request = request;
+    parser->len = 0;
+    parser->eof = 0;
+
+    char boundary[72];
+    header_param(content_type, "boundary", boundary, sizeof(boundary));
+    if (!boundary[0]) {
+        free(parser);
+        errno = EINVAL;
+        return -1;
+    }
+    parser->delimiter_len = snprintf(parser->delimiter, sizeof(parser->delimiter), "\r\n--%s", boundary);
+
+    // The first delimiter has no CRLF before it; pretend it does
+    memcpy(parser->window, "\r\n", 2);
+    parser->len = 2;
+
+    int result = -1;
+    int error = EINVAL;
+    int in_part = 0;
+    MultipartPart part;
+
+    while (1) {
+        if (parser_fill(parser) < 0) {
+            error = errno;
+            break;
+        }
+
+        char *found = memmem(parser->window, parser->len, parser->delimiter, parser->delimiter_len);
+        if (!in_part) {
+            // Preamble, or the headers of the next part
+            if (!found) {
+                if (parser->eof) break;
+                // Keep only what could be the start of a split delimiter
+                if (parser->len > parser->delimiter_len) parser_consume(parser, parser->len - parser->delimiter_len);
+                continue;
+            }
+            size_t after = (found - parser->window) + parser->delimiter_len;
+            if (parser->len < after + 2 && !parser->eof) {
+                if (parser->len == sizeof(parser->window)) break;
+                continue;
+            }
+            if (parser->len >= after + 2 && memcmp(parser->window + after, "--", 2) == 0) {
+                result = 0;  // Closing delimiter
+                break;
+            }
+
+            char *headers_end = memmem(parser->window + after, parser->len - after, "\r\n\r\n", 4);
+            if (!headers_end) {
+                if (parser->eof || parser->len == sizeof(parser->window)) break;
+                continue;
+            }
+            // Headers start after the delimiter line (which may carry padding)
+            char *line_end = memmem(parser->window + after, headers_end + 2 - (parser->window + after), "\r\n", 2);
+            char *headers = line_end + 2;
+            *headers_end = '\0';
+            if (headers > headers_end) headers = headers_end;  // Part without headers
+            parse_part_headers(headers, &part);
+            parser_consume(parser, headers_end + 4 - parser->window);
+            in_part = 1;
+            continue;
+        }
+
+        if (found) {
+            size_t data_len = found - parser->window;
+            if (handler(&part, parser->window, data_len, 1, arg) < 0) {
+                error = errno ? errno : EINVAL;
+                break;
+            }
+            // Leave the delimiter in place for the header step above
+            parser_consume(parser, data_len);
+            in_part = 0;
+            continue;
+        }
+        if (parser->eof) break;
+
+        // Hand over everything that cannot be part of a delimiter split
+        // across reads
+        if (parser->len > parser->delimiter_len) {
+            size_t safe = parser->len - parser->delimiter_len;
+            if (handler(&part, parser->window, safe, 0, arg) < 0) {
+                error = errno ? errno : EINVAL;
+                break;
+            }
+            parser_consume(parser, safe);
+        }
+    }
+
+    free(parser);
+    if (result < 0) errno = error;
+    return result;
+}
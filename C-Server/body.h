@@ -0,0 +1,61 @@
+#ifndef BODY_H
+#define BODY_H
+
+#include <sys/types.h>
+#include "Http_server.h"
+
+#define BODY_MEMORY_LIMIT (64 * 1024)          // Spooled bodies up to this size stay in memory
+#define BODY_MAX_SIZE (256LL * 1024 * 1024)    // Largest body a handler may read
+#define BODY_SPOOL_DIR "/tmp"
+#define BODY_READ_SIZE 8192
+#define MULTIPART_HEADER_SIZE 1024             // Largest header block of one multipart part
+
+// Incremental reader for a request body: bytes received with the headers
+// are returned first, the rest is read from the connection on demand and
+// de-chunked when the client used chunked transfer encoding
+typedef struct BodyReader {
+    Connection *conn;              // NULL when request->body already holds the whole body
+    int spool_fd;                  // Spooled body file read in place of the connection, or -1
+    const char *data;              // Unconsumed received bytes
+    size_t pos;
+    size_t len;
+    int chunked;
+    int in_chunk;                  // A chunk's data has been read; its CRLF follows
+    int expect_continue;           // Send "100 Continue" before the first read from the socket
+    int done;
+    int failed;
+    unsigned long long remaining;  // Bytes left in the body, or in the current chunk
+    unsigned long long total;      // Body bytes returned so far
+    char buf[BODY_READ_SIZE];
+} BodyReader;
+
+// Body contents kept in memory until they outgrow BODY_MEMORY_LIMIT, then
+// moved to an unnamed temporary file
+typedef struct {
+    ByteBuffer memory;
+    int fd;                        // O_TMPFILE file once spooled to disk, else -1
+    size_t len;
+} Spool;
+
+// Headers of one multipart/form-data part
+typedef struct {
+    char name[128];
+    char filename[256];            // Empty for plain form fields
+    char content_type[128];
+} MultipartPart;
+
+// Receives a part's contents piece by piece; final is set on its last call.
+// A negative return aborts parsing.
+typedef int (*MultipartHandler)(MultipartPart *part, const char *data, size_t len, int final, void *arg);
+
+void body_reader_init(BodyReader *reader, Connection *conn, HttpRequest *request);
+ssize_t body_read(HttpRequest *request, void *buf, size_t len);
+int body_spool(HttpRequest *request, Spool *spool);
+void body_buffer(HttpRequest *request, BodyReader *reader, Spool *spool);
+int multipart_parse(HttpRequest *request, MultipartHandler handler, void *arg);
+
+void spool_init(Spool *spool);
+int spool_write(Spool *spool, const void *data, size_t len);
+void spool_free(Spool *spool);
+
+#endif
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cache.h"
+#include "offload.h"
+
+// Hash bucket with its own lock; the condition variable wakes requests
+// waiting for a handler run on a key in this bucket
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t filled;
+    CacheEntry *head;
+} CacheBucket;
+
+static CacheBucket buckets[CACHE_BUCKETS];
+static pthread_once_t buckets_once = PTHREAD_ONCE_INIT;
+static CacheStats cache_stats;
+
+// Clock sweep over the buckets when the table is full
+static unsigned int sweep_hand;         // Next bucket to visit
+static long long sweep_not_before_ms;   // Nothing can expire earlier, per the last fruitless sweep
+
+static void init_buckets(void) {
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        pthread_mutex_init(&buckets[i].mutex, NULL);
+        pthread_cond_init(&buckets[i].filled, NULL);
+        buckets[i].head = NULL;
+    }
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * FNV-1a hash of the cache key
+ */
+static unsigned long hash_key(const char *key) {
+    unsigned long hash = 2166136261UL;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * Builds the cache key from method, path and the route's vary headers.
+ * The query string is left out unless the route keys on it, so arbitrary
+ * query strings cannot fill the table with copies of one page. Returns -1
+ * if the key does not fit.
+ */
+static int build_key(char *key, size_t max_len, HttpRequest *request) {
+    const RouteCachePolicy *policy = &request->route->cache;
+    int path_len = policy->by_query ? (int)strlen(request->path) : (int)strcspn(request->path, "?");
+    int len = snprintf(key, max_len, "%s %.*s\n", request->method, path_len, request->path);
+    const char *vary = policy->vary;
+
+    while (vary && *vary && len < (int)max_len) {
+        const char *comma = strchr(vary, ',');
+        size_t name_len = comma ? (size_t)(comma - vary) : strlen(vary);
+
+        char name[128];
+        if (name_len >= sizeof(name)) return -1;
+        memcpy(name, vary, name_len);
+        name[name_len] = '\0';
+
+        const char *value = get_header_value(request, name);
+        len += snprintf(key + len, max_len - len, "%s: %s\n", name, value ? value : "");
+        vary = comma ? comma + 1 : NULL;
+    }
+
+    return len < (int)max_len ? len : -1;
+}
+
+static CachedResponse* response_ref(CachedResponse *response) {
+    __atomic_add_fetch(&response->refs, 1, __ATOMIC_RELAXED);
+    return response;
+}
+
+static void response_release(CachedResponse *response) {
+    if (response && __atomic_sub_fetch(&response->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(response);
+    }
+}
+
+static CacheEntry* find_entry(CacheBucket *bucket, const char *key, unsigned long hash) {
+    for (CacheEntry *entry = bucket->head; entry; entry = entry->next) {
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) return entry;
+    }
+    return NULL;
+}
+
+static void remove_entry(CacheBucket *bucket, CacheEntry *entry) {
+    for (CacheEntry **link = &bucket->head; *link; link = &(*link)->next) {
+        if (*link == entry) {
+            *link = entry->next;
+            break;
+        }
+    }
+    response_release(entry->response);
+    free(entry);
+    __atomic_sub_fetch(&cache_stats.entries, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Drops entries in the bucket that are past their stale window (bucket
+ * lock held). Lowers *earliest to the time the next kept entry could go.
+ * Returns the number dropped.
+ */
+static int evict_expired(CacheBucket *bucket, long long now, long long *earliest) {
+    int dropped = 0;
+    CacheEntry *entry = bucket->head;
+    while (entry) {
+        CacheEntry *next = entry->next;
+        if (!entry->filling && entry->response && now >= entry->stale_until_ms) {
+            remove_entry(bucket, entry);
+            dropped++;
+        } else {
+            // An entry being filled may keep its old, already dead response
+            long long until = entry->filling ? now + CACHE_SWEEP_RETRY_MS : entry->stale_until_ms;
+            if (until < *earliest) *earliest = until;
+        }
+        entry = next;
+    }
+    return dropped;
+}
+
+/**
+ * Makes room in a full table: the caller's own bucket first, then a clock
+ * sweep over the others that resumes where the last one stopped and ends
+ * at the first bucket that frees anything. The caller holds its bucket's
+ * lock, so other buckets are only tried, never waited for. A sweep that
+ * frees nothing records when the first entry will expire, and sweeps are
+ * skipped until then.
+ */
+static void sweep_expired(CacheBucket *held, long long now) {
+    if (now < __atomic_load_n(&sweep_not_before_ms, __ATOMIC_RELAXED)) return;
+
+    long long earliest = LLONG_MAX;
+    if (evict_expired(held, now, &earliest) > 0) return;
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        CacheBucket *bucket = &buckets[__atomic_fetch_add(&sweep_hand, 1, __ATOMIC_RELAXED) % CACHE_BUCKETS];
+        if (bucket == held) continue;
+        if (pthread_mutex_trylock(&bucket->mutex) != 0) {
+            if (now + CACHE_SWEEP_RETRY_MS < earliest) earliest = now + CACHE_SWEEP_RETRY_MS;
+            continue;
+        }
+        int dropped = evict_expired(bucket, now, &earliest);
+        pthread_mutex_unlock(&bucket->mutex);
+        if (dropped > 0) return;
+    }
+    __atomic_store_n(&sweep_not_before_ms, earliest, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sends a cached response and accounts for it like a handler would
+ */
+static void serve_cached(Connection *conn, CachedResponse *response, HttpRequest *request, const char *client_ip) {
+    conn_send(conn, response->data, response->len);
+    update_stats(response->len);
+    log_request(client_ip, request->method, request->path, HTTP_OK);
+    response_release(response);
+}
+
+/**
+ * Serves a request for a cached route. A fresh entry is sent from memory;
+ * concurrent misses on the same key wait for a single handler run; an
+ * expired entry inside its stale window is served to everyone except the
+ * one request that re-runs the handler to refresh it.
+ */
+void cache_handle_request(Connection *conn, HttpRequest *request, const char *client_ip) {
+    Route *route = request->route;
+    char key[CACHE_KEY_SIZE];
+
+    pthread_once(&buckets_once, init_buckets);
+
+    if (build_key(key, sizeof(key), request) < 0) {
+        offload_run(conn, request, client_ip);
+        return;
+    }
+
+    unsigned long hash = hash_key(key);
+    CacheBucket *bucket = &buckets[hash % CACHE_BUCKETS];
+
+    pthread_mutex_lock(&bucket->mutex);
+    CacheEntry *entry;
+    while (1) {
+        entry = find_entry(bucket, key, hash);
+        long long now = now_ms();
+
+        if (entry && entry->response) {
+            if (now < entry->expires_ms) {
+                CachedResponse *response = response_ref(entry->response);
+                pthread_mutex_unlock(&bucket->mutex);
+                __atomic_add_fetch(&cache_stats.hits, 1, __ATOMIC_RELAXED);
+                serve_cached(conn, response, request, client_ip);
+                return;
+            }
+            if (now < entry->stale_until_ms && entry->filling) {
+                CachedResponse *response = response_ref(entry->response);
+                pthread_mutex_unlock(&bucket->mutex);
+                __atomic_add_fetch(&cache_stats.stale_hits, 1, __ATOMIC_RELAXED);
+                serve_cached(conn, response, request, client_ip);
+                return;
+            }
+        }
+
+        if (!entry || !entry->filling) break;
+
+        // Another request is running the handler for this key: wait for it
+        __atomic_add_fetch(&cache_stats.coalesced, 1, __ATOMIC_RELAXED);
+        pthread_cond_wait(&bucket->filled, &bucket->mutex);
+    }
+
+    if (!entry) {
+        if (__atomic_load_n(&cache_stats.entries, __ATOMIC_RELAXED) >= CACHE_MAX_ENTRIES) {
+            sweep_expired(bucket, now_ms());
+        }
+        if (__atomic_load_n(&cache_stats.entries, __ATOMIC_RELAXED) >= CACHE_MAX_ENTRIES ||
+            !(entry = calloc(1, sizeof(CacheEntry)))) {
+            // Cache full: serve uncached rather than block
+            pthread_mutex_unlock(&bucket->mutex);
+            offload_run(conn, request, client_ip);
+            return;
+        }
+        snprintf(entry->key, sizeof(entry->key), "%s", key);
+        entry->hash = hash;
+        entry->next = bucket->head;
+        bucket->head = entry;
+        __atomic_add_fetch(&cache_stats.entries, 1, __ATOMIC_RELAXED);
+    }
+    entry->filling = 1;
+    pthread_mutex_unlock(&bucket->mutex);
+    __atomic_add_fetch(&cache_stats.misses, 1, __ATOMIC_RELAXED);
+
+    // Run the handler once, capturing its complete response
+    ByteBuffer captured = {NULL, 0, 0};
+    Connection capture_conn = { .fd = conn->fd, .capture = &captured };
+    offload_run(&capture_conn, request, client_ip);
+    conn_send(conn, captured.data, captured.len);
+
+    // Only complete 200 responses are cached
+    const char *ok_prefix = "HTTP/1.1 200 ";
+    CachedResponse *response = NULL;
+    if (captured.len > strlen(ok_prefix) && strncmp(captured.data, ok_prefix, strlen(ok_prefix)) == 0) {
+        response = malloc(sizeof(CachedResponse) + captured.len);
+        if (response) {
+            response->refs = 1;
+            response->len = captured.len;
+            memcpy(response->data, captured.data, captured.len);
+        }
+    }
+    buffer_free(&captured);
+
+    pthread_mutex_lock(&bucket->mutex);
+    entry->filling = 0;
+    if (response) {
+        response_release(entry->response);
+        entry->response = response;
+        entry->expires_ms = now_ms() + route->cache.ttl_ms;
+        entry->stale_until_ms = entry->expires_ms + route->cache.stale_ms;
+    } else if (!entry->response) {
+        remove_entry(bucket, entry);
+    }
+    pthread_cond_broadcast(&bucket->filled);
+    pthread_mutex_unlock(&bucket->mutex);
+}
+
+/**
+ * Copies the current cache counters
+ */
+void cache_get_stats(CacheStats *stats) {
+    stats->hits = __atomic_load_n(&cache_stats.hits, __ATOMIC_RELAXED);
+    stats->stale_hits = __atomic_load_n(&cache_stats.stale_hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache_stats.misses, __ATOMIC_RELAXED);
+    stats->coalesced = __atomic_load_n(&cache_stats.coalesced, __ATOMIC_RELAXED);
+    stats->entries = __atomic_load_n(&cache_stats.entries, __ATOMIC_RELAXED);
+}
+
+/**
+ * Calls visit for every cached response, holding one bucket lock at a time
+ * so requests on other keys are never held up
+ */
+void cache_for_each(void (*visit)(const char *key, size_t len, long long expires_in_ms, void *arg), void *arg) {
+    pthread_once(&buckets_once, init_buckets);
+    long long now = now_ms();
+
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        pthread_mutex_lock(&buckets[i].mutex);
+        for (CacheEntry *entry = buckets[i].head; entry; entry = entry->next) {
+            if (entry->response) visit(entry->key, entry->response->len, entry->expires_ms - now, arg);
+        }
+        pthread_mutex_unlock(&buckets[i].mutex);
+    }
+}
+
+/**
+ * Drops every cached response that is not currently being produced
+ */
+void cache_purge(void) {
+    pthread_once(&buckets_once, init_buckets);
+
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        pthread_mutex_lock(&buckets[i].mutex);
+        CacheEntry *entry = buckets[i].head;
+        while (entry) {
+            CacheEntry *next = entry->next;
+            if (!entry->filling) remove_entry(&buckets[i], entry);
+            entry = next;
+        }
+        pthread_mutex_unlock(&buckets[i].mutex);
+    }
+}
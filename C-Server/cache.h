@@ -0,0 +1,43 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "Http_server.h"
+
+#define CACHE_BUCKETS 256
+#define CACHE_MAX_ENTRIES 1024
+#define CACHE_KEY_SIZE 1024
+#define CACHE_SWEEP_RETRY_MS 10   // Sweep backoff when entries could not be inspected
+
+// Immutable cached response, shared by readers through a reference count
+typedef struct {
+    int refs;
+    size_t len;
+    char data[];
+} CachedResponse;
+
+// Cache entry for one method + path (+ query) + vary-header combination
+typedef struct CacheEntry {
+    char key[CACHE_KEY_SIZE];
+    unsigned long hash;
+    CachedResponse *response;  // NULL until the first handler run completes
+    long long expires_ms;
+    long long stale_until_ms;
+    int filling;               // A handler run is producing a response for this key
+    struct CacheEntry *next;
+} CacheEntry;
+
+// Response cache counters
+typedef struct {
+    unsigned long hits;
+    unsigned long stale_hits;
+    unsigned long misses;
+    unsigned long coalesced;   // Requests that waited on another request's handler run
+    int entries;
+} CacheStats;
+
+void cache_handle_request(Connection *conn, HttpRequest *request, const char *client_ip);
+void cache_get_stats(CacheStats *stats);
+void cache_purge(void);
+void cache_for_each(void (*visit)(const char *key, size_t len, long long expires_in_ms, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,525 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "hpack.h"
+
+// Huffman code for each symbol (RFC 7541 Appendix B), symbol 256 is EOS
+typedef struct {
+    uint32_t code;
+    uint8_t bits;
+} HuffmanCode;
+
+static const HuffmanCode huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+
+};
+
+// Static table (RFC 7541 Appendix A), index 1 is the first entry
+static const struct {
+    const char *name;
+    const char *value;
+} static_table[HPACK_STATIC_ENTRIES] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// Huffman decoding tree: a positive child is a node index, a negative one
+// is -(symbol + 1), zero means no such code
+static int16_t huffman_tree[512][2];
+static pthread_once_t huffman_once = PTHREAD_ONCE_INIT;
+
+static void build_huffman_tree(void) {
+    int nodes = 1;
+    for (int symbol = 0; symbol < 257; symbol++) {
+        int node = 0;
+        for (int bit = huffman_codes[symbol].bits - 1; bit >= 0; bit--) {
+            int b = (huffman_codes[symbol].code >> bit) & 1;
+            if (bit == 0) {
+                huffman_tree[node][b] = -(symbol + 1);
+            } else {
+                if (huffman_tree[node][b] == 0) huffman_tree[node][b] = nodes++;
+                node = huffman_tree[node][b];
+            }
+        }
+    }
+}
+
+/**
+ * Decodes a Huffman-coded string. Returns the decoded length or -1.
+ */
+static int huffman_decode(const uint8_t *src, size_t len, char *out, size_t max_len) {
+    pthread_once(&huffman_once, build_huffman_tree);
+
+    size_t used = 0;
+    int node = 0;
+    int pending_bits = 0;
+    int pending_ones = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (src[i] >> bit) & 1;
+            int next = huffman_tree[node][b];
+            pending_bits++;
+            pending_ones &= b;
+
+            if (next < 0) {
+                int symbol = -next - 1;
+                if (symbol == 256 || used >= max_len) return -1;
+                out[used++] = (char)symbol;
+                node = 0;
+                pending_bits = 0;
+                pending_ones = 1;
+            } else if (next == 0) {
+                return -1;
+            } else {
+                node = next;
+            }
+        }
+    }
+
+    // Padding must be a prefix of EOS (all ones) and shorter than a byte
+    if (pending_bits > 7 || !pending_ones) return -1;
+    return (int)used;
+}
+
+static size_t huffman_length(const char *src, size_t len) {
+    size_t bits = 0;
+    for (size_t i = 0; i < len; i++) bits += huffman_codes[(uint8_t)src[i]].bits;
+    return (bits + 7) / 8;
+}
+
+static int huffman_encode(ByteBuffer *out, const char *src, size_t len) {
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        const HuffmanCode *code = &huffman_codes[(uint8_t)src[i]];
+        acc = (acc << code->bits) | code->code;
+        acc_bits += code->bits;
+        while (acc_bits >= 8) {
+            uint8_t byte = (uint8_t)(acc >> (acc_bits - 8));
+            if (buffer_append(out, &byte, 1) < 0) return -1;
+            acc_bits -= 8;
+        }
+    }
+    if (acc_bits > 0) {
+        // Pad with the most significant bits of EOS (all ones)
+        uint8_t byte = (uint8_t)((acc << (8 - acc_bits)) | (0xff >> acc_bits));
+        if (buffer_append(out, &byte, 1) < 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Decodes an integer with an N-bit prefix (RFC 7541 section 5.1)
+ */
+static int decode_int(const uint8_t **p, const uint8_t *end, int prefix_bits, uint32_t *value) {
+    if (*p >= end) return -1;
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    uint32_t v = **p & max_prefix;
+    (*p)++;
+    if (v < max_prefix) {
+        *value = v;
+        return 0;
+    }
+
+    for (int shift = 0; *p < end && shift <= 28; shift += 7) {
+        uint8_t b = *(*p)++;
+        v += (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int encode_int(ByteBuffer *out, uint8_t first_byte, int prefix_bits, uint32_t value) {
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix) {
+        first_byte |= (uint8_t)value;
+        return buffer_append(out, &first_byte, 1);
+    }
+
+    first_byte |= (uint8_t)max_prefix;
+    if (buffer_append(out, &first_byte, 1) < 0) return -1;
+    value -= max_prefix;
+    while (value >= 128) {
+        uint8_t b = (uint8_t)((value & 0x7f) | 0x80);
+        if (buffer_append(out, &b, 1) < 0) return -1;
+        value >>= 7;
+    }
+    uint8_t b = (uint8_t)value;
+    return buffer_append(out, &b, 1);
+}
+
+/**
+ * Decodes a string literal into out. Returns its length or -1.
+ */
+static int decode_string(const uint8_t **p, const uint8_t *end, char *out, size_t max_len) {
+    if (*p >= end) return -1;
+    int huffman = **p & 0x80;
+    uint32_t len;
+    if (decode_int(p, end, 7, &len) < 0 || len > (size_t)(end - *p)) return -1;
+
+    int result;
+    if (huffman) {
+        result = huffman_decode(*p, len, out, max_len);
+    } else {
+        if (len > max_len) return -1;
+        memcpy(out, *p, len);
+        result = (int)len;
+    }
+    *p += len;
+    return result;
+}
+
+static int encode_string(ByteBuffer *out, const char *str, size_t len) {
+    size_t huffman_len = huffman_length(str, len);
+    if (huffman_len < len) {
+        if (encode_int(out, 0x80, 7, huffman_len) < 0) return -1;
+        return huffman_encode(out, str, len);
+    }
+    if (encode_int(out, 0x00, 7, len) < 0) return -1;
+    return buffer_append(out, str, len);
+}
+
+void hpack_table_init(HpackTable *table, size_t max_size) {
+    memset(table, 0, sizeof(*table));
+    table->max_size = max_size;
+}
+
+void hpack_table_free(HpackTable *table) {
+    for (int i = 0; i < table->count; i++) {
+        HpackEntry *entry = &table->entries[(table->head + i) % table->capacity];
+        free(entry->name);
+        free(entry->value);
+    }
+    free(table->entries);
+    memset(table, 0, sizeof(*table));
+}
+
+static HpackEntry* table_get(HpackTable *table, int index) {
+    return &table->entries[(table->head + index) % table->capacity];
+}
+
+static void table_evict(HpackTable *table, size_t limit) {
+    while (table->count > 0 && table->size > limit) {
+        HpackEntry *oldest = table_get(table, table->count - 1);
+        table->size -= oldest->name_len + oldest->value_len + 32;
+        free(oldest->name);
+        free(oldest->value);
+        table->count--;
+    }
+}
+
+/**
+ * Inserts a new entry at the front of the dynamic table, evicting as needed
+ */
+static int table_add(HpackTable *table, const char *name, size_t name_len,
+                     const char *value, size_t value_len) {
+    size_t entry_size = name_len + value_len + 32;
+    if (entry_size > table->max_size) {
+        // An entry larger than the table empties it (RFC 7541 section 4.4)
+        table_evict(table, 0);
+        return 0;
+    }
+    table_evict(table, table->max_size - entry_size);
+
+    if (table->count == table->capacity) {
+        int new_capacity = table->capacity ? table->capacity * 2 : 16;
+        HpackEntry *entries = malloc(new_capacity * sizeof(HpackEntry));
+        if (!entries) return -1;
+        for (int i = 0; i < table->count; i++) entries[i] = *table_get(table, i);
+        free(table->entries);
+        table->entries = entries;
+        table->capacity = new_capacity;
+        table->head = 0;
+    }
+
+    HpackEntry entry;
+    entry.name = malloc(name_len + 1);
+    entry.value = malloc(value_len + 1);
+    if (!entry.name || !entry.value) {
+        free(entry.name);
+        free(entry.value);
+        return -1;
+    }
+    memcpy(entry.name, name, name_len);
+    entry.name[name_len] = '\0';
+    memcpy(entry.value, value, value_len);
+    entry.value[value_len] = '\0';
+    entry.name_len = name_len;
+    entry.value_len = value_len;
+
+    table->head = (table->head + table->capacity - 1) % table->capacity;
+    table->entries[table->head] = entry;
+    table->count++;
+    table->size += entry_size;
+    return 0;
+}
+
+/**
+ * Changes the table limit (decoder: announced by the peer; encoder: our
+ * choice, announced at the start of the next header block)
+ */
+void hpack_table_set_max_size(HpackTable *table, size_t max_size) {
+    if (max_size == table->max_size) return;
+    table->max_size = max_size;
+    table_evict(table, max_size);
+    table->update_pending = 1;
+}
+
+/**
+ * Resolves a 1-based HPACK index to a name/value pair
+ */
+static int lookup(HpackTable *table, uint32_t index, const char **name, size_t *name_len,
+                  const char **value, size_t *value_len) {
+    if (index == 0) return -1;
+    if (index <= HPACK_STATIC_ENTRIES) {
+        *name = static_table[index - 1].name;
+        *value = static_table[index - 1].value;
+        *name_len = strlen(*name);
+        *value_len = strlen(*value);
+        return 0;
+    }
+    index -= HPACK_STATIC_ENTRIES + 1;
+    if ((int)index >= table->count) return -1;
+    HpackEntry *entry = table_get(table, index);
+    *name = entry->name;
+    *name_len = entry->name_len;
+    *value = entry->value;
+    *value_len = entry->value_len;
+    return 0;
+}
+
+/**
+ * Decodes a complete header block, calling back for every field
+ */
+int hpack_decode(HpackTable *table, const uint8_t *block, size_t len,
+                 HpackHeaderCallback callback, void *arg) {
+    const uint8_t *p = block;
+    const uint8_t *end = block + len;
+    char *name_buf = malloc(HPACK_MAX_STRING);
+    char *value_buf = malloc(HPACK_MAX_STRING);
+    int result = -1;
+    if (!name_buf || !value_buf) goto done;
+
+    while (p < end) {
+        uint8_t first = *p;
+        const char *name, *value;
+        size_t name_len, value_len;
+        uint32_t index;
+
+        if (first & 0x80) {
+            // Indexed header field
+            if (decode_int(&p, end, 7, &index) < 0 ||
+                lookup(table, index, &name, &name_len, &value, &value_len) < 0) goto done;
+            if (callback(arg, name, name_len, value, value_len) < 0) goto done;
+            continue;
+        }
+
+        if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update
+            if (decode_int(&p, end, 5, &index) < 0 || index > HPACK_DEFAULT_TABLE_SIZE) goto done;
+            table->max_size = index;
+            table_evict(table, index);
+            continue;
+        }
+
+        // Literal: with incremental indexing (01), without (0000) or never indexed (0001)
+        int incremental = (first & 0xc0) == 0x40;
+        if (decode_int(&p, end, incremental ? 6 : 4, &index) < 0) goto done;
+
+        if (index == 0) {
+            int n = decode_string(&p, end, name_buf, HPACK_MAX_STRING);
+            if (n < 0) goto done;
+            name = name_buf;
+            name_len = n;
+        } else {
+            const char *unused;
+            size_t unused_len;
+            if (lookup(table, index, &name, &name_len, &unused, &unused_len) < 0) goto done;
+            // Copy the name: adding the entry below may evict the one it points to
+            memcpy(name_buf, name, name_len);
+            name = name_buf;
+        }
+
+        int n = decode_string(&p, end, value_buf, HPACK_MAX_STRING);
+        if (n < 0) goto done;
+        value = value_buf;
+        value_len = n;
+
+        if (incremental && table_add(table, name, name_len, value, value_len) < 0) goto done;
+        if (callback(arg, name, name_len, value, value_len) < 0) goto done;
+    }
+    result = 0;
+
+done:
+    free(name_buf);
+    free(value_buf);
+    return result;
+}
+
+/**
+ * Appends one header field to a header block, using the static and
+ * dynamic tables where possible. Names must be lowercase.
+ */
+int hpack_encode(HpackTable *table, ByteBuffer *out, const char *name, const char *value) {
+    if (table->update_pending) {
+        if (encode_int(out, 0x20, 5, table->max_size) < 0) return -1;
+        table->update_pending = 0;
+    }
+
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    uint32_t name_index = 0;
+
+    for (int i = 0; i < HPACK_STATIC_ENTRIES; i++) {
+        if (strcmp(static_table[i].name, name) != 0) continue;
+        if (strcmp(static_table[i].value, value) == 0) return encode_int(out, 0x80, 7, i + 1);
+        if (!name_index) name_index = i + 1;
+    }
+    for (int i = 0; i < table->count; i++) {
+        HpackEntry *entry = table_get(table, i);
+        if (entry->name_len != name_len || memcmp(entry->name, name, name_len) != 0) continue;
+        if (entry->value_len == value_len && memcmp(entry->value, value, value_len) == 0) {
+            return encode_int(out, 0x80, 7, HPACK_STATIC_ENTRIES + 1 + i);
+        }
+        if (!name_index) name_index = HPACK_STATIC_ENTRIES + 1 + i;
+    }
+
+    // Values that change on nearly every response would only churn the table
+    int incremental = strcmp(name, "date") != 0 && strcmp(name, "content-length") != 0 &&
+                      strcmp(name, "etag") != 0 && strcmp(name, "last-modified") != 0;
+
+    if (encode_int(out, incremental ? 0x40 : 0x00, incremental ? 6 : 4, name_index) < 0) return -1;
+    if (!name_index && encode_string(out, name, name_len) < 0) return -1;
+    if (encode_string(out, value, value_len) < 0) return -1;
+
+    if (incremental) return table_add(table, name, name_len, value, value_len);
+    return 0;
+}
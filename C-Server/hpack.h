@@ -0,0 +1,43 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Http_server.h"
+
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+#define HPACK_STATIC_ENTRIES 61
+#define HPACK_MAX_STRING 8192
+
+// Dynamic table entry
+typedef struct {
+    char *name;
+    char *value;
+    size_t name_len;
+    size_t value_len;
+} HpackEntry;
+
+// HPACK dynamic table (one per direction per connection), stored as a ring
+// with the newest entry at index 0
+typedef struct {
+    HpackEntry *entries;
+    int capacity;
+    int count;
+    int head;
+    size_t size;            // Sum of entry sizes as defined by RFC 7541 (len + 32)
+    size_t max_size;        // Current limit, changed by table size updates
+    int update_pending;     // Encoder: max_size changed and must be announced
+} HpackTable;
+
+// Called for each decoded header field
+typedef int (*HpackHeaderCallback)(void *arg, const char *name, size_t name_len,
+                                   const char *value, size_t value_len);
+
+void hpack_table_init(HpackTable *table, size_t max_size);
+void hpack_table_free(HpackTable *table);
+void hpack_table_set_max_size(HpackTable *table, size_t max_size);
+int hpack_decode(HpackTable *table, const uint8_t *block, size_t len,
+                 HpackHeaderCallback callback, void *arg);
+int hpack_encode(HpackTable *table, ByteBuffer *out, const char *name, const char *value);
+
+#endif
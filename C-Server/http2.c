@@ -0,0 +1,828 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "http2.h"
+#include "body.h"
+
+static uint32_t read_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void write_u32(uint8_t *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/**
+ * Appends a frame to the session's output buffer
+ */
+static void queue_frame(H2Session *session, uint8_t type, uint8_t flags, uint32_t stream_id,
+                        const void *payload, size_t len) {
+    uint8_t header[H2_FRAME_HEADER_LEN] = {
+        (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len, type, flags, 0, 0, 0, 0
+    };
+    write_u32(header + 5, stream_id & 0x7fffffff);
+    buffer_append(&session->out, header, sizeof(header));
+    if (len > 0) buffer_append(&session->out, payload, len);
+}
+
+static int flush_output(H2Session *session) {
+    if (session->out.len == 0) return 0;
+    int result = conn_send(session->conn, session->out.data, session->out.len);
+    session->out.len = 0;
+    return result;
+}
+
+static void queue_window_update(H2Session *session, uint32_t stream_id, uint32_t increment) {
+    uint8_t payload[4];
+    write_u32(payload, increment);
+    queue_frame(session, H2_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+/**
+ * Sends GOAWAY and marks the session for shutdown. Returns -1 so frame
+ * handlers can return its result directly.
+ */
+static int connection_error(H2Session *session, uint32_t error_code) {
+    uint8_t payload[8];
+    write_u32(payload, session->last_stream_id);
+    write_u32(payload + 4, error_code);
+    queue_frame(session, H2_GOAWAY, 0, 0, payload, sizeof(payload));
+    session->goaway = 1;
+    return -1;
+}
+
+static H2Stream* find_stream(H2Session *session, uint32_t id) {
+    for (H2Stream *stream = session->streams; stream; stream = stream->next) {
+        if (stream->id == id) return stream;
+    }
+    return NULL;
+}
+
+/**
+ * Creates a stream and appends it to the session, so streams are served
+ * in the order they were opened
+ */
+static H2Stream* create_stream(H2Session *session, uint32_t id) {
+    H2Stream *stream = calloc(1, sizeof(H2Stream));
+    if (!stream) return NULL;
+    stream->request = calloc(1, sizeof(HttpRequest));
+    if (!stream->request) {
+        free(stream);
+        return NULL;
+    }
+    stream->id = id;
+    stream->session = session;
+    stream->send_window = session->peer_initial_window;
+    snprintf(stream->request->version, sizeof(stream->request->version), "HTTP/2.0");
+
+    H2Stream **link = &session->streams;
+    while (*link) link = &(*link)->next;
+    *link = stream;
+    session->stream_count++;
+    return stream;
+}
+
+static void free_stream(H2Session *session, H2Stream *stream) {
+    // The running handler still writes to its stream; run_stream frees it
+    if (stream == session->active) {
+        stream->closed = 1;
+        return;
+    }
+    for (H2Stream **link = &session->streams; *link; link = &(*link)->next) {
+        if (*link == stream) {
+            *link = stream->next;
+            break;
+        }
+    }
+    buffer_free(&stream->header_block);
+    buffer_free(&stream->body);
+    buffer_free(&stream->response_head);
+    buffer_free(&stream->response_body);
+    free(stream->request);
+    free(stream);
+    session->stream_count--;
+}
+
+static void reset_stream(H2Session *session, H2Stream *stream, uint32_t error_code) {
+    uint8_t payload[4];
+    write_u32(payload, error_code);
+    queue_frame(session, H2_RST_STREAM, 0, stream->id, payload, sizeof(payload));
+    free_stream(session, stream);
+}
+
+static void copy_field(char *dst, size_t size, const char *src, size_t len) {
+    if (len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static int name_is(const char *name, size_t name_len, const char *expected) {
+    return name_len == strlen(expected) && memcmp(name, expected, name_len) == 0;
+}
+
+static void add_header(HttpRequest *request, const char *name, size_t name_len,
+                       const char *value, size_t value_len) {
+    if (request->header_count >= MAX_HEADERS) return;
+    HttpHeader *header = &request->headers[request->header_count++];
+    copy_field(header->name, sizeof(header->name), name, name_len);
+    copy_field(header->value, sizeof(header->value), value, value_len);
+}
+
+/**
+ * HPACK callback: maps pseudo-headers onto the request line fields and
+ * stores regular fields as headers. Connection-specific fields are not
+ * allowed in HTTP/2 and Content-Length is recomputed from the DATA frames.
+ */
+static int add_request_header(void *arg, const char *name, size_t name_len,
+                              const char *value, size_t value_len) {
+    H2Stream *stream = arg;
+    HttpRequest *request = stream->request;
+
+    if (name_len > 0 && name[0] == ':') {
+        if (name_is(name, name_len, ":method")) {
+            copy_field(request->method, sizeof(request->method), value, value_len);
+        } else if (name_is(name, name_len, ":path")) {
+            copy_field(request->path, sizeof(request->path), value, value_len);
+        } else if (name_is(name, name_len, ":authority")) {
+            add_header(request, "Host", 4, value, value_len);
+        } else if (!name_is(name, name_len, ":scheme")) {
+            stream->malformed = 1;
+        }
+        return 0;
+    }
+
+    if (name_is(name, name_len, "connection") || name_is(name, name_len, "keep-alive") ||
+        name_is(name, name_len, "proxy-connection") || name_is(name, name_len, "transfer-encoding") ||
+        name_is(name, name_len, "upgrade")) {
+        stream->malformed = 1;
+        return 0;
+    }
+    if (name_is(name, name_len, "content-length")) return 0;
+
+    add_header(request, name, name_len, value, value_len);
+    return 0;
+}
+
+static int process_input(H2Session *session);
+
+/**
+ * Flushes queued frames and reads the peer's next frames while a handler
+ * waits for flow-control credit. Streams completed meanwhile are left for
+ * the main loop to run.
+ */
+static int wait_for_window(H2Session *session) {
+    if (flush_output(session) < 0) return -1;
+    ssize_t n = conn_recv(session->conn, session->in + session->in_len, sizeof(session->in) - session->in_len);
+    if (n <= 0) {
+        session->goaway = 1;
+        return -1;
+    }
+    session->in_len += n;
+    return process_input(session);
+}
+
+/**
+ * Sends the stream's pending response bytes as DATA frames, waiting for
+ * WINDOW_UPDATE whenever the stream or connection window is spent. With
+ * end_stream the last frame (possibly empty) closes the stream.
+ */
+static int send_data(H2Session *session, H2Stream *stream, int end_stream) {
+    ByteBuffer *body = &stream->response_body;
+    if (body->len == 0 && !end_stream) return 0;
+
+    size_t pos = 0;
+    do {
+        size_t len = body->len - pos;
+        while (len > 0 && (session->send_window <= 0 || stream->send_window <= 0)) {
+            if (wait_for_window(session) < 0) return -1;
+        }
+        if (stream->closed || session->goaway) return -1;
+        if ((int64_t)len > session->send_window) len = session->send_window;
+        if ((int64_t)len > stream->send_window) len = stream->send_window;
+
+        int last = pos + len == body->len;
+        queue_frame(session, H2_DATA, last && end_stream ? H2_FLAG_END_STREAM : 0, stream->id,
+                    body->data + pos, len);
+        pos += len;
+        stream->send_window -= len;
+        session->send_window -= len;
+        if (session->out.len >= H2_FLUSH_THRESHOLD && flush_output(session) < 0) return -1;
+    } while (pos < body->len);
+
+    body->len = 0;
+    if (end_stream) stream->ended = 1;
+    return 0;
+}
+
+/**
+ * Adds response bytes to the stream, sending a DATA frame each time a
+ * full one is collected
+ */
+static int queue_body(H2Session *session, H2Stream *stream, const char *data, size_t len) {
+    size_t frame_size = session->peer_max_frame < H2_FLUSH_THRESHOLD ? session->peer_max_frame : H2_FLUSH_THRESHOLD;
+    while (len > 0) {
+        size_t take = frame_size - stream->response_body.len;
+        if (take > len) take = len;
+        if (buffer_append(&stream->response_body, data, take) < 0) return -1;
+        data += take;
+        len -= take;
+        if (stream->response_body.len == frame_size && send_data(session, stream, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Decodes a chunked body as it arrives, in pieces of any size
+ */
+static int dechunk(H2Session *session, H2Stream *stream, const char *data, size_t len) {
+    const char *end = data + len;
+    while (data < end) {
+        switch (stream->chunk_state) {
+            case CHUNK_SIZE: {
+                int digit = hex_value(*data);
+                if (digit >= 0) {
+                    stream->chunk_left = stream->chunk_left * 16 + digit;
+                } else {
+                    stream->chunk_state = CHUNK_EXTENSION;
+                    continue;
+                }
+                data++;
+                break;
+            }
+            case CHUNK_EXTENSION:
+                if (*data++ == '\n') stream->chunk_state = stream->chunk_left > 0 ? CHUNK_DATA : CHUNK_DONE;
+                break;
+            case CHUNK_DATA: {
+                size_t n = end - data;
+                if (n > stream->chunk_left) n = stream->chunk_left;
+                if (queue_body(session, stream, data, n) < 0) return -1;
+                data += n;
+                stream->chunk_left -= n;
+                if (stream->chunk_left == 0) stream->chunk_state = CHUNK_DATA_END;
+                break;
+            }
+            case CHUNK_DATA_END:
+                if (*data++ == '\n') stream->chunk_state = CHUNK_SIZE;
+                break;
+            case CHUNK_DONE:
+                return 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Encodes the handler's HTTP/1.1 response header as HEADERS (+ CONTINUATION).
+ * The stream ends with the header for HEAD and empty bodies.
+ */
+static int send_headers(H2Session *session, H2Stream *stream, const char *data, const char *head_end) {
+    int status = 0;
+    if (sscanf(data, "HTTP/1.%*d %d", &status) != 1 || status < 200 || status > 999) {
+        reset_stream(session, stream, H2_INTERNAL_ERROR);
+        return -1;
+    }
+
+    ByteBuffer block = {NULL, 0, 0};
+    char status_text[8];
+    snprintf(status_text, sizeof(status_text), "%d", status);
+    hpack_encode(&session->encoder, &block, ":status", status_text);
+
+    int empty = strcmp(stream->request->method, "HEAD") == 0 || status == 204 || status == 304;
+    const char *line = strstr(data, "\r\n") + 2;
+    while (line < head_end) {
+        const char *line_end = strstr(line, "\r\n");
+        const char *colon = memchr(line, ':', line_end - line);
+        if (colon) {
+            char name[128];
+            size_t name_len = colon - line;
+            if (name_len >= sizeof(name)) name_len = sizeof(name) - 1;
+            for (size_t i = 0; i < name_len; i++) name[i] = tolower((unsigned char)line[i]);
+            name[name_len] = '\0';
+
+            const char *value_start = colon + 1;
+            while (*value_start == ' ' || *value_start == '\t') value_start++;
+            char *value = strndup(value_start, line_end - value_start);
+
+            if (strcmp(name, "transfer-encoding") == 0) {
+                stream->chunked = value && strcasestr(value, "chunked") != NULL;
+            } else if (value && strcmp(name, "connection") != 0 && strcmp(name, "keep-alive") != 0 &&
+                       strcmp(name, "proxy-connection") != 0 && strcmp(name, "upgrade") != 0) {
+                if (strcmp(name, "content-length") == 0 && strcmp(value, "0") == 0) empty = 1;
+                hpack_encode(&session->encoder, &block, name, value);
+            }
+            free(value);
+        }
+        line = line_end + 2;
+    }
+
+    // Header block, split to the peer's frame size
+    size_t offset = 0;
+    uint8_t type = H2_HEADERS;
+    do {
+        size_t len = block.len - offset;
+        if (len > session->peer_max_frame) len = session->peer_max_frame;
+        uint8_t flags = 0;
+        if (offset + len == block.len) flags |= H2_FLAG_END_HEADERS;
+        if (type == H2_HEADERS && empty) flags |= H2_FLAG_END_STREAM;
+        queue_frame(session, type, flags, stream->id, block.data + offset, len);
+        offset += len;
+        type = H2_CONTINUATION;
+    } while (offset < block.len);
+    buffer_free(&block);
+
+    stream->headers_sent = 1;
+    stream->ended = empty;
+    return 0;
+}
+
+static int send_body(H2Session *session, H2Stream *stream, const char *data, size_t len) {
+    if (stream->ended || len == 0) return 0;
+    if (stream->chunked) return dechunk(session, stream, data, len);
+    return queue_body(session, stream, data, len);
+}
+
+/**
+ * Connection output of a stream's handler. The HTTP/1.1 header it writes
+ * first becomes HEADERS; the body follows as DATA frames while the handler
+ * is still producing it, so memory per stream stays at one frame however
+ * large the response.
+ */
+int http2_stream_send(H2Stream *stream, const void *data, size_t len) {
+    H2Session *session = stream->session;
+    if (stream->closed || session->goaway) return -1;
+    if (stream->headers_sent) return send_body(session, stream, data, len);
+
+    ByteBuffer *head = &stream->response_head;
+    if (buffer_append(head, data, len) < 0) return -1;
+    const char *head_end = memmem(head->data, head->len, "\r\n\r\n", 4);
+    if (!head_end) return head->len > H2_MAX_HEADER_BLOCK ? -1 : 0;
+
+    int result = send_headers(session, stream, head->data, head_end);
+    if (result == 0) {
+        size_t head_len = head_end + 4 - head->data;
+        result = send_body(session, stream, head->data + head_len, head->len - head_len);
+    }
+    buffer_free(head);
+    return result;
+}
+
+/**
+ * Runs the route for a complete request, streaming its output as frames
+ */
+static void run_stream(H2Session *session, H2Stream *stream) {
+    HttpRequest *request = stream->request;
+    if (!request->method[0] || !request->path[0]) {
+        reset_stream(session, stream, H2_PROTOCOL_ERROR);
+        return;
+    }
+
+    if (stream->body.len > 0) {
+        char length[32];
+        snprintf(length, sizeof(length), "%zu", stream->body.len);
+        add_header(request, "Content-Length", 14, length, strlen(length));
+        buffer_append(&stream->body, "", 1);  // Handlers expect a terminated body
+        request->body = stream->body.data;
+        request->body_length = stream->body.len - 1;
+    }
+
+    // The DATA frames are already collected, so the handler reads them from memory
+    BodyReader *body_reader = malloc(sizeof(BodyReader));
+    if (!body_reader) {
+        reset_stream(session, stream, H2_INTERNAL_ERROR);
+        return;
+    }
+    body_reader_init(body_reader, NULL, request);
+
+    Connection stream_conn = { .fd = session->conn->fd, .h2_stream = stream };
+    session->active = stream;
+    dispatch_request(&stream_conn, request, session->client_ip);
+    request->body = NULL;
+    request->body_reader = NULL;
+    free(body_reader);
+
+    if (!stream->closed && !stream->headers_sent) {
+        reset_stream(session, stream, H2_INTERNAL_ERROR);
+    } else if (!stream->closed && !stream->ended) {
+        send_data(session, stream, 1);
+    }
+    session->active = NULL;
+    free_stream(session, stream);
+}
+
+/**
+ * Runs the handlers of streams whose requests are complete, in the order
+ * the streams were opened
+ */
+static void run_ready_streams(H2Session *session) {
+    H2Stream *stream = session->streams;
+    while (stream && !session->goaway) {
+        if (!stream->runnable) {
+            stream = stream->next;
+            continue;
+        }
+        stream->runnable = 0;
+        run_stream(session, stream);
+        // Frames read while it ran may have opened or reset other streams
+        stream = session->streams;
+    }
+}
+
+/**
+ * Called once a header block is complete (END_HEADERS seen)
+ */
+static int headers_complete(H2Session *session, H2Stream *stream) {
+    int result = hpack_decode(&session->decoder, (const uint8_t*)stream->header_block.data,
+                              stream->header_block.len, add_request_header, stream);
+    buffer_free(&stream->header_block);
+    if (result < 0) return connection_error(session, H2_COMPRESSION_ERROR);
+
+    if (stream->malformed) {
+        reset_stream(session, stream, H2_PROTOCOL_ERROR);
+    } else if (session->stream_count > H2_MAX_CONCURRENT_STREAMS) {
+        reset_stream(session, stream, H2_REFUSED_STREAM);
+    } else if (stream->request_complete) {
+        stream->runnable = 1;
+    }
+    return 0;
+}
+
+/**
+ * Removes the padding (and optionally priority fields) from a frame payload.
+ * Returns -1 if the padding length is invalid.
+ */
+static int strip_padding(uint8_t flags, const uint8_t **payload, uint32_t *len, size_t priority_len) {
+    size_t pad = 0;
+    if (flags & H2_FLAG_PADDED) {
+        if (*len < 1) return -1;
+        pad = (*payload)[0];
+        (*payload)++;
+        (*len)--;
+    }
+    if (*len < pad + priority_len) return -1;
+    *payload += priority_len;
+    *len -= pad + priority_len;
+    return 0;
+}
+
+static int handle_headers(H2Session *session, uint8_t flags, uint32_t stream_id,
+                          const uint8_t *payload, uint32_t len) {
+    if (stream_id == 0 || stream_id % 2 == 0) return connection_error(session, H2_PROTOCOL_ERROR);
+    if (strip_padding(flags, &payload, &len, (flags & H2_FLAG_PRIORITY) ? 5 : 0) < 0) {
+        return connection_error(session, H2_PROTOCOL_ERROR);
+    }
+
+    H2Stream *stream = find_stream(session, stream_id);
+    if (!stream) {
+        if (stream_id <= session->last_stream_id) return connection_error(session, H2_STREAM_CLOSED);
+        session->last_stream_id = stream_id;
+        stream = create_stream(session, stream_id);
+        if (!stream) return connection_error(session, H2_INTERNAL_ERROR);
+    } else if (stream->request_complete) {
+        return connection_error(session, H2_STREAM_CLOSED);
+    }
+
+    if (stream->header_block.len + len > H2_MAX_HEADER_BLOCK) {
+        return connection_error(session, H2_PROTOCOL_ERROR);
+    }
+    if (flags & H2_FLAG_END_STREAM) stream->request_complete = 1;
+    buffer_append(&stream->header_block, payload, len);
+
+    if (flags & H2_FLAG_END_HEADERS) return headers_complete(session, stream);
+    session->continuation_stream = stream_id;
+    return 0;
+}
+
+static int handle_continuation(H2Session *session, uint8_t flags, uint32_t stream_id,
+                               const uint8_t *payload, uint32_t len) {
+    H2Stream *stream = find_stream(session, stream_id);
+    if (stream_id != session->continuation_stream || !stream) {
+        return connection_error(session, H2_PROTOCOL_ERROR);
+    }
+    if (stream->header_block.len + len > H2_MAX_HEADER_BLOCK) {
+        return connection_error(session, H2_PROTOCOL_ERROR);
+    }
+    buffer_append(&stream->header_block, payload, len);
+
+    if (!(flags & H2_FLAG_END_HEADERS)) return 0;
+    session->continuation_stream = 0;
+    return headers_complete(session, stream);
+}
+
+static int handle_data(H2Session *session, uint8_t flags, uint32_t stream_id,
+                       const uint8_t *payload, uint32_t len) {
+    if (stream_id == 0) return connection_error(session, H2_PROTOCOL_ERROR);
+
+    // The connection window is replenished as soon as a frame is consumed
+    if (len > 0) queue_window_update(session, 0, len);
+
+    uint32_t frame_len = len;
+    if (strip_padding(flags, &payload, &len, 0) < 0) return connection_error(session, H2_PROTOCOL_ERROR);
+
+    H2Stream *stream = find_stream(session, stream_id);
+    if (!stream || stream->request_complete) {
+        if (stream_id > session->last_stream_id) return connection_error(session, H2_PROTOCOL_ERROR);
+        uint8_t error[4];
+        write_u32(error, H2_STREAM_CLOSED);
+        queue_frame(session, H2_RST_STREAM, 0, stream_id, error, sizeof(error));
+        return 0;
+    }
+
+    if (stream->body.len + len > H2_MAX_REQUEST_BODY) {
+        reset_stream(session, stream, H2_REFUSED_STREAM);
+        return 0;
+    }
+    buffer_append(&stream->body, payload, len);
+
+    if (flags & H2_FLAG_END_STREAM) {
+        stream->request_complete = 1;
+        stream->runnable = 1;
+    } else if (frame_len > 0) {
+        queue_window_update(session, stream_id, frame_len);
+    }
+    return 0;
+}
+
+/**
+ * Applies a SETTINGS payload from the peer. Returns 0 or an error code.
+ */
+static uint32_t apply_settings(H2Session *session, const uint8_t *payload, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        uint16_t id = (payload[i] << 8) | payload[i + 1];
+        uint32_t value = read_u32(payload + i + 2);
+
+        switch (id) {
+            case H2_SETTINGS_HEADER_TABLE_SIZE:
+                hpack_table_set_max_size(&session->encoder,
+                    value < HPACK_DEFAULT_TABLE_SIZE ? value : HPACK_DEFAULT_TABLE_SIZE);
+                break;
+            case H2_SETTINGS_ENABLE_PUSH:
+                if (value > 1) return H2_PROTOCOL_ERROR;
+                break;
+            case H2_SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+                int64_t delta = (int64_t)value - session->peer_initial_window;
+                for (H2Stream *stream = session->streams; stream; stream = stream->next) {
+                    stream->send_window += delta;
+                    if (stream->send_window > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+                }
+                session->peer_initial_window = value;
+                break;
+            }
+            case H2_SETTINGS_MAX_FRAME_SIZE:
+                if (value < H2_DEFAULT_FRAME_SIZE || value > 0xffffff) return H2_PROTOCOL_ERROR;
+                session->peer_max_frame = value;
+                break;
+            default:
+                // MAX_CONCURRENT_STREAMS only limits pushes; unknown settings are ignored
+                break;
+        }
+    }
+    return 0;
+}
+
+static int handle_window_update(H2Session *session, uint32_t stream_id, const uint8_t *payload, uint32_t len) {
+    if (len != 4) return connection_error(session, H2_FRAME_SIZE_ERROR);
+    uint32_t increment = read_u32(payload) & 0x7fffffff;
+
+    if (stream_id == 0) {
+        if (increment == 0) return connection_error(session, H2_PROTOCOL_ERROR);
+        session->send_window += increment;
+        if (session->send_window > H2_MAX_WINDOW) return connection_error(session, H2_FLOW_CONTROL_ERROR);
+        return 0;
+    }
+
+    // Updates for streams we already finished are legal and ignored
+    H2Stream *stream = find_stream(session, stream_id);
+    if (!stream) return 0;
+    if (increment == 0) {
+        reset_stream(session, stream, H2_PROTOCOL_ERROR);
+    } else if ((stream->send_window += increment) > H2_MAX_WINDOW) {
+        reset_stream(session, stream, H2_FLOW_CONTROL_ERROR);
+    }
+    return 0;
+}
+
+/**
+ * Dispatches one frame. Returns -1 on a connection error.
+ */
+static int handle_frame(H2Session *session, uint8_t type, uint8_t flags, uint32_t stream_id,
+                        const uint8_t *payload, uint32_t len) {
+    // A header block must not be interleaved with any other frame
+    if (session->continuation_stream && type != H2_CONTINUATION) {
+        return connection_error(session, H2_PROTOCOL_ERROR);
+    }
+
+    switch (type) {
+        case H2_DATA:
+            return handle_data(session, flags, stream_id, payload, len);
+        case H2_HEADERS:
+            return handle_headers(session, flags, stream_id, payload, len);
+        case H2_CONTINUATION:
+            return handle_continuation(session, flags, stream_id, payload, len);
+        case H2_PRIORITY:
+            // Streams are served round-robin; priority hints are ignored
+            if (len != 5) return connection_error(session, H2_FRAME_SIZE_ERROR);
+            return 0;
+        case H2_RST_STREAM: {
+            if (stream_id == 0) return connection_error(session, H2_PROTOCOL_ERROR);
+            if (len != 4) return connection_error(session, H2_FRAME_SIZE_ERROR);
+            H2Stream *stream = find_stream(session, stream_id);
+            if (stream) free_stream(session, stream);
+            return 0;
+        }
+        case H2_SETTINGS: {
+            if (stream_id != 0) return connection_error(session, H2_PROTOCOL_ERROR);
+            if (flags & H2_FLAG_ACK) {
+                return len == 0 ? 0 : connection_error(session, H2_FRAME_SIZE_ERROR);
+            }
+            if (len % 6 != 0) return connection_error(session, H2_FRAME_SIZE_ERROR);
+            uint32_t error = apply_settings(session, payload, len);
+            if (error) return connection_error(session, error);
+            queue_frame(session, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+            return 0;
+        }
+        case H2_PING:
+            if (stream_id != 0) return connection_error(session, H2_PROTOCOL_ERROR);
+            if (len != 8) return connection_error(session, H2_FRAME_SIZE_ERROR);
+            if (!(flags & H2_FLAG_ACK)) queue_frame(session, H2_PING, H2_FLAG_ACK, 0, payload, len);
+            return 0;
+        case H2_GOAWAY:
+            session->goaway = 1;
+            return 0;
+        case H2_WINDOW_UPDATE:
+            return handle_window_update(session, stream_id, payload, len);
+        case H2_PUSH_PROMISE:
+            return connection_error(session, H2_PROTOCOL_ERROR);
+        default:
+            // Unknown frame types must be ignored
+            return 0;
+    }
+}
+
+/**
+ * Handles every complete frame in the input buffer and keeps the partial
+ * remainder. Returns -1 once the session is going away.
+ */
+static int process_input(H2Session *session) {
+    size_t pos = 0;
+    if (!session->preface_seen && session->in_len >= H2_PREFACE_LEN) {
+        if (!http2_is_preface((const char*)session->in, session->in_len)) {
+            return connection_error(session, H2_PROTOCOL_ERROR);
+        }
+        session->preface_seen = 1;
+        pos = H2_PREFACE_LEN;
+    }
+
+    while (session->preface_seen && !session->goaway && session->in_len - pos >= H2_FRAME_HEADER_LEN) {
+        const uint8_t *frame = session->in + pos;
+        uint32_t len = ((uint32_t)frame[0] << 16) | (frame[1] << 8) | frame[2];
+        if (len > H2_DEFAULT_FRAME_SIZE) return connection_error(session, H2_FRAME_SIZE_ERROR);
+        if (session->in_len - pos < H2_FRAME_HEADER_LEN + len) break;
+
+        handle_frame(session, frame[3], frame[4], read_u32(frame + 5) & 0x7fffffff,
+                     frame + H2_FRAME_HEADER_LEN, len);
+        pos += H2_FRAME_HEADER_LEN + len;
+    }
+    memmove(session->in, session->in + pos, session->in_len - pos);
+    session->in_len -= pos;
+    return session->goaway ? -1 : 0;
+}
+
+/**
+ * Decodes a base64url string (the HTTP2-Settings header). Returns the
+ * decoded length or -1.
+ */
+static int base64url_decode(const char *src, uint8_t *out, size_t max_len) {
+    uint32_t bits = 0;
+    int bit_count = 0;
+    size_t len = 0;
+
+    for (; *src && *src != '='; src++) {
+        int value;
+        if (*src >= 'A' && *src <= 'Z') value = *src - 'A';
+        else if (*src >= 'a' && *src <= 'z') value = *src - 'a' + 26;
+        else if (*src >= '0' && *src <= '9') value = *src - '0' + 52;
+        else if (*src == '-' || *src == '+') value = 62;
+        else if (*src == '_' || *src == '/') value = 63;
+        else return -1;
+
+        bits = (bits << 6) | value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            if (len >= max_len) return -1;
+            out[len++] = (bits >> bit_count) & 0xff;
+        }
+    }
+    return (int)len;
+}
+
+/**
+ * Returns 1 if the received bytes start with the HTTP/2 client preface
+ */
+int http2_is_preface(const char *data, size_t len) {
+    return len >= H2_PREFACE_LEN && memcmp(data, H2_PREFACE, H2_PREFACE_LEN) == 0;
+}
+
+/**
+ * Returns 1 if an HTTP/1.1 request asks to upgrade to cleartext HTTP/2.
+ * Requests with a body stay on HTTP/1.1.
+ */
+int http2_wants_upgrade(HttpRequest *request) {
+    const char *upgrade = get_header_value(request, "Upgrade");
+    if (!upgrade || !strcasestr(upgrade, "h2c")) return 0;
+    if (!get_header_value(request, "HTTP2-Settings")) return 0;
+    if (strcmp(request->method, "GET") != 0 && strcmp(request->method, "HEAD") != 0) return 0;
+    return request->body_length == 0;
+}
+
+/**
+ * Serves an HTTP/2 connection until the peer goes away. initial holds
+ * bytes already read (the prior-knowledge preface); upgrade_request is
+ * the HTTP/1.1 request that asked for h2c and becomes stream 1.
+ */
+void http2_serve(Connection *conn, const char *initial, size_t initial_len,
+                 HttpRequest *upgrade_request, const char *client_ip) {
+    H2Session *session = calloc(1, sizeof(H2Session));
+    if (!session) return;
+    session->conn = conn;
+    session->client_ip = client_ip;
+    session->send_window = H2_DEFAULT_WINDOW;
+    session->peer_initial_window = H2_DEFAULT_WINDOW;
+    session->peer_max_frame = H2_DEFAULT_FRAME_SIZE;
+    hpack_table_init(&session->decoder, HPACK_DEFAULT_TABLE_SIZE);
+    hpack_table_init(&session->encoder, HPACK_DEFAULT_TABLE_SIZE);
+
+    struct timeval tv = { H2_IDLE_TIMEOUT, 0 };
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (upgrade_request) {
+        // HTTP2-Settings carries the client's SETTINGS; it is acknowledged implicitly
+        uint8_t settings[256];
+        int settings_len = base64url_decode(get_header_value(upgrade_request, "HTTP2-Settings"),
+                                            settings, sizeof(settings));
+        if (settings_len < 0 || settings_len % 6 != 0 || apply_settings(session, settings, settings_len)) {
+            settings_len = -1;
+        }
+        const char *switching = "HTTP/1.1 101 Switching Protocols\r\n"
+                                "Connection: Upgrade\r\n"
+                                "Upgrade: h2c\r\n\r\n";
+        if (settings_len < 0 || conn_send(conn, switching, strlen(switching)) < 0) {
+            session->goaway = 1;
+        }
+    }
+
+    // Server preface: our SETTINGS, then a larger connection receive window
+    uint8_t settings[6] = { 0, H2_SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, 0 };
+    write_u32(settings + 2, H2_MAX_CONCURRENT_STREAMS);
+    queue_frame(session, H2_SETTINGS, 0, 0, settings, sizeof(settings));
+    queue_window_update(session, 0, H2_CONNECTION_WINDOW - H2_DEFAULT_WINDOW);
+
+    if (upgrade_request && !session->goaway) {
+        H2Stream *stream = create_stream(session, 1);
+        if (stream) {
+            HttpRequest *request = stream->request;
+            *request = *upgrade_request;
+            request->body = NULL;
+            snprintf(request->version, sizeof(request->version), "HTTP/2.0");
+            stream->request_complete = 1;
+            stream->runnable = 1;
+            session->last_stream_id = 1;
+        }
+    }
+
+    if (initial_len > sizeof(session->in)) initial_len = sizeof(session->in);
+    if (initial_len > 0) memcpy(session->in, initial, initial_len);
+    session->in_len = initial_len;
+
+    while (!session->goaway) {
+        if (process_input(session) < 0) break;
+        run_ready_streams(session);
+        if (flush_output(session) < 0 || session->goaway) break;
+
+        ssize_t n = conn_recv(conn, session->in + session->in_len, sizeof(session->in) - session->in_len);
+        if (n <= 0) break;
+        session->in_len += n;
+    }
+    flush_output(session);
+
+    while (session->streams) free_stream(session, session->streams);
+    hpack_table_free(&session->decoder);
+    hpack_table_free(&session->encoder);
+    buffer_free(&session->out);
+    free(session);
+}
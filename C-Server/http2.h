@@ -0,0 +1,115 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdint.h>
+#include "Http_server.h"
+#include "hpack.h"
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER_LEN 9
+#define H2_DEFAULT_WINDOW 65535
+#define H2_MAX_WINDOW 0x7fffffff
+#define H2_DEFAULT_FRAME_SIZE 16384
+#define H2_MAX_CONCURRENT_STREAMS 100
+#define H2_MAX_HEADER_BLOCK (64 * 1024)
+#define H2_MAX_REQUEST_BODY (8 * 1024 * 1024)
+#define H2_CONNECTION_WINDOW (1024 * 1024)  // Receive window we grant per connection
+#define H2_FLUSH_THRESHOLD (64 * 1024)
+#define H2_IDLE_TIMEOUT 60
+
+// Frame types (RFC 7540 section 6)
+#define H2_DATA 0x0
+#define H2_HEADERS 0x1
+#define H2_PRIORITY 0x2
+#define H2_RST_STREAM 0x3
+#define H2_SETTINGS 0x4
+#define H2_PUSH_PROMISE 0x5
+#define H2_PING 0x6
+#define H2_GOAWAY 0x7
+#define H2_WINDOW_UPDATE 0x8
+#define H2_CONTINUATION 0x9
+
+// Frame flags
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+// Settings identifiers
+#define H2_SETTINGS_HEADER_TABLE_SIZE 0x1
+#define H2_SETTINGS_ENABLE_PUSH 0x2
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE 0x5
+
+// Error codes
+#define H2_NO_ERROR 0x0
+#define H2_PROTOCOL_ERROR 0x1
+#define H2_INTERNAL_ERROR 0x2
+#define H2_FLOW_CONTROL_ERROR 0x3
+#define H2_STREAM_CLOSED 0x5
+#define H2_FRAME_SIZE_ERROR 0x6
+#define H2_REFUSED_STREAM 0x7
+#define H2_COMPRESSION_ERROR 0x9
+
+// Decoding state for a chunked response body
+typedef enum {
+    CHUNK_SIZE = 0,   // Hex digits of the chunk size
+    CHUNK_EXTENSION,  // Rest of the size line
+    CHUNK_DATA,
+    CHUNK_DATA_END,   // CRLF after the chunk data
+    CHUNK_DONE        // Last chunk seen; trailers are dropped
+} ChunkState;
+
+// One request/response exchange on a connection
+typedef struct H2Stream {
+    uint32_t id;
+    struct H2Session *session;
+    int request_complete;      // END_STREAM received
+    int runnable;              // Request complete, handler not run yet
+    int malformed;             // Request headers violated HTTP/2 rules
+    int closed;                // Reset while its handler was running
+    int64_t send_window;
+    HttpRequest *request;
+    ByteBuffer header_block;   // HEADERS + CONTINUATION fragments until END_HEADERS
+    ByteBuffer body;
+    ByteBuffer response_head;  // Handler output until the end of its HTTP/1.1 header
+    ByteBuffer response_body;  // Response bytes not yet framed, at most one DATA frame
+    int headers_sent;
+    int ended;                 // END_STREAM sent
+    int chunked;
+    ChunkState chunk_state;
+    size_t chunk_left;
+    struct H2Stream *next;
+} H2Stream;
+
+// Per-connection HTTP/2 state
+typedef struct H2Session {
+    Connection *conn;
+    const char *client_ip;
+    HpackTable decoder;
+    HpackTable encoder;
+    int64_t send_window;
+    uint32_t peer_initial_window;
+    uint32_t peer_max_frame;
+    uint32_t last_stream_id;
+    uint32_t continuation_stream;  // Stream expecting CONTINUATION, 0 if none
+    int stream_count;
+    H2Stream *streams;
+    int goaway;
+    int preface_seen;
+    H2Stream *active;              // Stream whose handler is running
+    ByteBuffer out;                // Frames queued for the next write
+    uint8_t in[H2_FRAME_HEADER_LEN + H2_DEFAULT_FRAME_SIZE];
+    size_t in_len;
+} H2Session;
+
+int http2_is_preface(const char *data, size_t len);
+int http2_wants_upgrade(HttpRequest *request);
+int http2_stream_send(H2Stream *stream, const void *data, size_t len);
+void http2_serve(Connection *conn, const char *initial, size_t initial_len,
+                 HttpRequest *upgrade_request, const char *client_ip);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/sendfile.h>
+
+#include "largefile.h"
+#include "tls.h"
+
+static unsigned long long rate_limit;  // Bytes per second per connection, 0 for unlimited
+static LargeFileStats largefile_stats;
+
+// Per-transfer pacing state
+typedef struct {
+    struct timespec start;
+    unsigned long long sent;
+} Pacer;
+
+/**
+ * Caps the rate of each large transfer; 0 only yields between windows
+ */
+void largefile_set_rate(unsigned long long bytes_per_sec) {
+    rate_limit = bytes_per_sec;
+}
+
+/**
+ * Picks the transfer method: plaintext sockets splice, kTLS sockets let the
+ * kernel encrypt from the page cache, and userspace TLS encrypts from a
+ * buffer the file is read into
+ */
+FileSendMethod largefile_method(Connection *conn, size_t count) {
+    if (conn->ssl) {
+        return tls_ktls_send(conn) ? SEND_SENDFILE : SEND_READ;
+    }
+    return count >= LARGE_FILE_MIN ? SEND_SPLICE : SEND_SENDFILE;
+}
+
+/**
+ * Ends a send window: sleeps until the transfer is back under the rate
+ * limit, or just yields so other connections get a turn at the CPU
+ */
+static void pace_window(Pacer *pacer, size_t window) {
+    __atomic_fetch_add(&largefile_stats.windows, 1, __ATOMIC_RELAXED);
+    pacer->sent += window;
+
+    if (rate_limit == 0) {
+        sched_yield();
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - pacer->start.tv_sec) + (now.tv_nsec - pacer->start.tv_nsec) / 1e9;
+    double due = (double)pacer->sent / rate_limit;
+    if (due > elapsed) {
+        double wait = due - elapsed;
+        struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+        __atomic_fetch_add(&largefile_stats.paced_sleeps, 1, __ATOMIC_RELAXED);
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+    } else {
+        sched_yield();
+    }
+}
+
+static int send_with_sendfile(Connection *conn, int file_fd, off_t offset, size_t count, Pacer *pacer) {
+    while (count > 0) {
+        size_t window = count < SEND_WINDOW_BYTES ? count : SEND_WINDOW_BYTES;
+        if (conn->ssl) {
+            if (tls_sendfile(conn, file_fd, offset, window) < 0) return -1;
+            offset += window;
+        } else {
+            size_t left = window;
+            while (left > 0) {
+                ssize_t sent = sendfile(conn->fd, file_fd, &offset, left);
+                if (sent < 0 && errno == EINTR) continue;
+                if (sent < 0 && errno == EAGAIN && conn_wait(conn, POLLOUT) == 0) continue;
+                if (sent <= 0) return -1;
+                left -= sent;
+            }
+        }
+        count -= window;
+        pace_window(pacer, window);
+    }
+    return 0;
+}
+
+/**
+ * Moves the file through a pipe sized to one window, so each window is a
+ * pair of page-reference moves with no copy into userspace. The next window
+ * is read ahead while the current one drains to the socket. Returns -2 when
+ * splice is unsupported before anything was sent, so the caller can fall back.
+ */
+static int send_with_splice(Connection *conn, int file_fd, off_t offset, size_t count, Pacer *pacer) {
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) return -2;
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, SEND_WINDOW_BYTES);
+
+    int result = 0;
+    while (count > 0 && result == 0) {
+        size_t window = count < SEND_WINDOW_BYTES ? count : SEND_WINDOW_BYTES;
+        if (count > window) {
+            posix_fadvise(file_fd, offset + window, SEND_WINDOW_BYTES, POSIX_FADV_WILLNEED);
+        }
+
+        size_t left = window;
+        while (left > 0 && result == 0) {
+            ssize_t in = splice(file_fd, &offset, pipe_fds[1], NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (in < 0 && errno == EINTR) continue;
+            if (in <= 0) {
+                int unsupported = in < 0 && (errno == EINVAL || errno == ENOSYS);
+                result = unsupported && pacer->sent == 0 && left == window ? -2 : -1;
+                break;
+            }
+            left -= in;
+
+            while (in > 0) {
+                ssize_t out = splice(pipe_fds[0], NULL, conn->fd, NULL, in,
+                                     SPLICE_F_MOVE | (left > 0 || count > window ? SPLICE_F_MORE : 0));
+                if (out < 0 && errno == EINTR) continue;
+                if (out < 0 && errno == EAGAIN && conn_wait(conn, POLLOUT) == 0) continue;
+                if (out <= 0) {
+                    result = -1;
+                    break;
+                }
+                in -= out;
+            }
+        }
+        if (result < 0) break;
+        count -= window;
+        pace_window(pacer, window);
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return result;
+}
+
+/**
+ * Reads the file into a buffer reused for the whole transfer and hands it
+ * to the userspace TLS encoder. Unlike a mapping, a read of a file
+ * truncated mid-transfer just comes up short, which ends the response.
+ */
+static int send_with_read(Connection *conn, int file_fd, off_t offset, size_t count, Pacer *pacer) {
+    char *buffer = malloc(LARGE_READ_BYTES);
+    if (!buffer) return -2;
+
+    int result = 0;
+    while (count > 0 && result == 0) {
+        size_t window = count < SEND_WINDOW_BYTES ? count : SEND_WINDOW_BYTES;
+        if (count > window) {
+            posix_fadvise(file_fd, offset + window, SEND_WINDOW_BYTES, POSIX_FADV_WILLNEED);
+        }
+
+        size_t left = window;
+        while (left > 0) {
+            ssize_t n = pread(file_fd, buffer, left < LARGE_READ_BYTES ? left : LARGE_READ_BYTES, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0 || tls_send(conn, buffer, n) < 0) {
+                result = -1;
+                break;
+            }
+            offset += n;
+            left -= n;
+        }
+        if (result < 0) break;
+        count -= window;
+        pace_window(pacer, window);
+    }
+
+    free(buffer);
+    return result;
+}
+
+/**
+ * Sends a large file range with the method suited to the connection,
+ * yielding (or sleeping for the rate limit) after every window so a
+ * multi-gigabyte download cannot monopolize the CPU
+ */
+int largefile_send(Connection *conn, int file_fd, off_t offset, size_t count) {
+    Pacer pacer = {{0, 0}, 0};
+    clock_gettime(CLOCK_MONOTONIC, &pacer.start);
+    posix_fadvise(file_fd, offset, count, POSIX_FADV_SEQUENTIAL);
+
+    FileSendMethod method = largefile_method(conn, count);
+    int result = -2;
+    if (method == SEND_SPLICE) {
+        result = send_with_splice(conn, file_fd, offset, count, &pacer);
+        if (result != -2) __atomic_fetch_add(&largefile_stats.splice, 1, __ATOMIC_RELAXED);
+    } else if (method == SEND_READ) {
+        result = send_with_read(conn, file_fd, offset, count, &pacer);
+        if (result != -2) __atomic_fetch_add(&largefile_stats.read, 1, __ATOMIC_RELAXED);
+    }
+
+    if (result == -2) {
+        __atomic_fetch_add(&largefile_stats.sendfile, 1, __ATOMIC_RELAXED);
+        result = send_with_sendfile(conn, file_fd, offset, count, &pacer);
+    }
+    return result;
+}
+
+/**
+ * Copies the current large-file counters
+ */
+void largefile_get_stats(LargeFileStats *stats) {
+    stats->sendfile = __atomic_load_n(&largefile_stats.sendfile, __ATOMIC_RELAXED);
+    stats->splice = __atomic_load_n(&largefile_stats.splice, __ATOMIC_RELAXED);
+    stats->read = __atomic_load_n(&largefile_stats.read, __ATOMIC_RELAXED);
+    stats->windows = __atomic_load_n(&largefile_stats.windows, __ATOMIC_RELAXED);
+    stats->paced_sleeps = __atomic_load_n(&largefile_stats.paced_sleeps, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,32 @@
+#ifndef LARGEFILE_H
+#define LARGEFILE_H
+
+#include <sys/types.h>
+#include "Http_server.h"
+
+#define LARGE_FILE_MIN (4 * 1024 * 1024)   // Transfers at least this big take the paced path
+#define SEND_WINDOW_BYTES (1024 * 1024)    // Bytes sent before a connection yields the CPU
+#define LARGE_READ_BYTES (256 * 1024)      // Read buffer for the userspace TLS path
+
+// How a large transfer is moved to the socket
+typedef enum {
+    SEND_SENDFILE = 0,  // sendfile(), or SSL_sendfile() on kTLS connections
+    SEND_SPLICE,        // file -> pipe -> socket with splice()
+    SEND_READ           // pread() into a buffer handed to the userspace TLS encoder
+} FileSendMethod;
+
+// Large-file transfer counters
+typedef struct {
+    unsigned long sendfile;
+    unsigned long splice;
+    unsigned long read;
+    unsigned long windows;       // Send windows completed
+    unsigned long paced_sleeps;  // Windows that waited for the rate limit
+} LargeFileStats;
+
+void largefile_set_rate(unsigned long long bytes_per_sec);
+FileSendMethod largefile_method(Connection *conn, size_t count);
+int largefile_send(Connection *conn, int file_fd, off_t offset, size_t count);
+void largefile_get_stats(LargeFileStats *stats);
+
+#endif
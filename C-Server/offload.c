@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "offload.h"
+#include "admin.h"
+#include "binlog.h"
+#include "body.h"
+
+// Finished jobs of one connection thread: a lock-free stack pushed by the
+// pool threads and drained by its owner once the eventfd fires
+typedef struct {
+    struct OffloadJob *head;
+    int event_fd;
+} Completions;
+
+// Job states: whichever of the pool thread (DONE) and the waiting
+// connection thread (ABANDONED) moves a job out of RUNNING owns it
+enum { JOB_RUNNING = 0, JOB_DONE, JOB_ABANDONED };
+
+// One blocking handler call, run on a pool thread with its response
+// captured for the connection thread to send. The job owns a copy of the
+// request and its spooled body, so it outlives a connection that gave up.
+typedef struct OffloadJob {
+    struct OffloadJob *next;      // Completion stack link
+    int state;
+    Connection conn;
+    ByteBuffer captured;
+    HttpRequest request;
+    BodyReader body_reader;
+    Spool body;
+    char client_ip[64];
+    uint64_t log_started_ns;
+    Completions *owner;
+} OffloadJob;
+
+// Jobs queued on one pool thread. Its owner and thieves both take the
+// oldest job, so requests are served in arrival order.
+typedef struct {
+    pthread_mutex_t lock;
+    OffloadJob *jobs[OFFLOAD_QUEUE_SIZE];
+    unsigned int top;             // Next job to run
+    unsigned int bottom;          // Next free slot
+} Deque;
+
+static Deque *deques;
+static int pool_threads = 0;
+static unsigned int next_deque;
+static int queued;                // Jobs reserved or waiting in the deques
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned long submitted_count;
+static unsigned long completed_count;
+static unsigned long stolen_count;
+static unsigned long inline_count;
+static unsigned long timeout_count;
+
+static pthread_key_t completions_key;
+static pthread_once_t completions_once = PTHREAD_ONCE_INIT;
+static __thread Completions *thread_completions = NULL;
+
+static void free_completions(void *arg) {
+    Completions *completions = arg;
+    close(completions->event_fd);
+    free(completions);
+}
+
+static void create_completions_key(void) {
+    pthread_key_create(&completions_key, free_completions);
+}
+
+/**
+ * Returns the calling thread's completion stack, created on first use and
+ * released when the thread exits
+ */
+static Completions *get_completions(void) {
+    if (thread_completions) return thread_completions;
+    pthread_once(&completions_once, create_completions_key);
+
+    Completions *completions = calloc(1, sizeof(Completions));
+    if (!completions) return NULL;
+    completions->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (completions->event_fd < 0) {
+        free(completions);
+        return NULL;
+    }
+    pthread_setspecific(completions_key, completions);
+    thread_completions = completions;
+    return completions;
+}
+
+/**
+ * Queues a job on the next pool thread's deque, or on any other with room.
+ * Returns -1 if every deque is full.
+ */
+static int submit(OffloadJob *job) {
+    __atomic_add_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+    unsigned int start = __atomic_fetch_add(&next_deque, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < pool_threads; i++) {
+        Deque *deque = &deques[(start + i) % pool_threads];
+        pthread_mutex_lock(&deque->lock);
+        if (deque->bottom - deque->top < OFFLOAD_QUEUE_SIZE) {
+            deque->jobs[deque->bottom++ % OFFLOAD_QUEUE_SIZE] = job;
+            pthread_mutex_unlock(&deque->lock);
+
+            pthread_mutex_lock(&idle_lock);
+            pthread_cond_signal(&idle_cond);
+            pthread_mutex_unlock(&idle_lock);
+            __atomic_add_fetch(&submitted_count, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        pthread_mutex_unlock(&deque->lock);
+    }
+    __atomic_sub_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+    return -1;
+}
+
+/**
+ * Takes the oldest job from the thread's own deque, or steals one from
+ * the others
+ */
+static OffloadJob *take(int index) {
+    for (int i = 0; i < pool_threads; i++) {
+        Deque *deque = &deques[(index + i) % pool_threads];
+        pthread_mutex_lock(&deque->lock);
+        if (deque->top != deque->bottom) {
+            OffloadJob *job = deque->jobs[deque->top++ % OFFLOAD_QUEUE_SIZE];
+            pthread_mutex_unlock(&deque->lock);
+            __atomic_sub_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+            if (i > 0) __atomic_add_fetch(&stolen_count, 1, __ATOMIC_RELAXED);
+            return job;
+        }
+        pthread_mutex_unlock(&deque->lock);
+    }
+    return NULL;
+}
+
+static void free_job(OffloadJob *job) {
+    buffer_free(&job->captured);
+    spool_free(&job->body);
+    free(job);
+}
+
+/**
+ * Runs the handler and hands the job back to its connection thread, or
+ * frees it if that thread stopped waiting
+ */
+static void run_job(OffloadJob *job) {
+    binlog_request_resume(job->log_started_ns);
+    job->request.route->handler(&job->conn, &job->request, job->client_ip);
+
+    int running = JOB_RUNNING;
+    if (!__atomic_compare_exchange_n(&job->state, &running, JOB_DONE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free_job(job);
+        __atomic_add_fetch(&completed_count, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    Completions *owner = job->owner;
+    OffloadJob *head = __atomic_load_n(&owner->head, __ATOMIC_RELAXED);
+    do {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&owner->head, &head, job, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&completed_count, 1, __ATOMIC_RELAXED);
+
+    // The owner cannot return (and close the eventfd) before this write
+    uint64_t one = 1;
+    while (write(owner->event_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+static void *pool_thread(void *arg) {
+    int index = (int)(intptr_t)arg;
+    while (1) {
+        OffloadJob *job = take(index);
+        if (job) {
+            run_job(job);
+            continue;
+        }
+        pthread_mutex_lock(&idle_lock);
+        while (__atomic_load_n(&queued, __ATOMIC_ACQUIRE) <= 0) {
+            pthread_cond_wait(&idle_cond, &idle_lock);
+        }
+        pthread_mutex_unlock(&idle_lock);
+    }
+    return NULL;
+}
+
+/**
+ * Starts the pool that runs routes flagged as blocking. With no threads
+ * those handlers run inline like any other.
+ */
+int offload_start(int threads) {
+    if (threads <= 0) return 0;
+    deques = calloc(threads, sizeof(Deque));
+    if (!deques) return -1;
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&deques[i].lock, NULL);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, NULL, pool_thread, (void *)(intptr_t)i) != 0) {
+            if (i == 0) return -1;
+            break;
+        }
+        pthread_detach(thread_id);
+        pool_threads = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * Waits up to OFFLOAD_TIMEOUT for the job on the completion eventfd.
+ * Returns 0 once the job is on the stack, -1 if the connection thread gave
+ * it up, in which case the pool thread frees it when the handler returns.
+ */
+static int wait_for_job(Completions *completions, OffloadJob *job) {
+    struct pollfd pfd = { completions->event_fd, POLLIN, 0 };
+    int timeout = OFFLOAD_TIMEOUT * 1000;
+    uint64_t count;
+    while (1) {
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready == 0) {
+            int running = JOB_RUNNING;
+            if (__atomic_compare_exchange_n(&job->state, &running, JOB_ABANDONED, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return -1;
+            }
+            // Finished just now: its eventfd write is on the way
+            timeout = -1;
+            continue;
+        }
+        while (read(completions->event_fd, &count, sizeof(count)) < 0 && errno == EINTR);
+        // A connection thread waits for one job at a time, so the stack
+        // holds this job once the eventfd fires. Reading first also
+        // guarantees the pool thread is done with the eventfd before this
+        // thread can exit.
+        if (__atomic_exchange_n(&completions->head, NULL, __ATOMIC_ACQUIRE)) return 0;
+    }
+}
+
+/**
+ * Runs the request's route handler. Blocking routes are handed to the
+ * pool while the connection thread sleeps on its eventfd, so a slow disk
+ * or upstream ties up a bounded set of pool threads; the captured response
+ * is then sent from the connection thread as usual. The request body is
+ * read on the connection thread first: pool threads never wait on a
+ * client, only on the work itself.
+ */
+void offload_run(Connection *conn, HttpRequest *request, const char *client_ip) {
+    Route *route = request->route;
+    if (!route->blocking || pool_threads == 0) {
+        route->handler(conn, request, client_ip);
+        return;
+    }
+
+    Completions *completions = get_completions();
+    OffloadJob *job = completions ? calloc(1, sizeof(OffloadJob)) : NULL;
+    if (!job) {
+        __atomic_add_fetch(&inline_count, 1, __ATOMIC_RELAXED);
+        route->handler(conn, request, client_ip);
+        return;
+    }
+
+    job->request = *request;
+    spool_init(&job->body);
+    body_buffer(&job->request, &job->body_reader, &job->body);
+    snprintf(job->client_ip, sizeof(job->client_ip), "%s", client_ip);
+    job->conn.fd = -1;
+    job->conn.capture = &job->captured;
+    job->conn.accepted_at = conn->accepted_at;
+    job->log_started_ns = binlog_request_time();
+    job->owner = completions;
+
+    if (submit(job) < 0) {
+        // Pool saturated: better late on this thread than refused
+        __atomic_add_fetch(&inline_count, 1, __ATOMIC_RELAXED);
+        route->handler(conn, &job->request, client_ip);
+        free_job(job);
+        return;
+    }
+
+    if (wait_for_job(completions, job) < 0) {
+        const char *body = "<h1>503 Service Unavailable</h1>";
+        __atomic_add_fetch(&timeout_count, 1, __ATOMIC_RELAXED);
+        send_response_header(conn, HTTP_SERVICE_UNAVAILABLE, "text/html", strlen(body));
+        conn_send(conn, body, strlen(body));
+        log_request(client_ip, request->method, request->path, HTTP_SERVICE_UNAVAILABLE);
+        return;
+    }
+
+    conn_send(conn, job->captured.data, job->captured.len);
+    admin_conn_sent(job->captured.len);
+    free_job(job);
+}
+
+void offload_get_stats(OffloadStats *stats) {
+    stats->threads = pool_threads;
+    stats->queued = __atomic_load_n(&queued, __ATOMIC_RELAXED);
+    if (stats->queued < 0) stats->queued = 0;
+    stats->submitted = __atomic_load_n(&submitted_count, __ATOMIC_RELAXED);
+    stats->completed = __atomic_load_n(&completed_count, __ATOMIC_RELAXED);
+    stats->stolen = __atomic_load_n(&stolen_count, __ATOMIC_RELAXED);
+    stats->inline_runs = __atomic_load_n(&inline_count, __ATOMIC_RELAXED);
+    stats->timed_out = __atomic_load_n(&timeout_count, __ATOMIC_RELAXED);
+}
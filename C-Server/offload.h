@@ -0,0 +1,26 @@
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include "Http_server.h"
+
+#define OFFLOAD_THREADS 4        // Default pool size (-O to change, 0 runs blocking routes inline)
+#define OFFLOAD_MAX_THREADS 64
+#define OFFLOAD_QUEUE_SIZE 256   // Jobs each pool thread's deque can hold
+#define OFFLOAD_TIMEOUT 30       // Seconds a connection waits for its job before answering 503
+
+// Offload pool counters
+typedef struct {
+    int threads;
+    int queued;                  // Jobs waiting in the deques right now
+    unsigned long submitted;
+    unsigned long completed;
+    unsigned long stolen;        // Jobs run by a thread other than the one they were queued on
+    unsigned long inline_runs;   // Blocking handlers run on the connection thread (pool off or full)
+    unsigned long timed_out;     // Jobs given up on after OFFLOAD_TIMEOUT
+} OffloadStats;
+
+int offload_start(int threads);
+void offload_run(Connection *conn, HttpRequest *request, const char *client_ip);
+void offload_get_stats(OffloadStats *stats);
+
+#endif
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+#include "outq.h"
+#include "tls.h"
+
+static OutqStats outq_stats;
+
+void outq_init(OutputQueue *queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+static void note_peak(size_t buffered) {
+    size_t peak = __atomic_load_n(&outq_stats.peak_buffered, __ATOMIC_RELAXED);
+    while (buffered > peak &&
+           !__atomic_compare_exchange_n(&outq_stats.peak_buffered, &peak, buffered, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void append_segment(OutputQueue *queue, OutSegment *segment) {
+    if (queue->tail) {
+        queue->tail->next = segment;
+    } else {
+        queue->head = segment;
+    }
+    queue->tail = segment;
+    queue->pending += segment->len;
+}
+
+static void pop_segment(OutputQueue *queue) {
+    OutSegment *segment = queue->head;
+    queue->head = segment->next;
+    if (!queue->head) queue->tail = NULL;
+    if (segment->file_fd >= 0) {
+        close(segment->file_fd);
+    } else {
+        queue->buffered -= segment->cap;
+    }
+    free(segment);
+}
+
+/**
+ * Marks the queue as failed and drops what is left, so a connection whose
+ * write failed never sends a response with a hole in it
+ */
+static int fail_queue(OutputQueue *queue) {
+    queue->failed = 1;
+    while (queue->head) pop_segment(queue);
+    queue->pending = 0;
+    return -1;
+}
+
+/**
+ * Accounts for n bytes accepted by the socket from the buffer segments at
+ * the head of the queue
+ */
+static void consume_buffers(OutputQueue *queue, size_t n) {
+    while (n > 0) {
+        OutSegment *segment = queue->head;
+        size_t taken = n < segment->len ? n : segment->len;
+        segment->pos += taken;
+        segment->len -= taken;
+        queue->pending -= taken;
+        n -= taken;
+        if (segment->len == 0) pop_segment(queue);
+    }
+}
+
+/**
+ * Writes queued segments: runs of buffers go out in one gathered sendmsg()
+ * and file ranges through sendfile(), each resuming where the socket last
+ * stopped accepting data. Without wait, returns as soon as the socket is
+ * full; with wait, blocks until the queue is empty or the send timeout hits.
+ * TLS segments are written whole, since OpenSSL must retry a record as is.
+ */
+int outq_flush(Connection *conn, int wait) {
+    OutputQueue *queue = conn->out;
+    if (!queue) return 0;
+    if (queue->failed) return -1;
+    if (!queue->head) return 0;
+    __atomic_fetch_add(&outq_stats.flushes, 1, __ATOMIC_RELAXED);
+
+    while (queue->head) {
+        OutSegment *segment = queue->head;
+
+        if (conn->ssl) {
+            int result = segment->file_fd >= 0
+                ? tls_sendfile(conn, segment->file_fd, segment->offset, segment->len)
+                : tls_send(conn, segment->data + segment->pos, segment->len);
+            if (result < 0) return fail_queue(queue);
+            queue->pending -= segment->len;
+            segment->len = 0;
+            pop_segment(queue);
+            continue;
+        }
+
+        ssize_t n;
+        size_t requested = segment->len;
+        if (segment->file_fd >= 0) {
+            n = sendfile(conn->fd, segment->file_fd, &segment->offset, segment->len);
+            if (n == 0) return fail_queue(queue);  // File shrank under us
+        } else {
+            struct iovec iov[OUTQ_MAX_IOV];
+            int count = 0;
+            requested = 0;
+            for (OutSegment *s = segment; s && s->file_fd < 0 && count < OUTQ_MAX_IOV; s = s->next) {
+                iov[count].iov_base = s->data + s->pos;
+                iov[count].iov_len = s->len;
+                requested += s->len;
+                count++;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return fail_queue(queue);
+            if (!wait) return 0;
+            __atomic_fetch_add(&outq_stats.waits, 1, __ATOMIC_RELAXED);
+            if (conn_wait(conn, POLLOUT) < 0) return fail_queue(queue);
+            continue;
+        }
+        if ((size_t)n < requested) {
+            __atomic_fetch_add(&outq_stats.partial_writes, 1, __ATOMIC_RELAXED);
+        }
+
+        if (segment->file_fd >= 0) {
+            segment->len -= n;
+            queue->pending -= n;
+            if (segment->len == 0) pop_segment(queue);
+        } else {
+            consume_buffers(queue, n);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Queues a copy of data. Small writes are coalesced into the tail segment;
+ * when the copied bytes would pass OUTQ_MAX_BYTES the sender first waits
+ * for the socket to drain, and a single write larger than the cap is sent
+ * straight from the caller's buffer once the queue is empty.
+ */
+int outq_push(Connection *conn, const void *data, size_t len) {
+    OutputQueue *queue = conn->out;
+    if (queue->failed) return -1;
+    if (len == 0) return 0;
+
+    OutSegment *tail = queue->tail;
+    if (tail && tail->file_fd < 0 && tail->cap - tail->pos - tail->len >= len) {
+        memcpy(tail->data + tail->pos + tail->len, data, len);
+        tail->len += len;
+        queue->pending += len;
+    } else {
+        size_t cap = len > OUTQ_SEGMENT_SIZE ? len : OUTQ_SEGMENT_SIZE;
+        if (queue->buffered + cap > OUTQ_MAX_BYTES) {
+            if (outq_flush(conn, 0) < 0) return -1;
+            if (queue->buffered + cap > OUTQ_MAX_BYTES) {
+                __atomic_fetch_add(&outq_stats.cap_stalls, 1, __ATOMIC_RELAXED);
+                if (outq_flush(conn, 1) < 0) return -1;
+            }
+        }
+        if (cap > OUTQ_MAX_BYTES) {
+            if (conn_write(conn, data, len) < 0) return fail_queue(queue);
+            return 0;
+        }
+
+        OutSegment *segment = malloc(sizeof(OutSegment) + cap);
+        if (!segment) return fail_queue(queue);
+        segment->next = NULL;
+        segment->file_fd = -1;
+        segment->offset = 0;
+        segment->pos = 0;
+        segment->len = len;
+        segment->cap = cap;
+        memcpy(segment->data, data, len);
+        append_segment(queue, segment);
+        queue->buffered += cap;
+        note_peak(queue->buffered);
+    }
+
+    return queue->pending >= OUTQ_FLUSH_BYTES ? outq_flush(conn, 0) : 0;
+}
+
+/**
+ * Sends a scatter list behind the queued buffers in a single sendmsg(), so
+ * a response header and its body leave in one write without being copied
+ * together first. Whatever the socket does not take is queued as a copy.
+ * TLS connections, queues holding file ranges and lists too long to gather
+ * are queued piece by piece instead.
+ */
+int outq_pushv(Connection *conn, const struct iovec *iov, int count) {
+    OutputQueue *queue = conn->out;
+    if (queue->failed) return -1;
+
+    struct iovec gathered[OUTQ_PUSHV_IOV];
+    int queued = 0;
+    size_t queued_bytes = 0;
+    int usable = !conn->ssl;
+    for (OutSegment *s = queue->head; usable && s; s = s->next) {
+        if (s->file_fd >= 0 || queued == OUTQ_PUSHV_IOV) {
+            usable = 0;
+            break;
+        }
+        gathered[queued].iov_base = s->data + s->pos;
+        gathered[queued++].iov_len = s->len;
+        queued_bytes += s->len;
+    }
+    if (!usable || queued + count > OUTQ_PUSHV_IOV) {
+        for (int i = 0; i < count; i++) {
+            if (outq_push(conn, iov[i].iov_base, iov[i].iov_len) < 0) return -1;
+        }
+        return 0;
+    }
+    memcpy(gathered + queued, iov, sizeof(struct iovec) * count);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = gathered;
+    msg.msg_iovlen = queued + count;
+    ssize_t n;
+    do {
+        n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return fail_queue(queue);
+        n = 0;
+    }
+    __atomic_fetch_add(&outq_stats.flushes, 1, __ATOMIC_RELAXED);
+
+    size_t sent = (size_t)n;
+    size_t from_queue = sent < queued_bytes ? sent : queued_bytes;
+    consume_buffers(queue, from_queue);
+    sent -= from_queue;
+
+    // Queue the rest of the caller's pieces, starting mid-piece if the
+    // socket filled up inside one
+    int partial = 0;
+    for (int i = 0; i < count; i++) {
+        const char *data = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        if (sent >= len) {
+            sent -= len;
+            continue;
+        }
+        partial = 1;
+        if (outq_push(conn, data + sent, len - sent) < 0) return -1;
+        sent = 0;
+    }
+    if (partial && n > 0) __atomic_fetch_add(&outq_stats.partial_writes, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Queues a file range. The descriptor is duplicated because the caller's
+ * (often a shared path-cache entry) may be closed before the range is sent.
+ */
+int outq_push_file(Connection *conn, int file_fd, off_t offset, size_t count) {
+    OutputQueue *queue = conn->out;
+    if (queue->failed) return -1;
+    if (count == 0) return 0;
+
+    OutSegment *segment = malloc(sizeof(OutSegment));
+    if (!segment) return fail_queue(queue);
+    segment->file_fd = fcntl(file_fd, F_DUPFD_CLOEXEC, 0);
+    if (segment->file_fd < 0) {
+        free(segment);
+        return fail_queue(queue);
+    }
+    segment->next = NULL;
+    segment->offset = offset;
+    segment->pos = 0;
+    segment->len = count;
+    segment->cap = 0;
+    append_segment(queue, segment);
+
+    return queue->pending >= OUTQ_FLUSH_BYTES ? outq_flush(conn, 0) : 0;
+}
+
+/**
+ * Frees whatever is still queued, closing file segments
+ */
+void outq_discard(OutputQueue *queue) {
+    while (queue->head) pop_segment(queue);
+    queue->pending = 0;
+}
+
+/**
+ * Copies the current output queue counters
+ */
+void outq_get_stats(OutqStats *stats) {
+    stats->flushes = __atomic_load_n(&outq_stats.flushes, __ATOMIC_RELAXED);
+    stats->partial_writes = __atomic_load_n(&outq_stats.partial_writes, __ATOMIC_RELAXED);
+    stats->waits = __atomic_load_n(&outq_stats.waits, __ATOMIC_RELAXED);
+    stats->cap_stalls = __atomic_load_n(&outq_stats.cap_stalls, __ATOMIC_RELAXED);
+    stats->peak_buffered = __atomic_load_n(&outq_stats.peak_buffered, __ATOMIC_RELAXED);
+}
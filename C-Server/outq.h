@@ -0,0 +1,50 @@
+#ifndef OUTQ_H
+#define OUTQ_H
+
+#include <sys/types.h>
+#include "Http_server.h"
+
+#define OUTQ_MAX_BYTES (256 * 1024)   // Copied bytes a connection may hold before the sender waits
+#define OUTQ_FLUSH_BYTES (16 * 1024)  // Queued bytes that trigger an opportunistic flush
+#define OUTQ_SEGMENT_SIZE 4096        // Minimum buffer segment, so small writes coalesce
+#define OUTQ_MAX_IOV 64
+#define OUTQ_PUSHV_IOV 256            // Queued buffers plus caller pieces in one outq_pushv() write
+
+// Pending piece of a response: copied bytes or a range of an open file
+typedef struct OutSegment {
+    struct OutSegment *next;
+    int file_fd;         // -1 for buffer segments
+    off_t offset;        // Next file byte to send
+    size_t len;          // Bytes not yet sent
+    size_t pos;          // Buffer bytes already sent
+    size_t cap;
+    char data[];
+} OutSegment;
+
+// Per-connection output queue
+typedef struct OutputQueue {
+    OutSegment *head;
+    OutSegment *tail;
+    size_t buffered;     // Copied bytes held in buffer segments
+    size_t pending;      // All bytes not yet sent, file ranges included
+    int failed;          // Set once a write fails; later output is dropped
+} OutputQueue;
+
+// Output queue counters
+typedef struct {
+    unsigned long flushes;
+    unsigned long partial_writes;  // Writes the socket only partly accepted
+    unsigned long waits;           // Times a sender waited for the socket to drain
+    unsigned long cap_stalls;      // Waits forced by the memory cap
+    size_t peak_buffered;
+} OutqStats;
+
+void outq_init(OutputQueue *queue);
+int outq_push(Connection *conn, const void *data, size_t len);
+int outq_pushv(Connection *conn, const struct iovec *iov, int count);
+int outq_push_file(Connection *conn, int file_fd, off_t offset, size_t count);
+int outq_flush(Connection *conn, int wait);
+void outq_discard(OutputQueue *queue);
+void outq_get_stats(OutqStats *stats);
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/mempolicy.h>
+
+#include "placement.h"
+#include "Http_server.h"
+
+int placement_active = 0;
+
+// Nodes that have CPUs, in ascending order, and the CPUs of each
+static int node_count = 0;
+static int node_ids[PLACEMENT_MAX_NODES];
+static cpu_set_t node_cpus[PLACEMENT_MAX_NODES];
+
+// System-wide numastat counters when the server started
+static unsigned long other_node_base[PLACEMENT_MAX_NODES];
+static unsigned long foreign_base[PLACEMENT_MAX_NODES];
+
+/**
+ * Parses a sysfs CPU list such as "0-3,8-11" into set. Returns the number
+ * of CPUs added.
+ */
+static int parse_cpulist(const char *list, cpu_set_t *set) {
+    int added = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+            added++;
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*p == '\n') break;
+    }
+    return added;
+}
+
+/**
+ * Reads one node's numa_foreign and other_node counters: pages that
+ * should have come from the node but did not, and pages it gave to tasks
+ * running on another node
+ */
+static void read_numastat(int node, unsigned long *other_node, unsigned long *foreign) {
+    char path[128], line[128];
+    snprintf(path, sizeof(path), "%s/node%d/numastat", PLACEMENT_NODE_DIR, node);
+    *other_node = *foreign = 0;
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+    while (fgets(line, sizeof(line), fp)) {
+        sscanf(line, "other_node %lu", other_node);
+        sscanf(line, "numa_foreign %lu", foreign);
+    }
+    fclose(fp);
+}
+
+/**
+ * Reads the node topology from sysfs and turns on NUMA placement. A
+ * system without it counts as one node holding every CPU the process may
+ * use. Returns the number of nodes.
+ */
+int placement_init(void) {
+    node_count = 0;
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        char path[128], list[1024];
+        snprintf(path, sizeof(path), "%s/node%d/cpulist", PLACEMENT_NODE_DIR, node);
+        FILE *fp = fopen(path, "r");
+        if (!fp) continue;
+        int read = fgets(list, sizeof(list), fp) != NULL;
+        fclose(fp);
+
+        // Memory-only nodes get no workers
+        CPU_ZERO(&node_cpus[node_count]);
+        if (!read || parse_cpulist(list, &node_cpus[node_count]) == 0) continue;
+        node_ids[node_count] = node;
+        read_numastat(node, &other_node_base[node_count], &foreign_base[node_count]);
+        node_count++;
+    }
+    if (node_count == 0) {
+        node_ids[0] = 0;
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &node_cpus[0]) < 0) CPU_ZERO(&node_cpus[0]);
+        node_count = 1;
+    }
+    placement_active = 1;
+    return node_count;
+}
+
+/**
+ * Index into the node table of the node a worker runs on. Workers are
+ * dealt out in contiguous blocks, so neighbouring slots share a node.
+ */
+int placement_node_of_worker(int worker, int workers) {
+    if (!placement_active || workers <= 0) return 0;
+    return (int)((long)worker * node_count / workers);
+}
+
+/**
+ * Pins the calling worker process to its node's CPUs and makes the node
+ * its preferred memory, before it creates its listener, threads, buffers
+ * and caches: everything allocated from here on is node-local. Preferred
+ * rather than strict binding lets an exhausted node spill to the others
+ * instead of invoking the OOM killer. Returns -1 if either call failed.
+ */
+int placement_bind(int worker, int workers) {
+    if (!placement_active) return 0;
+    int index = placement_node_of_worker(worker, workers);
+    __atomic_store_n(&stats_slot->numa_node, index, __ATOMIC_RELAXED);
+
+    int result = 0;
+    if (CPU_COUNT(&node_cpus[index]) > 0 && sched_setaffinity(0, sizeof(cpu_set_t), &node_cpus[index]) < 0) {
+        result = -1;
+    }
+    unsigned long mask = 1UL << node_ids[index];
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) < 0) {
+        result = -1;
+    }
+    return result;
+}
+
+/**
+ * Returns the node table index of a CPU, or -1 if it is on none
+ */
+static int node_of_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+    for (int i = 0; i < node_count; i++) {
+        if (CPU_ISSET(cpu, &node_cpus[i])) return i;
+    }
+    return -1;
+}
+
+/**
+ * Attaches a classic BPF program to a reuseport group whose listeners
+ * were bound in worker order, so a socket's index in the group is its
+ * worker. The program loads the CPU that received the packet and returns
+ * a worker on that CPU's node, spreading a node's CPUs over its workers.
+ * CPUs on no node return an out-of-range index, for which the kernel
+ * falls back to its hash. Returns -1 if the program could not be attached.
+ */
+int placement_steer(int listen_fd, int workers) {
+    if (!placement_active || workers <= 0) return 0;
+
+    struct sock_filter *code = malloc((2 * CPU_SETSIZE + 2) * sizeof(struct sock_filter));
+    if (!code) return -1;
+    int len = 0;
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int index = 0; index < node_count; index++) {
+        int first = -1, count = 0;
+        for (int w = 0; w < workers; w++) {
+            if (placement_node_of_worker(w, workers) != index) continue;
+            if (first < 0) first = w;
+            count++;
+        }
+        if (count == 0) continue;
+
+        int rank = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &node_cpus[index])) continue;
+            code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpu, 0, 1);
+            code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, first + rank++ % count);
+        }
+    }
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+    struct sock_fprog program = { (unsigned short)len, code };
+    int result = len <= BPF_MAXINSNS ?
+        setsockopt(listen_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) : -1;
+    free(code);
+    return result < 0 ? -1 : 0;
+}
+
+/**
+ * Counts an accepted connection as local or remote by the node of the CPU
+ * that processed its packets
+ */
+void placement_note_accept(int fd) {
+    if (!placement_active) return;
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0) return;
+    int node = node_of_cpu(cpu);
+    if (node < 0) return;
+    if (node == __atomic_load_n(&stats_slot->numa_node, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&stats_slot->local_accepts, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&stats_slot->remote_accepts, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Summarizes placement per node: its workers, accepts of connections
+ * whose packets were processed on the node or elsewhere, and the pages it
+ * served to other nodes or failed to supply since the server started
+ * (system-wide counters)
+ */
+void placement_describe(char *out, size_t out_len) {
+    if (!placement_active) {
+        snprintf(out, out_len, "off");
+        return;
+    }
+
+    int used = snprintf(out, out_len, "%d node%s", node_count, node_count == 1 ? "" : "s");
+    for (int i = 0; i < node_count && used > 0 && (size_t)used < out_len; i++) {
+        unsigned long local = 0, remote = 0;
+        int workers = 0;
+        for (int w = 0; w < server_stats->process_count; w++) {
+            StatsSlot *slot = &server_stats->slots[w];
+            if (placement_node_of_worker(w, server_stats->process_count) != i) continue;
+            workers++;
+            local += __atomic_load_n(&slot->local_accepts, __ATOMIC_RELAXED);
+            remote += __atomic_load_n(&slot->remote_accepts, __ATOMIC_RELAXED);
+        }
+        unsigned long other_node, foreign;
+        read_numastat(node_ids[i], &other_node, &foreign);
+        used += snprintf(out + used, out_len - used,
+                         "%s node %d: %d worker%s, %lu local / %lu remote accepts, %lu pages to other nodes, %lu spilled",
+                         i == 0 ? ";" : ",", node_ids[i], workers, workers == 1 ? "" : "s", local, remote,
+                         other_node - other_node_base[i], foreign - foreign_base[i]);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stddef.h>
+
+#define PLACEMENT_MAX_NODES 64                   // Nodes tracked (one word of node mask)
+#define PLACEMENT_NODE_DIR "/sys/devices/system/node"
+
+extern int placement_active;
+
+int placement_init(void);
+int placement_node_of_worker(int worker, int workers);
+int placement_bind(int worker, int workers);
+int placement_steer(int listen_fd, int workers);
+void placement_note_accept(int fd);
+void placement_describe(char *out, size_t out_len);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#include "prefork.h"
+
+ServerStats *server_stats = NULL;
+StatsSlot *stats_slot = NULL;
+
+static volatile sig_atomic_t master_stopping = 0;
+
+/**
+ * Maps the statistics shared by every server process. Must run before any
+ * worker is forked; the calling process starts out owning slot 0.
+ */
+int stats_init(int processes) {
+    if (processes < 1 || processes > MAX_WORKERS) return -1;
+    void *map = mmap(NULL, sizeof(ServerStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) return -1;
+
+    server_stats = map;
+    memset(server_stats, 0, sizeof(ServerStats));
+    server_stats->start_time = time(NULL);
+    server_stats->process_count = processes;
+    stats_slot = &server_stats->slots[0];
+    stats_slot->pid = getpid();
+    return 0;
+}
+
+/**
+ * Sums the counters of every process, including workers that were
+ * restarted (a respawned worker keeps its slot)
+ */
+void stats_totals(unsigned long *requests, unsigned long *bytes) {
+    *requests = 0;
+    *bytes = 0;
+    for (int i = 0; i < server_stats->process_count; i++) {
+        *requests += __atomic_load_n(&server_stats->slots[i].request_count, __ATOMIC_RELAXED);
+        *bytes += __atomic_load_n(&server_stats->slots[i].bytes_sent, __ATOMIC_RELAXED);
+    }
+}
+
+static void handle_master_signal(int sig) {
+    (void)sig;
+    master_stopping = 1;
+}
+
+/**
+ * Forks the worker for a slot. Returns 0 in the worker, the pid in the
+ * master, or -1 if fork failed.
+ */
+static pid_t spawn_worker(int index) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) __atomic_store_n(&server_stats->slots[index].pid, pid, __ATOMIC_RELAXED);
+        return pid;
+    }
+
+    // Workers go down with the master
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() == 1) _exit(0);
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    stats_slot = &server_stats->slots[index];
+    __atomic_store_n(&stats_slot->pid, getpid(), __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Stops every worker and exits the master
+ */
+static void stop_workers(int workers) {
+    for (int i = 0; i < workers; i++) {
+        int pid = __atomic_load_n(&server_stats->slots[i].pid, __ATOMIC_RELAXED);
+        if (pid > 0) kill(pid, SIGTERM);
+    }
+    while (wait(NULL) > 0 || errno == EINTR);
+    printf("\nShutting down server...\n");
+    exit(0);
+}
+
+/**
+ * Forks the workers and turns the calling process into their master,
+ * which restarts any worker that crashes. Returns only in a worker, with
+ * its index (0 .. workers - 1).
+ */
+int prefork_start(int workers) {
+    long long started_ms[MAX_WORKERS];
+    struct timespec ts;
+
+    // Buffered output would otherwise be written once per process
+    fflush(NULL);
+
+    for (int i = 0; i < workers; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        started_ms[i] = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        pid_t pid = spawn_worker(i);
+        if (pid == 0) return i;
+        if (pid < 0) {
+            perror("Fork failed");
+            stop_workers(i);
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_master_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    printf("Master %d supervising %d workers\n", (int)getpid(), workers);
+    fflush(stdout);
+
+    while (1) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (master_stopping) stop_workers(workers);
+        if (pid < 0) {
+            if (errno != EINTR) sleep(1);
+            continue;
+        }
+
+        int index = -1;
+        for (int i = 0; i < workers; i++) {
+            if (__atomic_load_n(&server_stats->slots[i].pid, __ATOMIC_RELAXED) == pid) index = i;
+        }
+        if (index < 0) continue;
+        __atomic_store_n(&server_stats->slots[index].pid, 0, __ATOMIC_RELAXED);
+
+        // A worker that exited cleanly was asked to stop
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+
+        char message[128];
+        if (WIFSIGNALED(status)) {
+            snprintf(message, sizeof(message), "Worker %d (pid %d) killed by signal %d, restarting",
+                     index, (int)pid, WTERMSIG(status));
+        } else {
+            snprintf(message, sizeof(message), "Worker %d (pid %d) exited with status %d, restarting",
+                     index, (int)pid, WEXITSTATUS(status));
+        }
+        log_error(message);
+        fprintf(stderr, "%s\n", message);
+
+        // Do not spin on a worker that dies as soon as it starts
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        long long now = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        if (now - started_ms[index] < RESPAWN_BACKOFF_MS) {
+            struct timespec pause = { RESPAWN_BACKOFF_MS / 1000, (RESPAWN_BACKOFF_MS % 1000) * 1000000L };
+            nanosleep(&pause, NULL);
+            if (master_stopping) stop_workers(workers);
+        }
+
+        started_ms[index] = now;
+        __atomic_add_fetch(&server_stats->slots[index].respawns, 1, __ATOMIC_RELAXED);
+        fflush(NULL);
+        pid = spawn_worker(index);
+        if (pid == 0) return index;
+        if (pid < 0) perror("Fork failed");
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#include "Http_server.h"
+
+#define RESPAWN_BACKOFF_MS 1000  // Delay before restarting a worker that died right after starting
+
+int stats_init(int processes);
+void stats_totals(unsigned long *requests, unsigned long *bytes);
+int prefork_start(int workers);
+
+#endif
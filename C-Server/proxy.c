@@ -0,0 +1,654 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "proxy.h"
+
+// Configured upstream groups, one per proxy route
+static UpstreamGroup upstream_groups[MAX_PROXY_ROUTES];
+static int upstream_group_count = 0;
+
+// Buffered reader used to relay a byte stream while parsing its framing
+typedef struct {
+    Connection *conn;
+    char buf[PROXY_HEAD_SIZE];
+    size_t pos;
+    size_t len;
+} StreamReader;
+
+/**
+ * Refills the reader buffer once everything buffered has been consumed
+ */
+static ssize_t reader_fill(StreamReader *reader) {
+    if (reader->pos < reader->len) return reader->len - reader->pos;
+
+    ssize_t n = conn_recv(reader->conn, reader->buf, sizeof(reader->buf));
+    if (n <= 0) return n;
+
+    reader->pos = 0;
+    reader->len = n;
+    return n;
+}
+
+/**
+ * Reads one CRLF-terminated line (used for chunk-size and trailer lines)
+ */
+static int reader_read_line(StreamReader *reader, char *line, size_t max_len) {
+    size_t used = 0;
+    while (1) {
+        if (reader_fill(reader) <= 0) return -1;
+        char c = reader->buf[reader->pos++];
+        if (used + 1 < max_len) line[used++] = c;
+        if (c == '\n') break;
+    }
+    line[used] = '\0';
+    return (int)used;
+}
+
+/**
+ * Copies exactly length bytes from the reader to dst
+ */
+static int relay_bytes(StreamReader *reader, Connection *dst, size_t length, unsigned long *relayed) {
+    while (length > 0) {
+        if (reader_fill(reader) <= 0) return -1;
+        size_t chunk = reader->len - reader->pos;
+        if (chunk > length) chunk = length;
+        if (conn_send(dst, reader->buf + reader->pos, chunk) < 0) return -1;
+        reader->pos += chunk;
+        length -= chunk;
+        if (relayed) *relayed += chunk;
+    }
+    return 0;
+}
+
+/**
+ * Copies a chunked body verbatim, tracking chunk boundaries to find its end
+ */
+static int relay_chunked(StreamReader *reader, Connection *dst, unsigned long *relayed) {
+    char line[256];
+    while (1) {
+        int line_len = reader_read_line(reader, line, sizeof(line));
+        if (line_len <= 0) return -1;
+        if (conn_send(dst, line, line_len) < 0) return -1;
+        if (relayed) *relayed += line_len;
+
+        size_t chunk_size = strtoul(line, NULL, 16);
+        if (chunk_size == 0) break;
+
+        // Chunk data followed by its CRLF
+        if (relay_bytes(reader, dst, chunk_size + 2, relayed) < 0) return -1;
+    }
+
+    // Trailer section, terminated by an empty line
+    while (1) {
+        int line_len = reader_read_line(reader, line, sizeof(line));
+        if (line_len <= 0) return -1;
+        if (conn_send(dst, line, line_len) < 0) return -1;
+        if (relayed) *relayed += line_len;
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) break;
+    }
+    return 0;
+}
+
+/**
+ * Copies everything until the peer closes the connection
+ */
+static void relay_until_eof(StreamReader *reader, Connection *dst, unsigned long *relayed) {
+    while (reader_fill(reader) > 0) {
+        size_t chunk = reader->len - reader->pos;
+        if (conn_send(dst, reader->buf + reader->pos, chunk) < 0) return;
+        reader->pos += chunk;
+        if (relayed) *relayed += chunk;
+    }
+}
+
+/**
+ * Opens a new connection to an upstream with I/O timeouts applied
+ */
+static int upstream_connect(Upstream *upstream, int timeout_sec) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct timeval tv = { timeout_sec, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd, (struct sockaddr*)&upstream->addr, sizeof(upstream->addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Picks an upstream according to the group's balancing mode (group mutex held)
+ */
+static Upstream* pick_upstream(UpstreamGroup *group) {
+    int any_healthy = 0;
+    for (int i = 0; i < group->server_count; i++) {
+        if (group->servers[i].healthy) any_healthy = 1;
+    }
+
+    Upstream *best = NULL;
+    unsigned int start = group->next++;
+    for (int i = 0; i < group->server_count; i++) {
+        Upstream *candidate = &group->servers[(start + i) % group->server_count];
+        // With every upstream marked down, fail open and try them anyway
+        if (any_healthy && !candidate->healthy) continue;
+
+        if (group->balance == BALANCE_ROUND_ROBIN) {
+            best = candidate;
+            break;
+        }
+        if (!best || candidate->active < best->active) {
+            best = candidate;
+        }
+    }
+
+    if (best) best->active++;
+    return best;
+}
+
+/**
+ * Takes a live idle connection from the pool or opens a new one
+ */
+static int acquire_connection(UpstreamGroup *group, Upstream *upstream, int *reused) {
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&group->mutex);
+    while (upstream->idle_count > 0) {
+        IdleConnection idle = upstream->idle[--upstream->idle_count];
+        pthread_mutex_unlock(&group->mutex);
+
+        // Any readable event on an idle connection means EOF or junk: drop it
+        struct pollfd pfd = { idle.fd, POLLIN, 0 };
+        if (now - idle.last_used < UPSTREAM_IDLE_TIMEOUT && poll(&pfd, 1, 0) == 0) {
+            *reused = 1;
+            return idle.fd;
+        }
+        close(idle.fd);
+
+        pthread_mutex_lock(&group->mutex);
+    }
+    pthread_mutex_unlock(&group->mutex);
+
+    *reused = 0;
+    int fd = upstream_connect(upstream, UPSTREAM_IO_TIMEOUT);
+    if (fd < 0) {
+        pthread_mutex_lock(&group->mutex);
+        upstream->failures++;
+        upstream->healthy = 0;
+        pthread_mutex_unlock(&group->mutex);
+    }
+    return fd;
+}
+
+/**
+ * Returns a connection to the pool (or closes it) and ends the in-flight request
+ */
+static void release_connection(UpstreamGroup *group, Upstream *upstream, int fd, int reusable) {
+    pthread_mutex_lock(&group->mutex);
+    upstream->active--;
+    if (fd >= 0 && reusable && upstream->idle_count < UPSTREAM_POOL_SIZE) {
+        upstream->idle[upstream->idle_count].fd = fd;
+        upstream->idle[upstream->idle_count].last_used = time(NULL);
+        upstream->idle_count++;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&group->mutex);
+
+    if (fd >= 0) close(fd);
+}
+
+/**
+ * Returns non-zero for hop-by-hop headers that must not be forwarded
+ */
+static int is_hop_by_hop(const char *name) {
+    return strcasecmp(name, "Connection") == 0 ||
+           strcasecmp(name, "Keep-Alive") == 0 ||
+           strcasecmp(name, "Proxy-Connection") == 0 ||
+           strcasecmp(name, "TE") == 0 ||
+           strcasecmp(name, "Upgrade") == 0;
+}
+
+/**
+ * Returns non-zero for methods that may be sent twice with the same effect
+ */
+static int is_idempotent(const char *method) {
+    return strcmp(method, "GET") == 0 ||
+           strcmp(method, "HEAD") == 0 ||
+           strcmp(method, "OPTIONS") == 0 ||
+           strcmp(method, "PUT") == 0 ||
+           strcmp(method, "DELETE") == 0;
+}
+
+/**
+ * Builds the request head sent upstream, with the route prefix stripped
+ */
+static int build_upstream_request(char *out, size_t max_len, HttpRequest *request,
+                                  UpstreamGroup *group, Upstream *upstream, const char *client_ip) {
+    size_t prefix_len = strlen(group->prefix);
+    const char *rest = request->path;
+    if (strncmp(rest, group->prefix, prefix_len) == 0) {
+        rest += prefix_len;
+    } else {
+        // Path is the prefix without its trailing slash: keep only the query
+        const char *query = strchr(rest, '?');
+        rest = query ? query : rest + strlen(rest);
+    }
+
+    int len = snprintf(out, max_len, "%s /%s HTTP/1.1\r\n", request->method,
+                       *rest == '/' ? rest + 1 : rest);
+
+    const char *forwarded_for = NULL;
+    int has_host = 0;
+    for (int i = 0; i < request->header_count && len < (int)max_len; i++) {
+        HttpHeader *header = &request->headers[i];
+        if (is_hop_by_hop(header->name)) continue;
+        if (strcasecmp(header->name, "X-Forwarded-For") == 0) {
+            forwarded_for = header->value;
+            continue;
+        }
+        if (strcasecmp(header->name, "Host") == 0) has_host = 1;
+        len += snprintf(out + len, max_len - len, "%s: %s\r\n", header->name, header->value);
+    }
+
+    if (len < (int)max_len && !has_host) {
+        len += snprintf(out + len, max_len - len, "Host: %s:%d\r\n", upstream->host, upstream->port);
+    }
+    if (len < (int)max_len) {
+        len += snprintf(out + len, max_len - len,
+                        "X-Forwarded-For: %s%s%s\r\n"
+                        "Connection: keep-alive\r\n"
+                        "\r\n",
+                        forwarded_for ? forwarded_for : "", forwarded_for ? ", " : "", client_ip);
+    }
+
+    return len < (int)max_len ? len : -1;
+}
+
+/**
+ * Streams the client request body upstream without buffering it
+ */
+static int forward_request_body(Connection *client, Connection *upstream_conn, HttpRequest *request) {
+    const char *transfer_encoding = get_header_value(request, "Transfer-Encoding");
+    const char *content_length = get_header_value(request, "Content-Length");
+
+    StreamReader *reader = malloc(sizeof(StreamReader));
+    if (!reader) return -1;
+    reader->conn = client;
+    reader->pos = 0;
+    reader->len = request->body_length < sizeof(reader->buf) ? request->body_length : sizeof(reader->buf);
+    if (reader->len > 0) memcpy(reader->buf, request->body, reader->len);
+
+    int result = 0;
+    if (transfer_encoding && strcasecmp(transfer_encoding, "chunked") == 0) {
+        result = relay_chunked(reader, upstream_conn, NULL);
+    } else if (content_length) {
+        result = relay_bytes(reader, upstream_conn, strtoull(content_length, NULL, 10), NULL);
+    }
+
+    free(reader);
+    return result;
+}
+
+/**
+ * Returns non-zero if the request body has to be read from the client socket
+ */
+static int has_streamed_body(HttpRequest *request) {
+    const char *transfer_encoding = get_header_value(request, "Transfer-Encoding");
+    const char *content_length = get_header_value(request, "Content-Length");
+    if (transfer_encoding && strcasecmp(transfer_encoding, "chunked") == 0) return 1;
+    return content_length && strtoull(content_length, NULL, 10) > request->body_length;
+}
+
+/**
+ * Reads the upstream response head into the reader buffer, skipping 1xx responses.
+ * Returns the head length, or -1 with errno ECONNRESET if the upstream closed
+ * the connection and EAGAIN if it timed out.
+ */
+static int read_response_head(StreamReader *reader) {
+    while (1) {
+        char *end;
+        while (!(end = memmem(reader->buf + reader->pos, reader->len - reader->pos, "\r\n\r\n", 4))) {
+            // Keep room for the Connection header appended when forwarding the head
+            if (reader->len + 64 > sizeof(reader->buf)) {
+                if (reader->pos == 0) {
+                    errno = EMSGSIZE;  // Head larger than the buffer
+                    return -1;
+                }
+                memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+                reader->len -= reader->pos;
+                reader->pos = 0;
+            }
+            ssize_t n = conn_recv(reader->conn, reader->buf + reader->len, sizeof(reader->buf) - 64 - reader->len);
+            if (n == 0) errno = ECONNRESET;
+            if (n <= 0) return -1;
+            reader->len += n;
+        }
+
+        int status = 0;
+        sscanf(reader->buf + reader->pos, "HTTP/%*d.%*d %d", &status);
+        size_t head_len = end + 4 - (reader->buf + reader->pos);
+        if (status >= 100 && status < 200) {
+            reader->pos += head_len;
+            continue;
+        }
+        return (int)head_len;
+    }
+}
+
+/**
+ * Route handler for proxy routes: forwards the request to the route's upstream group
+ */
+void handle_proxy(Connection *conn, HttpRequest *request, const char *client_ip) {
+    UpstreamGroup *group = request->route->upstream;
+    int streamed_body = has_streamed_body(request);
+
+    StreamReader *reader = malloc(sizeof(StreamReader));
+    char *head = malloc(PROXY_HEAD_SIZE);
+    if (!reader || !head) {
+        free(reader);
+        free(head);
+        send_response_header(conn, HTTP_INTERNAL_SERVER_ERROR, "text/html", 0);
+        log_request(client_ip, request->method, request->path, HTTP_INTERNAL_SERVER_ERROR);
+        return;
+    }
+
+    int error_status = HTTP_BAD_GATEWAY;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        pthread_mutex_lock(&group->mutex);
+        Upstream *upstream = pick_upstream(group);
+        pthread_mutex_unlock(&group->mutex);
+        if (!upstream) break;
+
+        int reused;
+        int upstream_fd = acquire_connection(group, upstream, &reused);
+        if (upstream_fd < 0) {
+            release_connection(group, upstream, -1, 0);
+            continue;
+        }
+
+        int head_len = build_upstream_request(head, PROXY_HEAD_SIZE, request, group, upstream, client_ip);
+        if (head_len < 0) {
+            release_connection(group, upstream, upstream_fd, 0);
+            break;
+        }
+
+        Connection upstream_conn = { .fd = upstream_fd };
+        int sent = conn_send(&upstream_conn, head, head_len) == 0;
+        if (sent && !streamed_body && request->body_length > 0) {
+            sent = conn_send(&upstream_conn, request->body, request->body_length) == 0;
+        } else if (sent && streamed_body) {
+            sent = forward_request_body(conn, &upstream_conn, request) == 0;
+        }
+
+        reader->conn = &upstream_conn;
+        reader->pos = 0;
+        reader->len = 0;
+        int response_head_len = sent ? read_response_head(reader) : -1;
+        if (response_head_len < 0) {
+            int error = errno;
+            release_connection(group, upstream, upstream_fd, 0);
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                error_status = HTTP_GATEWAY_TIMEOUT;
+                break;
+            }
+            // A pooled connection may have been closed by the upstream just as we
+            // reused it. Only a close before any response byte shows the request
+            // was not acted on, and even then only idempotent requests whose body
+            // was not consumed are sent again.
+            int closed = error == ECONNRESET || error == EPIPE;
+            if (reused && closed && reader->len == 0 && !streamed_body && is_idempotent(request->method)) continue;
+            break;
+        }
+
+        // Parse the status and framing of the upstream response
+        char *response_head = reader->buf + reader->pos;
+        int status = HTTP_BAD_GATEWAY;
+        int minor_version = 1;
+        sscanf(response_head, "HTTP/1.%d %d", &minor_version, &status);
+
+        long long content_length = -1;
+        int chunked = 0;
+        int keep_alive = minor_version >= 1;
+
+        char *line = strstr(response_head, "\r\n") + 2;
+        int out_len = (int)(line - response_head);
+        memcpy(head, response_head, out_len);
+        while (line < response_head + response_head_len - 2) {
+            char *line_end = strstr(line, "\r\n");
+            size_t line_len = line_end + 2 - line;
+            char *colon = memchr(line, ':', line_end - line);
+            if (colon) {
+                const char *value = colon + 1;
+                while (*value == ' ' || *value == '\t') value++;
+                size_t name_len = colon - line;
+
+                if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                    content_length = strtoll(value, NULL, 10);
+                } else if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                    chunked = strncasecmp(value, "chunked", 7) == 0;
+                } else if (name_len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                    if (strncasecmp(value, "close", 5) == 0) keep_alive = 0;
+                    if (strncasecmp(value, "keep-alive", 10) == 0) keep_alive = 1;
+                    line = line_end + 2;
+                    continue;
+                }
+                if (!(name_len == 10 && strncasecmp(line, "Keep-Alive", 10) == 0)) {
+                    memcpy(head + out_len, line, line_len);
+                    out_len += line_len;
+                }
+            }
+            line = line_end + 2;
+        }
+        out_len += snprintf(head + out_len, PROXY_HEAD_SIZE - out_len, "Connection: close\r\n\r\n");
+        reader->pos += response_head_len;
+
+        // Relay the response to the client while the upstream is still sending it
+        unsigned long relayed = 0;
+        int body_ok = 1;
+        conn_send(conn, head, out_len);
+        if (strcmp(request->method, "HEAD") == 0 || status == 204 || status == 304) {
+            // No body
+        } else if (chunked) {
+            body_ok = relay_chunked(reader, conn, &relayed) == 0;
+        } else if (content_length >= 0) {
+            body_ok = relay_bytes(reader, conn, content_length, &relayed) == 0;
+        } else {
+            relay_until_eof(reader, conn, &relayed);
+            keep_alive = 0;
+        }
+
+        // Leftover bytes mean the upstream sent more than it framed; don't reuse it
+        int reusable = keep_alive && body_ok && reader->pos == reader->len;
+        release_connection(group, upstream, upstream_fd, reusable);
+
+        update_stats(relayed);
+        log_request(client_ip, request->method, request->path, status);
+        free(reader);
+        free(head);
+        return;
+    }
+
+    free(reader);
+    free(head);
+
+    const char *body = error_status == HTTP_GATEWAY_TIMEOUT ? "<h1>504 Gateway Timeout</h1>" : "<h1>502 Bad Gateway</h1>";
+    send_response_header(conn, error_status, "text/html", strlen(body));
+    if (strcmp(request->method, "HEAD") != 0) {
+        conn_send(conn, body, strlen(body));
+    }
+    log_request(client_ip, request->method, request->path, error_status);
+}
+
+/**
+ * Runs one active health check against an upstream
+ */
+static int check_upstream(UpstreamGroup *group, Upstream *upstream) {
+    int fd = upstream_connect(upstream, HEALTH_CHECK_TIMEOUT);
+    if (fd < 0) return 0;
+
+    char request[512];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.1\r\n"
+                       "Host: %s:%d\r\n"
+                       "User-Agent: %s health-check\r\n"
+                       "Connection: close\r\n"
+                       "\r\n",
+                       group->health_path, upstream->host, upstream->port, SERVER_VERSION);
+
+    int status = 0;
+    char response[64];
+    Connection probe = { .fd = fd };
+    if (conn_send(&probe, request, len) == 0) {
+        ssize_t n = recv(fd, response, sizeof(response) - 1, 0);
+        if (n > 0) {
+            response[n] = '\0';
+            sscanf(response, "HTTP/%*d.%*d %d", &status);
+        }
+        // Drain the rest so the upstream sees an orderly close rather than a reset
+        while (n > 0) n = recv(fd, response, sizeof(response), 0);
+    }
+    close(fd);
+
+    return status >= 200 && status < 500;
+}
+
+/**
+ * Background thread that periodically probes every upstream
+ */
+static void* health_check_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        for (int g = 0; g < upstream_group_count; g++) {
+            UpstreamGroup *group = &upstream_groups[g];
+            for (int i = 0; i < group->server_count; i++) {
+                Upstream *upstream = &group->servers[i];
+                int healthy = check_upstream(group, upstream);
+
+                pthread_mutex_lock(&group->mutex);
+                int was_healthy = upstream->healthy;
+                upstream->healthy = healthy;
+                if (!healthy) upstream->failures++;
+                pthread_mutex_unlock(&group->mutex);
+
+                if (healthy != was_healthy) {
+                    // Sized for the longest host and prefix, so the message is never cut
+                    char message[sizeof(upstream->host) + sizeof(group->prefix) + 64];
+                    snprintf(message, sizeof(message), "Upstream %.*s:%d for %.*s marked %s",
+                             (int)sizeof(upstream->host) - 1, upstream->host, upstream->port,
+                             (int)sizeof(group->prefix) - 1, group->prefix, healthy ? "up" : "down");
+                    log_error(message);
+                }
+            }
+        }
+        sleep(HEALTH_CHECK_INTERVAL);
+    }
+    return NULL;
+}
+
+/**
+ * Starts the health checker if any proxy routes are configured
+ */
+void proxy_start_health_checks(void) {
+    if (upstream_group_count == 0) return;
+
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, health_check_thread, NULL) == 0) {
+        pthread_detach(thread_id);
+    }
+}
+
+/**
+ * Resolves "host:port" into an upstream entry
+ */
+static int parse_upstream(const char *spec, Upstream *upstream) {
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(upstream->host)) return -1;
+
+    memset(upstream, 0, sizeof(*upstream));
+    memcpy(upstream->host, spec, colon - spec);
+    upstream->port = atoi(colon + 1);
+    if (upstream->port <= 0 || upstream->port > 65535) return -1;
+
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(upstream->host, NULL, &hints, &result) != 0) return -1;
+    upstream->addr = *(struct sockaddr_in*)result->ai_addr;
+    upstream->addr.sin_port = htons(upstream->port);
+    freeaddrinfo(result);
+
+    upstream->healthy = 1;
+    return 0;
+}
+
+/**
+ * Registers a proxy route from a command line spec:
+ *   /prefix/=host:port[,host:port...][;balance=round_robin|least_conn][;health=/path]
+ */
+int proxy_add_route(const char *spec) {
+    if (upstream_group_count >= MAX_PROXY_ROUTES) return -1;
+
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%s", spec);
+
+    char *eq = strchr(copy, '=');
+    if (!eq || copy[0] != '/' || (size_t)(eq - copy) >= sizeof(upstream_groups[0].prefix)) return -1;
+    *eq = '\0';
+
+    UpstreamGroup *group = &upstream_groups[upstream_group_count];
+    memset(group, 0, sizeof(*group));
+    pthread_mutex_init(&group->mutex, NULL);
+    memcpy(group->prefix, copy, eq - copy);
+    snprintf(group->health_path, sizeof(group->health_path), "/");
+    group->balance = BALANCE_ROUND_ROBIN;
+
+    char *saveptr;
+    char *servers = strtok_r(eq + 1, ";", &saveptr);
+    char *option;
+    while ((option = strtok_r(NULL, ";", &saveptr)) != NULL) {
+        if (strcmp(option, "balance=least_conn") == 0) {
+            group->balance = BALANCE_LEAST_CONN;
+        } else if (strcmp(option, "balance=round_robin") == 0) {
+            group->balance = BALANCE_ROUND_ROBIN;
+        } else if (strncmp(option, "health=/", 8) == 0) {
+            snprintf(group->health_path, sizeof(group->health_path), "%s", option + 7);
+        } else {
+            return -1;
+        }
+    }
+
+    char *server_saveptr;
+    for (char *server = servers ? strtok_r(servers, ",", &server_saveptr) : NULL; server;
+         server = strtok_r(NULL, ",", &server_saveptr)) {
+        if (group->server_count >= MAX_UPSTREAMS) return -1;
+        if (parse_upstream(server, &group->servers[group->server_count]) < 0) return -1;
+        group->server_count++;
+    }
+    if (group->server_count == 0) return -1;
+
+    Route route;
+    memset(&route, 0, sizeof(route));
+    snprintf(route.path, sizeof(route.path), "%s", group->prefix);
+    snprintf(route.methods, sizeof(route.methods), "*");
+    route.handler = handle_proxy;
+    route.kind = ROUTE_PROXY;
+    route.upstream = group;
+    if (add_route(&route) < 0) return -1;
+
+    upstream_group_count++;
+    return 0;
+}
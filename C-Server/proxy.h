@@ -0,0 +1,55 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <netinet/in.h>
+#include "Http_server.h"
+
+#define MAX_PROXY_ROUTES 8
+#define MAX_UPSTREAMS 8
+#define UPSTREAM_POOL_SIZE 16      // Idle keep-alive connections kept per upstream
+#define UPSTREAM_IDLE_TIMEOUT 30   // Seconds before an idle pooled connection is dropped
+#define UPSTREAM_IO_TIMEOUT 30     // Seconds to wait on upstream connect/send/recv
+#define HEALTH_CHECK_INTERVAL 5    // Seconds between active health checks
+#define HEALTH_CHECK_TIMEOUT 2
+#define PROXY_HEAD_SIZE (BUFFER_SIZE * 4)
+
+// Load balancing strategies
+typedef enum {
+    BALANCE_ROUND_ROBIN,
+    BALANCE_LEAST_CONN
+} BalanceMode;
+
+// Idle keep-alive connection parked in an upstream pool
+typedef struct {
+    int fd;
+    time_t last_used;
+} IdleConnection;
+
+// A single upstream HTTP server
+typedef struct {
+    char host[64];
+    int port;
+    struct sockaddr_in addr;
+    int healthy;
+    int active;  // Requests currently in flight
+    IdleConnection idle[UPSTREAM_POOL_SIZE];
+    int idle_count;
+    unsigned long failures;
+} Upstream;
+
+// Set of upstreams serving one proxy route
+typedef struct UpstreamGroup {
+    char prefix[256];
+    char health_path[128];
+    BalanceMode balance;
+    Upstream servers[MAX_UPSTREAMS];
+    int server_count;
+    unsigned int next;  // Round-robin cursor
+    pthread_mutex_t mutex;
+} UpstreamGroup;
+
+int proxy_add_route(const char *spec);
+void proxy_start_health_checks(void);
+void handle_proxy(Connection *conn, HttpRequest *request, const char *client_ip);
+
+#endif
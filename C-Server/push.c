@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <openssl/evp.h>
+
+#include "push.h"
+#include "outq.h"
+#include "tls.h"
+#include "admin.h"
+#include "prefork.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// WebSocket opcodes
+#define WS_TEXT 0x1
+#define WS_CLOSE 0x8
+#define WS_PING 0x9
+#define WS_PONG 0xA
+
+// A connection subscribed to a channel. Its queue is guarded by the
+// channel lock; the eventfd wakes the connection's thread.
+typedef struct PushSubscriber {
+    struct PushSubscriber *next;
+    int event_fd;
+    PushMessage *queue[PUSH_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int count;
+} PushSubscriber;
+
+PushChannel push_time_channel = { "time", PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0 };
+PushChannel push_status_channel = { "status", PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0 };
+
+static unsigned long delivered_count;
+static unsigned long dropped_count;
+
+static void message_unref(PushMessage *message) {
+    if (message && __atomic_sub_fetch(&message->refs, 1, __ATOMIC_ACQ_REL) == 0) free(message);
+}
+
+/**
+ * Writes a WebSocket frame header for an unmasked server frame. Returns
+ * the header length.
+ */
+static size_t ws_frame_header(unsigned char *header, int opcode, size_t len) {
+    header[0] = 0x80 | opcode;
+    if (len < 126) {
+        header[1] = (unsigned char)len;
+        return 2;
+    }
+    if (len <= 0xffff) {
+        header[1] = 126;
+        header[2] = (unsigned char)(len >> 8);
+        header[3] = (unsigned char)len;
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; i++) header[2 + i] = (unsigned char)((uint64_t)len >> (56 - 8 * i));
+    return 10;
+}
+
+/**
+ * Serializes an update once in both wire formats
+ */
+static PushMessage* create_message(const char *event, const char *data, size_t len) {
+    ByteBuffer sse = {NULL, 0, 0};
+    int result = buffer_append(&sse, "event: ", 7);
+    result |= buffer_append(&sse, event, strlen(event));
+    result |= buffer_append(&sse, "\n", 1);
+
+    // Every line of the payload becomes its own data: field
+    const char *line = data, *end = data + len;
+    while (result == 0 && line <= end) {
+        const char *newline = memchr(line, '\n', end - line);
+        size_t line_len = newline ? (size_t)(newline - line) : (size_t)(end - line);
+        result |= buffer_append(&sse, "data: ", 6);
+        result |= buffer_append(&sse, line, line_len);
+        result |= buffer_append(&sse, "\n", 1);
+        if (!newline) break;
+        line = newline + 1;
+    }
+    result |= buffer_append(&sse, "\n", 1);
+
+    unsigned char header[10];
+    size_t header_len = ws_frame_header(header, WS_TEXT, len);
+    PushMessage *message = result == 0 ? malloc(sizeof(PushMessage) + sse.len + header_len + len) : NULL;
+    if (message) {
+        message->refs = 1;
+        message->sse_len = sse.len;
+        message->ws_len = header_len + len;
+        memcpy(message->data, sse.data, sse.len);
+        memcpy(message->data + sse.len, header, header_len);
+        memcpy(message->data + sse.len + header_len, data, len);
+    }
+    buffer_free(&sse);
+    return message;
+}
+
+/**
+ * Queues a message for a subscriber, dropping its oldest one when it has
+ * fallen PUSH_QUEUE_SIZE messages behind (channel lock held)
+ */
+static void enqueue(PushSubscriber *subscriber, PushMessage *message) {
+    if (subscriber->count == PUSH_QUEUE_SIZE) {
+        message_unref(subscriber->queue[subscriber->head]);
+        subscriber->head = (subscriber->head + 1) % PUSH_QUEUE_SIZE;
+        subscriber->count--;
+        __atomic_add_fetch(&dropped_count, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&message->refs, 1, __ATOMIC_RELAXED);
+    subscriber->queue[(subscriber->head + subscriber->count) % PUSH_QUEUE_SIZE] = message;
+    subscriber->count++;
+
+    uint64_t one = 1;
+    if (write(subscriber->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Push: could not wake a subscriber");
+    }
+}
+
+/**
+ * Sends an update to every subscriber of a channel. The payload is
+ * framed once; subscribers share the buffer by reference.
+ */
+void push_publish(PushChannel *channel, const char *data, size_t len) {
+    PushMessage *message = create_message(channel->name, data, len);
+    if (!message) return;
+
+    pthread_mutex_lock(&channel->lock);
+    message_unref(channel->latest);
+    __atomic_add_fetch(&message->refs, 1, __ATOMIC_RELAXED);
+    channel->latest = message;
+    for (PushSubscriber *subscriber = channel->subscribers; subscriber; subscriber = subscriber->next) {
+        enqueue(subscriber, message);
+    }
+    __atomic_add_fetch(&channel->published, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&channel->lock);
+
+    message_unref(message);
+}
+
+/**
+ * Writes a control frame (payloads of up to 125 bytes)
+ */
+static int ws_send_control(Connection *conn, int opcode, const unsigned char *payload, size_t len) {
+    unsigned char frame[2 + 125];
+    if (len > 125) len = 125;
+    size_t header_len = ws_frame_header(frame, opcode, len);
+    if (len > 0) memcpy(frame + header_len, payload, len);
+    return conn_write(conn, frame, header_len + len);
+}
+
+/**
+ * Handles the frames a WebSocket client sent: pings are answered, a close
+ * is echoed, data frames are ignored. Returns -1 once the connection
+ * should end; frame holds *have bytes and keeps any partial frame.
+ */
+static int ws_read_frames(Connection *conn, unsigned char *frame, size_t *have) {
+    while (*have >= 2) {
+        int opcode = frame[0] & 0x0f;
+        int masked = frame[1] & 0x80;
+        uint64_t len = frame[1] & 0x7f;
+        size_t header_len = 2;
+
+        if (len == 126) {
+            if (*have < 4) break;
+            len = ((uint64_t)frame[2] << 8) | frame[3];
+            header_len = 4;
+        } else if (len == 127) {
+            if (*have < 10) break;
+            len = 0;
+            for (int i = 0; i < 8; i++) len = (len << 8) | frame[2 + i];
+            header_len = 10;
+        }
+
+        // Client frames must be masked and fit the frame buffer
+        static const unsigned char too_big[] = { 0x03, 0xf1 };         // 1009
+        static const unsigned char protocol_error[] = { 0x03, 0xea };  // 1002
+        if (!masked) {
+            ws_send_control(conn, WS_CLOSE, protocol_error, sizeof(protocol_error));
+            return -1;
+        }
+        if (len > PUSH_FRAME_SIZE - header_len - 4) {
+            ws_send_control(conn, WS_CLOSE, too_big, sizeof(too_big));
+            return -1;
+        }
+        size_t frame_len = header_len + 4 + (size_t)len;
+        if (*have < frame_len) break;
+
+        unsigned char *mask = frame + header_len;
+        unsigned char *payload = mask + 4;
+        for (size_t i = 0; i < len; i++) payload[i] ^= mask[i % 4];
+
+        if (opcode == WS_CLOSE) {
+            ws_send_control(conn, WS_CLOSE, payload, len >= 2 ? 2 : 0);
+            return -1;
+        }
+        if (opcode == WS_PING && ws_send_control(conn, WS_PONG, payload, len) < 0) {
+            return -1;
+        }
+
+        memmove(frame, frame + frame_len, *have - frame_len);
+        *have -= frame_len;
+    }
+    return 0;
+}
+
+/**
+ * Completes the WebSocket opening handshake (RFC 6455)
+ */
+static int ws_handshake(Connection *conn, HttpRequest *request) {
+    const char *key = get_header_value(request, "Sec-WebSocket-Key");
+    const char *version = get_header_value(request, "Sec-WebSocket-Version");
+    if (!key || !version || strcmp(version, "13") != 0 || strlen(key) > 64) return -1;
+
+    char input[128];
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    int input_len = snprintf(input, sizeof(input), "%s" WS_GUID, key);
+    if (!EVP_Digest(input, input_len, digest, &digest_len, EVP_sha1(), NULL)) return -1;
+
+    unsigned char accept[64];
+    EVP_EncodeBlock(accept, digest, digest_len);
+
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 101 Switching Protocols\r\n"
+                       "Server: " SERVER_VERSION "\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: %s\r\n"
+                       "\r\n", accept);
+    return conn_send(conn, header, len);
+}
+
+static int sse_handshake(Connection *conn) {
+    const char *header =
+        "HTTP/1.1 200 OK\r\n"
+        "Server: " SERVER_VERSION "\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "X-Accel-Buffering: no\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    return conn_send(conn, header, strlen(header));
+}
+
+/**
+ * Writes every message queued for the subscriber
+ */
+static int deliver(Connection *conn, PushChannel *channel, PushSubscriber *subscriber, int websocket) {
+    PushMessage *pending[PUSH_QUEUE_SIZE];
+    unsigned int count;
+
+    pthread_mutex_lock(&channel->lock);
+    count = subscriber->count;
+    for (unsigned int i = 0; i < count; i++) {
+        pending[i] = subscriber->queue[(subscriber->head + i) % PUSH_QUEUE_SIZE];
+    }
+    subscriber->head = subscriber->count = 0;
+    pthread_mutex_unlock(&channel->lock);
+
+    int result = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        PushMessage *message = pending[i];
+        if (result == 0) {
+            result = websocket ? conn_write(conn, message->data + message->sse_len, message->ws_len)
+                               : conn_write(conn, message->data, message->sse_len);
+            if (result == 0) __atomic_add_fetch(&delivered_count, 1, __ATOMIC_RELAXED);
+        }
+        message_unref(message);
+    }
+    return result;
+}
+
+/**
+ * Route handler for ROUTE_PUSH routes: upgrades the request to a WebSocket
+ * (Upgrade: websocket) or an SSE stream and relays the route's channel
+ * until the client goes away
+ */
+void push_subscribe(Connection *conn, HttpRequest *request, const char *client_ip) {
+    PushChannel *channel = request->route ? request->route->channel : NULL;
+    const char *upgrade = get_header_value(request, "Upgrade");
+    int websocket = upgrade && strcasestr(upgrade, "websocket") != NULL;
+
+    // Captured responses and HTTP/2 streams, which share the connection's thread, cannot stay open
+    if (!channel || conn->capture || conn->h2_stream || (websocket && ws_handshake(conn, request) < 0)) {
+        const char *bad_request = "<h1>400 Bad Request</h1>";
+        send_response_header(conn, HTTP_BAD_REQUEST, "text/html", strlen(bad_request));
+        conn_send(conn, bad_request, strlen(bad_request));
+        log_request(client_ip, request->method, request->path, HTTP_BAD_REQUEST);
+        return;
+    }
+    if (!websocket) sse_handshake(conn);
+    log_request(client_ip, request->method, request->path, websocket ? 101 : HTTP_OK);
+    if (conn->out && outq_flush(conn, 1) < 0) return;
+
+    PushSubscriber *subscriber = calloc(1, sizeof(PushSubscriber));
+    if (!subscriber) return;
+    subscriber->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (subscriber->event_fd < 0) {
+        free(subscriber);
+        return;
+    }
+
+    pthread_mutex_lock(&channel->lock);
+    subscriber->next = channel->subscribers;
+    channel->subscribers = subscriber;
+    __atomic_add_fetch(&channel->subscriber_count, 1, __ATOMIC_RELAXED);
+    if (channel->latest) enqueue(subscriber, channel->latest);
+    pthread_mutex_unlock(&channel->lock);
+    admin_conn_state(CONN_PUSH, NULL);
+
+    unsigned char frame[PUSH_FRAME_SIZE];
+    size_t have = 0;
+    while (1) {
+        struct pollfd fds[2] = {
+            { conn->fd, POLLIN, 0 },
+            { subscriber->event_fd, POLLIN, 0 }
+        };
+        int ready = tls_pending(conn) ? 1 : poll(fds, 2, PUSH_KEEPALIVE_MS);
+        if (tls_pending(conn)) fds[0].revents = POLLIN;
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+
+        if (ready == 0) {
+            // Keepalive, which also notices clients that vanished without a FIN
+            int result = websocket ? ws_send_control(conn, WS_PING, NULL, 0)
+                                   : conn_write(conn, ": keepalive\n\n", 13);
+            if (result < 0) break;
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t wakeups;
+            if (read(subscriber->event_fd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN) break;
+            if (deliver(conn, channel, subscriber, websocket) < 0) break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = conn_recv(conn, frame + have, sizeof(frame) - have);
+            if (n <= 0) break;
+            if (websocket) {
+                have += n;
+                if (ws_read_frames(conn, frame, &have) < 0) break;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&channel->lock);
+    for (PushSubscriber **link = &channel->subscribers; *link; link = &(*link)->next) {
+        if (*link == subscriber) {
+            *link = subscriber->next;
+            break;
+        }
+    }
+    __atomic_sub_fetch(&channel->subscriber_count, 1, __ATOMIC_RELAXED);
+    while (subscriber->count > 0) {
+        message_unref(subscriber->queue[subscriber->head]);
+        subscriber->head = (subscriber->head + 1) % PUSH_QUEUE_SIZE;
+        subscriber->count--;
+    }
+    pthread_mutex_unlock(&channel->lock);
+
+    close(subscriber->event_fd);
+    free(subscriber);
+}
+
+static int has_subscribers(PushChannel *channel) {
+    return __atomic_load_n(&channel->subscriber_count, __ATOMIC_RELAXED) > 0;
+}
+
+/**
+ * Publishes the /time and /status updates once a second while anyone is
+ * subscribed to them
+ */
+static void* ticker_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        struct timespec tick = { PUSH_TICK_MS / 1000, (PUSH_TICK_MS % 1000) * 1000000L };
+        nanosleep(&tick, NULL);
+
+        char data[256];
+        time_t now = time(NULL);
+        if (has_subscribers(&push_time_channel)) {
+            char time_str[64];
+            struct tm tm;
+            localtime_r(&now, &tm);
+            strftime(time_str, sizeof(time_str), "%a %b %d %H:%M:%S %Y", &tm);
+            int len = snprintf(data, sizeof(data), "{\"time\":\"%s\",\"timezone\":\"%s\"}", time_str, tzname[0]);
+            push_publish(&push_time_channel, data, len);
+        }
+
+        if (has_subscribers(&push_status_channel)) {
+            long uptime = (long)(now - server_stats->start_time);
+            unsigned long requests, bytes_sent;
+            stats_totals(&requests, &bytes_sent);
+
+            PushStats push;
+            push_get_stats(&push);
+            int len = snprintf(data, sizeof(data),
+                               "{\"uptime\":%ld,\"requests\":%lu,\"bytes_sent\":%lu,\"subscribers\":%d}",
+                               uptime, requests, bytes_sent, push.subscribers);
+            push_publish(&push_status_channel, data, len);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Starts the thread that feeds the built-in channels
+ */
+void push_start(void) {
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, ticker_thread, NULL) == 0) {
+        pthread_detach(thread_id);
+    }
+}
+
+void push_get_stats(PushStats *stats) {
+    PushChannel *channels[] = { &push_time_channel, &push_status_channel };
+    stats->subscribers = 0;
+    stats->published = 0;
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        stats->subscribers += __atomic_load_n(&channels[i]->subscriber_count, __ATOMIC_RELAXED);
+        stats->published += __atomic_load_n(&channels[i]->published, __ATOMIC_RELAXED);
+    }
+    stats->delivered = __atomic_load_n(&delivered_count, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&dropped_count, __ATOMIC_RELAXED);
+}
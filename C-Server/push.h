@@ -0,0 +1,49 @@
+#ifndef PUSH_H
+#define PUSH_H
+
+#include <pthread.h>
+#include "Http_server.h"
+
+#define PUSH_QUEUE_SIZE 64         // Messages a subscriber may fall behind before the oldest are dropped
+#define PUSH_KEEPALIVE_MS 15000    // Idle time before a comment (SSE) or ping (WebSocket) is sent
+#define PUSH_FRAME_SIZE 4096       // Largest WebSocket frame read from a client
+#define PUSH_TICK_MS 1000
+
+// Update serialized once per publish and shared by every subscriber it is
+// queued for; freed when the last one has written it
+typedef struct {
+    int refs;
+    size_t sse_len;       // "event:/data:" framing at data
+    size_t ws_len;        // WebSocket text frame at data + sse_len
+    char data[];
+} PushMessage;
+
+struct PushSubscriber;
+
+// Named broadcast channel
+typedef struct PushChannel {
+    const char *name;
+    pthread_mutex_t lock;
+    struct PushSubscriber *subscribers;
+    PushMessage *latest;           // Sent to new subscribers straight away
+    int subscriber_count;
+    unsigned long published;
+} PushChannel;
+
+// Push counters, over all channels
+typedef struct {
+    int subscribers;
+    unsigned long published;
+    unsigned long delivered;
+    unsigned long dropped;         // Messages a slow subscriber never received
+} PushStats;
+
+extern PushChannel push_time_channel;
+extern PushChannel push_status_channel;
+
+void push_start(void);
+void push_publish(PushChannel *channel, const char *data, size_t len);
+void push_subscribe(Connection *conn, HttpRequest *request, const char *client_ip);
+void push_get_stats(PushStats *stats);
+
+#endif
@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rcu.h"
+
+// Per-thread reader state on its own cache line, so entering and leaving a
+// read section never writes memory another core is reading
+typedef struct EpochRecord {
+    unsigned long state;       // (epoch << 1) | 1 inside a read section, 0 outside
+    int in_use;                // Owned by a live thread
+    struct EpochRecord *next;
+} __attribute__((aligned(RCU_CACHE_LINE))) EpochRecord;
+
+static struct {
+    unsigned long epoch;
+} __attribute__((aligned(RCU_CACHE_LINE))) global_epoch = { 1 };
+
+static EpochRecord *records = NULL;
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static __thread EpochRecord *thread_record = NULL;
+static __thread int read_depth = 0;
+
+/**
+ * Thread exit: hands the record to the next thread that needs one
+ */
+static void release_record(void *arg) {
+    EpochRecord *record = arg;
+    __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void create_record_key(void) {
+    pthread_key_create(&record_key, release_record);
+}
+
+/**
+ * Returns the calling thread's record, reusing one left by an exited thread
+ */
+static EpochRecord* get_record(void) {
+    if (thread_record) return thread_record;
+    pthread_once(&record_key_once, create_record_key);
+
+    EpochRecord *record;
+    for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&record->in_use, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!record) {
+        void *memory;
+        if (posix_memalign(&memory, RCU_CACHE_LINE, sizeof(EpochRecord)) != 0) abort();
+        record = memory;
+        memset(record, 0, sizeof(*record));
+        record->in_use = 1;
+        record->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&records, &record->next, record, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    thread_record = record;
+    pthread_setspecific(record_key, record);
+    return record;
+}
+
+/**
+ * Enters a read section: pointers loaded from an RcuMap stay valid until
+ * the matching rcu_read_unlock(). Sections may nest.
+ */
+void rcu_read_lock(void) {
+    if (read_depth++ > 0) return;
+    EpochRecord *record = get_record();
+    unsigned long epoch = __atomic_load_n(&global_epoch.epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->state, (epoch << 1) | 1, __ATOMIC_RELAXED);
+    // The announcement must be visible before any map pointer is read
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcu_read_unlock(void) {
+    if (--read_depth > 0) return;
+    __atomic_store_n(&thread_record->state, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Moves the global epoch forward if every reader inside a read section has
+ * observed the current one. Returns the (possibly new) epoch.
+ */
+static unsigned long try_advance_epoch(void) {
+    unsigned long epoch = __atomic_load_n(&global_epoch.epoch, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for (EpochRecord *record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        unsigned long state = __atomic_load_n(&record->state, __ATOMIC_ACQUIRE);
+        if ((state & 1) && (state >> 1) != epoch) return epoch;
+    }
+
+    unsigned long expected = epoch;
+    __atomic_compare_exchange_n(&global_epoch.epoch, &expected, epoch + 1, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    return __atomic_load_n(&global_epoch.epoch, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Waits until every read section open at the time of the call has ended.
+ * Must not be called from inside a read section.
+ */
+void rcu_synchronize(void) {
+    unsigned long target = __atomic_load_n(&global_epoch.epoch, __ATOMIC_ACQUIRE) + 2;
+    while (try_advance_epoch() < target) {
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+}
+
+static unsigned long hash_key(const char *key) {
+    unsigned long hash = 2166136261UL;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * Queues an unlinked node for freeing (write lock held)
+ */
+static void retire_node(RcuMap *map, RcuNode *node) {
+    node->retired_epoch = __atomic_load_n(&global_epoch.epoch, __ATOMIC_ACQUIRE);
+    node->retired_next = map->retired;
+    map->retired = node;
+}
+
+/**
+ * Frees retired nodes that no reader can reach any more: a node retired in
+ * epoch E is safe once the global epoch reaches E + 2 (write lock held)
+ */
+static void reclaim(RcuMap *map) {
+    if (!map->retired) return;
+    unsigned long epoch = try_advance_epoch();
+
+    RcuNode **link = &map->retired;
+    while (*link) {
+        RcuNode *node = *link;
+        if (node->retired_epoch + 2 <= epoch) {
+            *link = node->retired_next;
+            if (map->free_value) map->free_value(node->value);
+            free(node);
+        } else {
+            link = &node->retired_next;
+        }
+    }
+}
+
+/**
+ * Creates a map with a fixed number of buckets (rounded up to a power of two)
+ */
+int rcu_map_init(RcuMap *map, size_t buckets, RcuFreeFn free_value) {
+    size_t size = 1;
+    while (size < buckets) size <<= 1;
+
+    map->buckets = calloc(size, sizeof(RcuNode*));
+    if (!map->buckets) return -1;
+    map->mask = size - 1;
+    map->free_value = free_value;
+    map->count = 0;
+    map->retired = NULL;
+    pthread_mutex_init(&map->write_lock, NULL);
+    return 0;
+}
+
+/**
+ * Looks up a key. Must be called inside a read section; the value may be
+ * retired by a writer but is not freed before rcu_read_unlock().
+ */
+void* rcu_map_lookup(RcuMap *map, const char *key) {
+    unsigned long hash = hash_key(key);
+    RcuNode *node = __atomic_load_n(&map->buckets[hash & map->mask], __ATOMIC_ACQUIRE);
+    for (; node; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+        if (node->hash == hash && strcmp(node->key, key) == 0) return node->value;
+    }
+    return NULL;
+}
+
+/**
+ * Calls visit for every entry. The caller must be inside rcu_read_lock();
+ * entries inserted or removed meanwhile may or may not be seen.
+ */
+void rcu_map_for_each(RcuMap *map, void (*visit)(const char *key, void *value, void *arg), void *arg) {
+    for (size_t i = 0; i <= map->mask; i++) {
+        RcuNode *node = __atomic_load_n(&map->buckets[i], __ATOMIC_ACQUIRE);
+        for (; node; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+            visit(node->key, node->value, arg);
+        }
+    }
+}
+
+/**
+ * Inserts or replaces the value for a key; a replaced value is freed after
+ * a grace period
+ */
+int rcu_map_insert(RcuMap *map, const char *key, void *value) {
+    size_t key_len = strlen(key);
+    RcuNode *node = malloc(sizeof(RcuNode) + key_len + 1);
+    if (!node) return -1;
+    node->hash = hash_key(key);
+    node->value = value;
+    memcpy(node->key, key, key_len + 1);
+
+    pthread_mutex_lock(&map->write_lock);
+    RcuNode **link = &map->buckets[node->hash & map->mask];
+    while (*link && ((*link)->hash != node->hash || strcmp((*link)->key, key) != 0)) {
+        link = &(*link)->next;
+    }
+
+    RcuNode *old = *link;
+    if (old) {
+        node->next = old->next;
+        __atomic_store_n(link, node, __ATOMIC_RELEASE);
+        retire_node(map, old);
+    } else {
+        node->next = map->buckets[node->hash & map->mask];
+        __atomic_store_n(&map->buckets[node->hash & map->mask], node, __ATOMIC_RELEASE);
+        map->count++;
+    }
+    reclaim(map);
+    pthread_mutex_unlock(&map->write_lock);
+    return 0;
+}
+
+/**
+ * Unlinks every entry whose value matches the predicate (write lock held)
+ */
+static int remove_matching(RcuMap *map, int (*predicate)(void *value, void *arg), void *arg) {
+    int removed = 0;
+    for (size_t i = 0; i <= map->mask; i++) {
+        RcuNode **link = &map->buckets[i];
+        while (*link) {
+            RcuNode *node = *link;
+            if (predicate(node->value, arg)) {
+                __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+                retire_node(map, node);
+                map->count--;
+                removed++;
+            } else {
+                link = &node->next;
+            }
+        }
+    }
+    return removed;
+}
+
+/**
+ * Removes a key. Returns 1 if it was present.
+ */
+int rcu_map_remove(RcuMap *map, const char *key) {
+    pthread_mutex_lock(&map->write_lock);
+    int removed = 0;
+    unsigned long hash = hash_key(key);
+    RcuNode **link = &map->buckets[hash & map->mask];
+    while (*link) {
+        RcuNode *node = *link;
+        if (node->hash == hash && strcmp(node->key, key) == 0) {
+            __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+            retire_node(map, node);
+            map->count--;
+            removed = 1;
+            break;
+        }
+        link = &node->next;
+    }
+    reclaim(map);
+    pthread_mutex_unlock(&map->write_lock);
+    return removed;
+}
+
+/**
+ * Removes every entry for which predicate(value, arg) returns non-zero.
+ * Returns the number of entries removed.
+ */
+int rcu_map_remove_if(RcuMap *map, int (*predicate)(void *value, void *arg), void *arg) {
+    pthread_mutex_lock(&map->write_lock);
+    int removed = remove_matching(map, predicate, arg);
+    reclaim(map);
+    pthread_mutex_unlock(&map->write_lock);
+    return removed;
+}
+
+/**
+ * Frees the retired nodes no reader can reach any more. Writers do this as
+ * they go; this lets an idle map release them too. Never waits for readers.
+ */
+void rcu_map_reclaim(RcuMap *map) {
+    pthread_mutex_lock(&map->write_lock);
+    reclaim(map);
+    pthread_mutex_unlock(&map->write_lock);
+}
+
+/**
+ * Waits for a grace period, then frees every node retired before the call.
+ * Must not be called from inside a read section.
+ */
+void rcu_map_drain(RcuMap *map) {
+    rcu_synchronize();
+    rcu_map_reclaim(map);
+}
+
+int rcu_map_count(RcuMap *map) {
+    return __atomic_load_n(&map->count, __ATOMIC_RELAXED);
+}
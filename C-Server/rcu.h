@@ -0,0 +1,48 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define RCU_CACHE_LINE 64
+
+// Map node; immutable once published except for its next pointer
+typedef struct RcuNode {
+    struct RcuNode *next;
+    unsigned long hash;
+    void *value;
+    struct RcuNode *retired_next;
+    unsigned long retired_epoch;
+    char key[];
+} RcuNode;
+
+// Called for a value once no reader can still see it
+typedef void (*RcuFreeFn)(void *value);
+
+// Read-mostly hash map: lookups take no locks and write nothing shared;
+// writers are serialized by a mutex and unlinked nodes are freed after
+// every reader that could have seen them has left its read section
+typedef struct {
+    RcuNode **buckets;
+    size_t mask;
+    pthread_mutex_t write_lock;
+    RcuFreeFn free_value;
+    int count;
+    RcuNode *retired;      // Unlinked nodes waiting for a grace period
+} RcuMap;
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void rcu_synchronize(void);
+
+int rcu_map_init(RcuMap *map, size_t buckets, RcuFreeFn free_value);
+void* rcu_map_lookup(RcuMap *map, const char *key);
+int rcu_map_insert(RcuMap *map, const char *key, void *value);
+int rcu_map_remove(RcuMap *map, const char *key);
+int rcu_map_remove_if(RcuMap *map, int (*predicate)(void *value, void *arg), void *arg);
+void rcu_map_reclaim(RcuMap *map);
+void rcu_map_drain(RcuMap *map);
+int rcu_map_count(RcuMap *map);
+void rcu_map_for_each(RcuMap *map, void (*visit)(const char *key, void *value, void *arg), void *arg);
+
+#endif
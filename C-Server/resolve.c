@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+
+#include "resolve.h"
+#include "rcu.h"
+
+static RcuMap path_map;
+static ResolveStats resolve_stats;
+static int root_fd = -1;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void drop_cached(void *value) {
+    resolve_release(value);
+}
+
+/**
+ * Pins the webroot directory; every lookup is resolved relative to it
+ */
+int resolve_init(const char *webroot) {
+    if (rcu_map_init(&path_map, RESOLVE_BUCKETS, drop_cached) < 0) return -1;
+    root_fd = open(webroot, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    return root_fd < 0 ? -1 : 0;
+}
+
+/**
+ * Turns a request path into a canonical webroot path: the query string is
+ * dropped, percent-escapes are decoded, empty and "." segments are removed
+ * and ".." is applied. Returns -1 for malformed escapes, encoded separators
+ * or NULs, and any path that climbs above the webroot.
+ */
+int canonicalize_path(const char *raw, char *out, size_t out_len) {
+    if (raw[0] != '/' || out_len < 2) return -1;
+
+    size_t len = 0;
+    out[len++] = '/';
+    const char *p = raw;
+
+    while (*p && *p != '?' && *p != '#') {
+        while (*p == '/') p++;
+
+        char segment[RESOLVE_PATH_SIZE];
+        size_t segment_len = 0;
+        while (*p && *p != '/' && *p != '?' && *p != '#') {
+            int c = (unsigned char)*p;
+            if (c == '%') {
+                if (!isxdigit((unsigned char)p[1]) || !isxdigit((unsigned char)p[2])) return -1;
+                char hex[3] = {p[1], p[2], '\0'};
+                c = (int)strtol(hex, NULL, 16);
+                p += 3;
+            } else {
+                p++;
+            }
+            if (c == '\0' || c == '/' || c == '\\') return -1;
+            if (segment_len >= sizeof(segment) - 1) return -1;
+            segment[segment_len++] = (char)c;
+        }
+
+        if (segment_len == 0 || (segment_len == 1 && segment[0] == '.')) continue;
+        if (segment_len == 2 && segment[0] == '.' && segment[1] == '.') {
+            if (len == 1) return -1;
+            while (len > 1 && out[len - 1] != '/') len--;
+            if (len > 1) len--;
+            continue;
+        }
+
+        if (len + 1 + segment_len >= out_len) return -1;
+        if (len > 1) out[len++] = '/';
+        memcpy(out + len, segment, segment_len);
+        len += segment_len;
+    }
+
+    out[len] = '\0';
+    return 0;
+}
+
+/**
+ * Opens a relative canonical path one component at a time, each directory
+ * with O_NOFOLLOW so a symlink anywhere along the path is refused, not
+ * just at its end. Canonical paths hold no "." or "..", so the walk cannot
+ * climb out of the webroot.
+ */
+static int open_walk(const char *relative) {
+    int dir_fd = root_fd;
+    const char *p = relative;
+    const char *slash;
+    while ((slash = strchr(p, '/')) != NULL) {
+        char component[RESOLVE_PATH_SIZE];
+        size_t len = slash - p;
+        if (len >= sizeof(component)) len = sizeof(component) - 1;
+        memcpy(component, p, len);
+        component[len] = '\0';
+
+        int next = openat(dir_fd, component, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dir_fd != root_fd) close(dir_fd);
+        if (next < 0) return -1;
+        dir_fd = next;
+        p = slash + 1;
+    }
+
+    int fd = openat(dir_fd, p, O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOFOLLOW);
+    int saved_errno = errno;
+    if (dir_fd != root_fd) close(dir_fd);
+    errno = saved_errno;
+    return fd;
+}
+
+/**
+ * Opens a canonical path beneath the pinned webroot. openat2() with
+ * RESOLVE_BENEATH makes the kernel refuse symlinks or ".." that would
+ * leave the webroot; on kernels without it, or where a seccomp filter
+ * answers it with EPERM, the path is walked component by component.
+ */
+static int open_beneath(const char *canonical) {
+    const char *relative = canonical[1] ? canonical + 1 : ".";
+    struct open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+
+    int fd = syscall(SYS_openat2, root_fd, relative, &how, sizeof(how));
+    if (fd < 0 && (errno == ENOSYS || errno == EPERM)) {
+        fd = open_walk(relative);
+    }
+    return fd;
+}
+
+static void resolved_free(ResolvedPath *resolved) {
+    if (resolved->fd >= 0) close(resolved->fd);
+    free(resolved);
+}
+
+/**
+ * Drops a reference; the file is closed when the last one goes away
+ */
+void resolve_release(ResolvedPath *resolved) {
+    if (resolved && __atomic_sub_fetch(&resolved->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        resolved_free(resolved);
+    }
+}
+
+static int is_expired(void *value, void *arg) {
+    return *(long long*)arg >= ((ResolvedPath*)value)->expires_ms;
+}
+
+/**
+ * Resolves a canonical path (see canonicalize_path) to an open file, its
+ * stat and MIME type. Results, including failures, are cached for
+ * RESOLVE_TTL_MS in a lock-free map. The caller must resolve_release() the
+ * result.
+ */
+ResolvedPath* resolve_path(const char *canonical) {
+    if (root_fd < 0) return NULL;
+    long long now = now_ms();
+
+    // The cache's own reference keeps the entry alive for the whole read
+    // section, so taking another one here cannot race with its release
+    rcu_read_lock();
+    ResolvedPath *entry = rcu_map_lookup(&path_map, canonical);
+    if (entry && now < entry->expires_ms) {
+        __atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+        rcu_read_unlock();
+        __atomic_add_fetch(&resolve_stats.hits, 1, __ATOMIC_RELAXED);
+        return entry;
+    }
+    rcu_read_unlock();
+    __atomic_add_fetch(&resolve_stats.misses, 1, __ATOMIC_RELAXED);
+
+    ResolvedPath *resolved = calloc(1, sizeof(ResolvedPath));
+    if (!resolved) return NULL;
+    snprintf(resolved->path, sizeof(resolved->path), "%s", canonical);
+    resolved->refs = 1;
+    resolved->fd = open_beneath(canonical);
+    if (resolved->fd < 0) {
+        resolved->error = errno;
+    } else if (fstat(resolved->fd, &resolved->st) < 0) {
+        resolved->error = errno;
+        close(resolved->fd);
+        resolved->fd = -1;
+    }
+    resolved->mime_type = get_mime_type(canonical);
+    resolved->expires_ms = now + RESOLVE_TTL_MS;
+
+    // When the cache is full the result is still returned, just not kept
+    if (rcu_map_count(&path_map) >= RESOLVE_MAX_ENTRIES) {
+        rcu_map_remove_if(&path_map, is_expired, &now);
+    }
+    if (rcu_map_count(&path_map) < RESOLVE_MAX_ENTRIES) {
+        resolved->refs++;
+        if (rcu_map_insert(&path_map, canonical, resolved) < 0) resolved->refs--;
+    }
+    return resolved;
+}
+
+/**
+ * Copies the current path cache counters
+ */
+void resolve_get_stats(ResolveStats *stats) {
+    stats->hits = __atomic_load_n(&resolve_stats.hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&resolve_stats.misses, __ATOMIC_RELAXED);
+    stats->entries = rcu_map_count(&path_map);
+}
+
+// Adapts rcu_map_for_each to resolve_for_each's visitor
+typedef struct {
+    void (*visit)(const ResolvedPath *resolved, long long expires_in_ms, void *arg);
+    void *arg;
+    long long now;
+} ResolveVisit;
+
+static void visit_entry(const char *key, void *value, void *arg) {
+    ResolveVisit *walk = arg;
+    const ResolvedPath *resolved = value;
+    (void)key;
+    walk->visit(resolved, resolved->expires_ms - walk->now, walk->arg);
+}
+
+/**
+ * Walks the path cache without blocking lookups or inserts
+ */
+void resolve_for_each(void (*visit)(const ResolvedPath *resolved, long long expires_in_ms, void *arg), void *arg) {
+    if (!path_map.buckets) return;
+    ResolveVisit walk = { visit, arg, now_ms() };
+    rcu_read_lock();
+    rcu_map_for_each(&path_map, visit_entry, &walk);
+    rcu_read_unlock();
+}
+
+static int match_all(void *value, void *arg) {
+    (void)value;
+    (void)arg;
+    return 1;
+}
+
+/**
+ * Drops every cached resolution and waits out the grace period, so the
+ * cache's descriptors are closed on return; in-flight readers keep theirs
+ * until they release them. Returns the number of entries dropped.
+ */
+int resolve_purge(void) {
+    if (!path_map.buckets) return 0;
+    int removed = rcu_map_remove_if(&path_map, match_all, NULL);
+    rcu_map_drain(&path_map);
+    return removed;
+}
+
+/**
+ * Drops expired entries and frees retired ones, closing their files, at
+ * most once per RESOLVE_MAINTAIN_MS. Called by the accept loop, so files
+ * are released even when no lookup or insert comes along to do it.
+ */
+void resolve_maintain(void) {
+    static long long next_run_ms = 0;
+    if (!path_map.buckets) return;
+    long long now = now_ms();
+    if (now < next_run_ms) return;
+    next_run_ms = now + RESOLVE_MAINTAIN_MS;
+    rcu_map_remove_if(&path_map, is_expired, &now);
+}
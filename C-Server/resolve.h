@@ -0,0 +1,41 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include <sys/stat.h>
+#include "Http_server.h"
+
+#define RESOLVE_BUCKETS 1024
+#define RESOLVE_MAX_ENTRIES 512   // Positive entries keep their file open
+#define RESOLVE_TTL_MS 2000       // How long a resolution is trusted before it is redone
+#define RESOLVE_PATH_SIZE 256
+#define RESOLVE_MAINTAIN_MS 1000  // Period of the sweep that closes expired and retired entries' files
+
+// Result of resolving a canonical path under the webroot, shared by
+// readers through a reference count
+typedef struct {
+    char path[RESOLVE_PATH_SIZE];
+    int refs;
+    int fd;                 // Open file, or -1 when resolution failed
+    int error;              // errno of the failed resolution
+    struct stat st;
+    const char *mime_type;
+    long long expires_ms;
+} ResolvedPath;
+
+// Path cache counters
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    int entries;
+} ResolveStats;
+
+int resolve_init(const char *webroot);
+int canonicalize_path(const char *raw, char *out, size_t out_len);
+ResolvedPath* resolve_path(const char *canonical);
+void resolve_release(ResolvedPath *resolved);
+void resolve_get_stats(ResolveStats *stats);
+void resolve_for_each(void (*visit)(const ResolvedPath *resolved, long long expires_in_ms, void *arg), void *arg);
+int resolve_purge(void);
+void resolve_maintain(void);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "template.h"
+#include "assets.h"
+
+/**
+ * Reads a template, from the copy compiled into the binary when there is
+ * one and from the webroot otherwise. Returns a NUL-terminated copy.
+ */
+static char *read_source(const char *name) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", TEMPLATE_DIR, name);
+
+    const EmbeddedAsset *asset = asset_lookup(path);
+    if (asset) {
+        char *source = malloc(asset->len + 1);
+        if (!source) return NULL;
+        memcpy(source, asset->data, asset->len);
+        source[asset->len] = '\0';
+        return source;
+    }
+
+    char file_path[512];
+    snprintf(file_path, sizeof(file_path), "%s%s", WEBROOT, path);
+    FILE *fp = fopen(file_path, "rb");
+    if (!fp) return NULL;
+    ByteBuffer buffer = {NULL, 0, 0};
+    char chunk[BUFFER_SIZE];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        if (buffer_append(&buffer, chunk, n) < 0) break;
+    }
+    int failed = ferror(fp) || buffer_append(&buffer, "", 1) < 0;
+    fclose(fp);
+    if (failed) {
+        buffer_free(&buffer);
+        return NULL;
+    }
+    return buffer.data;
+}
+
+static int add_segment(Template *tmpl, SegmentType type, int field, const char *data, size_t len) {
+    if (type == SEGMENT_STATIC && len == 0) return 0;
+    if (tmpl->segment_count == TEMPLATE_MAX_SEGMENTS) return -1;
+    TemplateSegment *segment = &tmpl->segments[tmpl->segment_count++];
+    segment->type = type;
+    segment->field = field;
+    segment->data = data;
+    segment->len = len;
+    if (type == SEGMENT_STATIC) tmpl->static_len += len;
+    return 0;
+}
+
+/**
+ * Splits the source into static chunks and placeholders. Returns NULL
+ * after printing the reason if the template cannot be used.
+ */
+static Template *compile(const char *name, char *source, const char *const *fields, int field_count) {
+    Template *tmpl = calloc(1, sizeof(Template));
+    if (!tmpl) return NULL;
+    snprintf(tmpl->name, sizeof(tmpl->name), "%s", name);
+    tmpl->source = source;
+    tmpl->field_count = field_count;
+
+    const char *text = source;
+    const char *open;
+    while ((open = strstr(text, "{{")) != NULL) {
+        const char *close = strstr(open + 2, "}}");
+        if (!close) {
+            fprintf(stderr, "Template %s: unterminated placeholder\n", name);
+            goto fail;
+        }
+
+        // {{ field }} or {{ field|html }}
+        const char *start = open + 2;
+        const char *end = close;
+        while (start < end && *start == ' ') start++;
+        while (end > start && end[-1] == ' ') end--;
+        const char *bar = memchr(start, '|', end - start);
+        SegmentType type = SEGMENT_TEXT;
+        if (bar) {
+            if (end - bar - 1 != 4 || strncmp(bar + 1, "html", 4) != 0) {
+                fprintf(stderr, "Template %s: unknown modifier in %.*s\n", name, (int)(close - open + 2), open);
+                goto fail;
+            }
+            type = SEGMENT_HTML;
+            end = bar;
+        }
+
+        int field = -1;
+        for (int i = 0; i < field_count; i++) {
+            if (strlen(fields[i]) == (size_t)(end - start) && strncmp(fields[i], start, end - start) == 0) {
+                field = i;
+                break;
+            }
+        }
+        if (field < 0) {
+            fprintf(stderr, "Template %s: unknown field %.*s\n", name, (int)(end - start), start);
+            goto fail;
+        }
+
+        if (add_segment(tmpl, SEGMENT_STATIC, -1, text, open - text) < 0 ||
+            add_segment(tmpl, type, field, NULL, 0) < 0) {
+            fprintf(stderr, "Template %s: more than %d segments\n", name, TEMPLATE_MAX_SEGMENTS);
+            goto fail;
+        }
+        text = close + 2;
+    }
+    if (add_segment(tmpl, SEGMENT_STATIC, -1, text, strlen(text)) < 0) {
+        fprintf(stderr, "Template %s: more than %d segments\n", name, TEMPLATE_MAX_SEGMENTS);
+        goto fail;
+    }
+    return tmpl;
+
+fail:
+    free(tmpl);
+    return NULL;
+}
+
+/**
+ * Loads and compiles TEMPLATE_DIR/name from the webroot. fields names the
+ * values the handler supplies, by index. Returns NULL after printing the
+ * reason if the template is missing or malformed.
+ */
+Template *template_load(const char *name, const char *const *fields, int field_count) {
+    if (field_count > TEMPLATE_MAX_FIELDS) return NULL;
+    char *source = read_source(name);
+    if (!source) {
+        fprintf(stderr, "Template %s: not found under %s%s\n", name, WEBROOT, TEMPLATE_DIR);
+        return NULL;
+    }
+    Template *tmpl = compile(name, source, fields, field_count);
+    if (!tmpl) free(source);
+    return tmpl;
+}
+
+void template_free(Template *tmpl) {
+    if (!tmpl) return;
+    free(tmpl->source);
+    free(tmpl);
+}
+
+void template_begin(TemplateRender *render, const Template *tmpl) {
+    render->tmpl = tmpl;
+    memset(render->values, 0, sizeof(render->values[0]) * tmpl->field_count);
+    render->escaped.data = NULL;
+    render->escaped.len = render->escaped.cap = 0;
+}
+
+/**
+ * Sets a field to a string, which must outlive template_send()
+ */
+void template_set(TemplateRender *render, int field, const char *value) {
+    render->values[field] = value;
+}
+
+/**
+ * Sets a field to a number, formatted into the render's own storage
+ */
+void template_set_ulong(TemplateRender *render, int field, unsigned long long value) {
+    char *end = render->numbers[field] + TEMPLATE_NUMBER_SIZE - 1;
+    char *p = end;
+    *p = '\0';
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    render->values[field] = p;
+}
+
+/**
+ * Escaped form of a markup character, or NULL if it needs none
+ */
+static const char *escape_char(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        case '\'': return "&#39;";
+        default: return NULL;
+    }
+}
+
+/**
+ * Appends the escaped value to the render's buffer. Returns 0 if the value
+ * has nothing to escape (and was not copied), 1 if it was, -1 on failure.
+ */
+static int escape_value(TemplateRender *render, const char *value) {
+    const char *p = value + strcspn(value, "&<>\"'");
+    if (!*p) return 0;
+
+    const char *run = value;
+    for (; *p; p++) {
+        const char *entity = escape_char(*p);
+        if (!entity) continue;
+        if (buffer_append(&render->escaped, run, p - run) < 0 ||
+            buffer_append(&render->escaped, entity, strlen(entity)) < 0) {
+            return -1;
+        }
+        run = p + 1;
+    }
+    return buffer_append(&render->escaped, run, p - run) < 0 ? -1 : 1;
+}
+
+/**
+ * Sends the response header and the page as one scatter list: static
+ * chunks straight from the compiled template and each placeholder from
+ * its value, escaped only if it contains markup characters. Returns the
+ * body length and releases the render.
+ */
+size_t template_send(Connection *conn, TemplateRender *render, int status_code, int head_only) {
+    const Template *tmpl = render->tmpl;
+    struct iovec iov[TEMPLATE_MAX_SEGMENTS];
+    size_t escaped_at[TEMPLATE_MAX_SEGMENTS];
+    size_t total = tmpl->static_len;
+
+    // Escape first: the buffer may move while it grows, so the scatter list
+    // records offsets into it until every value is in
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        const TemplateSegment *segment = &tmpl->segments[i];
+        if (segment->type == SEGMENT_STATIC) {
+            iov[i].iov_base = (void *)segment->data;
+            iov[i].iov_len = segment->len;
+            continue;
+        }
+        const char *value = render->values[segment->field] ? render->values[segment->field] : "";
+        size_t start = render->escaped.len;
+        int escaped = segment->type == SEGMENT_TEXT ? escape_value(render, value) : 0;
+        if (escaped < 0) {
+            // Out of memory: an empty slot beats sending markup unescaped
+            value = "";
+            escaped = 0;
+        }
+        escaped_at[i] = escaped ? start : (size_t)-1;
+        iov[i].iov_base = (void *)value;
+        iov[i].iov_len = escaped ? render->escaped.len - start : strlen(value);
+        total += iov[i].iov_len;
+    }
+    for (int i = 0; i < tmpl->segment_count; i++) {
+        if (tmpl->segments[i].type != SEGMENT_STATIC && escaped_at[i] != (size_t)-1) {
+            iov[i].iov_base = render->escaped.data + escaped_at[i];
+        }
+    }
+
+    send_response_header(conn, status_code, "text/html", total);
+    if (!head_only) conn_sendv(conn, iov, tmpl->segment_count);
+    buffer_free(&render->escaped);
+    return total;
+}
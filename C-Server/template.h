@@ -0,0 +1,56 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+#include "Http_server.h"
+
+#define TEMPLATE_DIR "/templates"     // Under the webroot; never served as static files
+#define TEMPLATE_MAX_SEGMENTS 192     // Static chunks plus placeholders per template
+#define TEMPLATE_MAX_FIELDS 64        // Distinct fields a handler may fill
+#define TEMPLATE_NUMBER_SIZE 24       // Formatted integer, including the terminator
+
+/*
+ * Templates are HTML files with {{field}} placeholders, replaced by the
+ * HTML-escaped value, and {{field|html}} ones, inserted as they are for
+ * markup the handler built itself. Each file is compiled once at startup
+ * against the handler's list of field names, so a placeholder naming an
+ * unknown field fails the start rather than a request.
+ */
+typedef enum {
+    SEGMENT_STATIC = 0,
+    SEGMENT_TEXT,     // Escaped field
+    SEGMENT_HTML      // Field inserted as is
+} SegmentType;
+
+typedef struct {
+    SegmentType type;
+    int field;            // Index into the handler's field list, for placeholders
+    const char *data;     // Static text, pointing into the template source
+    size_t len;
+} TemplateSegment;
+
+typedef struct {
+    char name[64];
+    char *source;         // The file's contents, owned by the template
+    int field_count;
+    size_t static_len;    // Bytes of static text, the floor of Content-Length
+    int segment_count;
+    TemplateSegment segments[TEMPLATE_MAX_SEGMENTS];
+} Template;
+
+// Values for one rendering, filled by field index. Unset fields render empty.
+typedef struct {
+    const Template *tmpl;
+    const char *values[TEMPLATE_MAX_FIELDS];
+    char numbers[TEMPLATE_MAX_FIELDS][TEMPLATE_NUMBER_SIZE];
+    ByteBuffer escaped;   // Escaped copies of the values that needed them
+} TemplateRender;
+
+Template *template_load(const char *name, const char *const *fields, int field_count);
+void template_free(Template *tmpl);
+void template_begin(TemplateRender *render, const Template *tmpl);
+void template_set(TemplateRender *render, int field, const char *value);
+void template_set_ulong(TemplateRender *render, int field, unsigned long long value);
+size_t template_send(Connection *conn, TemplateRender *render, int status_code, int head_only);
+
+#endif
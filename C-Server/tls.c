@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "tls.h"
+
+static SSL_CTX *tls_ctx = NULL;
+static TlsStats tls_stats;
+
+// ALPN protocols we accept, in wire format and order of preference
+static const unsigned char alpn_protocols[] = {
+    2, 'h', '2',
+    8, 'h', 't', 't', 'p', '/', '1', '.', '1'
+};
+
+/**
+ * Picks the ALPN protocol for a connection from the client's offer
+ */
+static int select_alpn(SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                       const unsigned char *in, unsigned int inlen, void *arg) {
+    (void)ssl;
+    (void)arg;
+    unsigned char *selected;
+    if (SSL_select_next_proto(&selected, outlen, alpn_protocols, sizeof(alpn_protocols),
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+/**
+ * Creates the server TLS context: certificate, session resumption, ALPN and kTLS
+ */
+int tls_init(const char *cert_file, const char *key_file) {
+    tls_ctx = SSL_CTX_new(TLS_server_method());
+    if (!tls_ctx) return -1;
+
+    SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+
+    if (SSL_CTX_use_certificate_chain_file(tls_ctx, cert_file) != 1 ||
+        SSL_CTX_use_PrivateKey_file(tls_ctx, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(tls_ctx) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(tls_ctx);
+        tls_ctx = NULL;
+        return -1;
+    }
+
+    // Resumption: server-side session cache for session IDs, plus stateless
+    // tickets (enabled by default, keys rotated by OpenSSL)
+    static const unsigned char session_context[] = SERVER_VERSION;
+    SSL_CTX_set_session_id_context(tls_ctx, session_context, sizeof(session_context) - 1);
+    SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(tls_ctx, TLS_SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(tls_ctx, TLS_SESSION_TIMEOUT);
+
+    // Hand record encryption to the kernel when it supports it, so file
+    // bodies can still go out through sendfile
+    SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS);
+
+    SSL_CTX_set_alpn_select_cb(tls_ctx, select_alpn, NULL);
+    return 0;
+}
+
+int tls_enabled(void) {
+    return tls_ctx != NULL;
+}
+
+/**
+ * Attaches a new TLS session to an accepted socket (handshake happens later)
+ */
+int tls_new_session(Connection *conn) {
+    conn->ssl = SSL_new(tls_ctx);
+    if (!conn->ssl) return -1;
+    SSL_set_fd(conn->ssl, conn->fd);
+    return 0;
+}
+
+/**
+ * Waits for the socket after an SSL call on a non-blocking socket could not
+ * make progress. Returns -1 for real errors and timeouts.
+ */
+static int wait_for_ssl(Connection *conn, int result) {
+    int error = SSL_get_error(conn->ssl, result);
+    if (error == SSL_ERROR_WANT_READ) return conn_wait(conn, POLLIN);
+    if (error == SSL_ERROR_WANT_WRITE) return conn_wait(conn, POLLOUT);
+    return -1;
+}
+
+/**
+ * Runs the server side of the handshake on the connection's thread
+ */
+int tls_handshake(Connection *conn) {
+    struct timeval tv = { TLS_HANDSHAKE_TIMEOUT, 0 };
+    struct timeval saved = { 0, 0 };
+    socklen_t saved_len = sizeof(saved);
+    getsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &saved, &saved_len);
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int result;
+    while ((result = SSL_accept(conn->ssl)) != 1 && wait_for_ssl(conn, result) == 0);
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &saved, sizeof(saved));
+
+    if (result != 1) {
+        __atomic_add_fetch(&tls_stats.failures, 1, __ATOMIC_RELAXED);
+        ERR_clear_error();
+        return -1;
+    }
+
+    __atomic_add_fetch(&tls_stats.handshakes, 1, __ATOMIC_RELAXED);
+    if (SSL_session_reused(conn->ssl)) {
+        __atomic_add_fetch(&tls_stats.resumed, 1, __ATOMIC_RELAXED);
+    }
+    if (BIO_get_ktls_send(SSL_get_wbio(conn->ssl))) {
+        __atomic_add_fetch(&tls_stats.ktls_send, 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/**
+ * Returns 1 if the handshake negotiated the given ALPN protocol
+ */
+int tls_alpn_selected(Connection *conn, const char *protocol) {
+    const unsigned char *selected;
+    unsigned int len;
+    SSL_get0_alpn_selected(conn->ssl, &selected, &len);
+    return selected && len == strlen(protocol) && memcmp(selected, protocol, len) == 0;
+}
+
+/**
+ * Sends close_notify and frees the session
+ */
+void tls_close(Connection *conn) {
+    if (!conn->ssl) return;
+    if (SSL_is_init_finished(conn->ssl)) SSL_shutdown(conn->ssl);
+    SSL_free(conn->ssl);
+    conn->ssl = NULL;
+}
+
+/**
+ * Returns the number of decrypted bytes buffered in the TLS session,
+ * which poll() on the socket cannot see
+ */
+int tls_pending(Connection *conn) {
+    return conn->ssl ? SSL_pending(conn->ssl) : 0;
+}
+
+int tls_send(Connection *conn, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        int written = SSL_write(conn->ssl, p, len > INT32_MAX ? INT32_MAX : (int)len);
+        if (written <= 0) {
+            if (wait_for_ssl(conn, written) == 0) continue;
+            ERR_clear_error();
+            return -1;
+        }
+        p += written;
+        len -= written;
+    }
+    return 0;
+}
+
+ssize_t tls_recv(Connection *conn, void *buf, size_t len) {
+    int n;
+    int error;
+    while (1) {
+        n = SSL_read(conn->ssl, buf, len > INT32_MAX ? INT32_MAX : (int)len);
+        if (n > 0) return n;
+        error = SSL_get_error(conn->ssl, n);
+        if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) break;
+        if (conn_wait(conn, error == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT) < 0) {
+            // Timed out: report it the way a blocking recv() would
+            ERR_clear_error();
+            return -1;
+        }
+    }
+
+    ERR_clear_error();
+    if (error == SSL_ERROR_ZERO_RETURN) return 0;
+    if (error != SSL_ERROR_SYSCALL || errno == 0) errno = ECONNRESET;
+    return -1;
+}
+
+/**
+ * Whether the kernel encrypts this connection's outgoing records
+ */
+int tls_ktls_send(Connection *conn) {
+    return BIO_get_ktls_send(SSL_get_wbio(conn->ssl)) ? 1 : 0;
+}
+
+/**
+ * Sends a file range over TLS: with kTLS the kernel encrypts sendfile()
+ * output, otherwise the file is read and encrypted in user space
+ */
+int tls_sendfile(Connection *conn, int file_fd, off_t offset, size_t count) {
+    if (tls_ktls_send(conn)) {
+        while (count > 0) {
+            ossl_ssize_t sent = SSL_sendfile(conn->ssl, file_fd, offset, count, 0);
+            if (sent <= 0) {
+                if (wait_for_ssl(conn, (int)sent) == 0) continue;
+                ERR_clear_error();
+                return -1;
+            }
+            offset += sent;
+            count -= sent;
+        }
+        return 0;
+    }
+
+    char buffer[BUFFER_SIZE * 4];
+    while (count > 0) {
+        ssize_t n = pread(file_fd, buffer, count < sizeof(buffer) ? count : sizeof(buffer), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        if (tls_send(conn, buffer, n) < 0) return -1;
+        offset += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/**
+ * Copies the current TLS counters
+ */
+void tls_get_stats(TlsStats *stats) {
+    stats->handshakes = __atomic_load_n(&tls_stats.handshakes, __ATOMIC_RELAXED);
+    stats->resumed = __atomic_load_n(&tls_stats.resumed, __ATOMIC_RELAXED);
+    stats->ktls_send = __atomic_load_n(&tls_stats.ktls_send, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&tls_stats.failures, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,32 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <sys/types.h>
+#include "Http_server.h"
+
+#define TLS_SESSION_CACHE_SIZE 20480  // Sessions kept for ID-based resumption
+#define TLS_SESSION_TIMEOUT 300       // Seconds a session (or ticket) stays resumable
+#define TLS_HANDSHAKE_TIMEOUT 10
+
+// TLS counters
+typedef struct {
+    unsigned long handshakes;
+    unsigned long resumed;
+    unsigned long ktls_send;  // Connections whose send path was offloaded to the kernel
+    unsigned long failures;
+} TlsStats;
+
+int tls_init(const char *cert_file, const char *key_file);
+int tls_enabled(void);
+int tls_new_session(Connection *conn);
+int tls_handshake(Connection *conn);
+int tls_alpn_selected(Connection *conn, const char *protocol);
+void tls_close(Connection *conn);
+int tls_pending(Connection *conn);
+int tls_send(Connection *conn, const void *data, size_t len);
+ssize_t tls_recv(Connection *conn, void *buf, size_t len);
+int tls_ktls_send(Connection *conn);
+int tls_sendfile(Connection *conn, int file_fd, off_t offset, size_t count);
+void tls_get_stats(TlsStats *stats);
+
+#endif
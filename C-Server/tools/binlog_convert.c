@@ -0,0 +1,218 @@
+/**
+ * Converter for binary access log segments (see binlog.h).
+ *
+ * Usage: binlog_convert [-f clf|combined|json] segment.blog...
+ *
+ * Records are printed in Common Log Format (the default), Combined Log
+ * Format or as one JSON object per line. Each segment's path table is read
+ * from the paths-<start>-<pid>.idx file next to it. The binary format keeps
+ * no protocol version, referer or user agent, so those are printed as "-"
+ * in Combined output and the request line has no protocol field.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../binlog.h"
+
+typedef enum {
+    FORMAT_CLF,
+    FORMAT_COMBINED,
+    FORMAT_JSON
+} OutputFormat;
+
+// Path table of one server run
+typedef struct {
+    long long run_started;
+    int pid;
+    char **paths;      // Indexed by path id
+    uint32_t count;
+} PathTable;
+
+static void free_paths(PathTable *table) {
+    for (uint32_t i = 0; i < table->count; i++) free(table->paths[i]);
+    free(table->paths);
+    memset(table, 0, sizeof(*table));
+}
+
+/**
+ * Loads the path table that belongs to a segment's run
+ */
+static void load_paths(PathTable *table, const char *segment_file, const BinlogHeader *header) {
+    if (table->paths && table->run_started == header->run_started && table->pid == header->pid) return;
+    free_paths(table);
+    table->run_started = header->run_started;
+    table->pid = header->pid;
+
+    char name[1024];
+    const char *slash = strrchr(segment_file, '/');
+    int dir_len = slash ? (int)(slash - segment_file) : 1;
+    snprintf(name, sizeof(name), "%.*s/paths-%010lld-%d.idx", dir_len, slash ? segment_file : ".",
+             (long long)header->run_started, (int)header->pid);
+
+    FILE *fp = fopen(name, "r");
+    if (!fp) {
+        fprintf(stderr, "%s: no path table, paths are printed as ids\n", name);
+        return;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        char *space = strchr(line, ' ');
+        if (!space) continue;
+        *space = '\0';
+        unsigned long id = strtoul(line, NULL, 10);
+        if (id == 0 || id > BINLOG_MAX_PATHS) continue;
+        if (id >= table->count) {
+            char **grown = realloc(table->paths, (id + 1) * sizeof(char*));
+            if (!grown) break;
+            memset(grown + table->count, 0, (id + 1 - table->count) * sizeof(char*));
+            table->paths = grown;
+            table->count = id + 1;
+        }
+        space[1 + strcspn(space + 1, "\n")] = '\0';
+        free(table->paths[id]);
+        table->paths[id] = strdup(space + 1);
+    }
+    fclose(fp);
+}
+
+/**
+ * Prints a string as a quoted JSON string
+ */
+static void print_json_string(const char *value) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char*)value; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+static void print_record(const BinlogRecord *record, const PathTable *table, OutputFormat format) {
+    char ip[INET6_ADDRSTRLEN] = "-";
+    if (record->family == 4) {
+        inet_ntop(AF_INET, record->ip, ip, sizeof(ip));
+    } else if (record->family == 6) {
+        inet_ntop(AF_INET6, record->ip, ip, sizeof(ip));
+    } else if (record->family == BINLOG_FAMILY_UNIX) {
+        uint32_t peer[2];
+        memcpy(peer, record->ip, sizeof(peer));
+        snprintf(ip, sizeof(ip), "unix:pid=%u,uid=%u", peer[0], peer[1]);
+    }
+
+    char path_buf[32];
+    const char *path = record->path_id < table->count ? table->paths[record->path_id] : NULL;
+    if (!path) {
+        snprintf(path_buf, sizeof(path_buf), record->path_id ? "#%u" : "(other)", record->path_id);
+        path = path_buf;
+    }
+    const char *method = record->method < BINLOG_METHOD_COUNT ? binlog_method_names[record->method] : "-";
+
+    time_t seconds = (time_t)(record->timestamp_ns / 1000000000ULL);
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    char when[64];
+
+    if (format == FORMAT_JSON) {
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+        printf("{\"time\":\"%s.%06u", when, (unsigned)(record->timestamp_ns % 1000000000ULL / 1000));
+        strftime(when, sizeof(when), "%z", &tm);
+        printf("%s\",\"ip\":\"%s\",\"method\":\"%s\",\"path\":", when, ip, method);
+        print_json_string(path);
+        printf(",\"status\":%u,\"bytes\":%llu,\"latency_us\":%u}\n",
+               record->status, (unsigned long long)record->bytes, record->latency_us);
+        return;
+    }
+
+    strftime(when, sizeof(when), "%d/%b/%Y:%H:%M:%S %z", &tm);
+    printf("%s - - [%s] \"%s %s\" %u ", ip, when, method, path, record->status);
+    if (record->bytes) {
+        printf("%llu", (unsigned long long)record->bytes);
+    } else {
+        putchar('-');
+    }
+    printf(format == FORMAT_COMBINED ? " \"-\" \"-\"\n" : "\n");
+}
+
+/**
+ * Prints every written record of one segment file
+ */
+static int convert_segment(const char *file, PathTable *table, OutputFormat format) {
+    int fd = open(file, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(BinlogHeader)) {
+        fprintf(stderr, "%s: cannot read segment\n", file);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: cannot map segment\n", file);
+        return -1;
+    }
+
+    const BinlogHeader *header = map;
+    if (memcmp(header->magic, BINLOG_MAGIC, sizeof(BINLOG_MAGIC)) != 0 ||
+        header->version != BINLOG_VERSION || header->record_size != sizeof(BinlogRecord)) {
+        fprintf(stderr, "%s: not a version %d binary log segment\n", file, BINLOG_VERSION);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    load_paths(table, file, header);
+    size_t available = (st.st_size - sizeof(BinlogHeader)) / sizeof(BinlogRecord);
+    size_t count = header->capacity < available ? header->capacity : available;
+    const BinlogRecord *records = (const BinlogRecord*)((const char*)map + sizeof(BinlogHeader));
+    for (size_t i = 0; i < count; i++) {
+        // Slots are claimed in order but filled concurrently, so an empty
+        // slot does not mean the rest of the segment is empty
+        if (records[i].timestamp_ns) print_record(&records[i], table, format);
+    }
+
+    munmap(map, st.st_size);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    OutputFormat format = FORMAT_CLF;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt == 'f' && strcmp(optarg, "clf") == 0) {
+            format = FORMAT_CLF;
+        } else if (opt == 'f' && strcmp(optarg, "combined") == 0) {
+            format = FORMAT_COMBINED;
+        } else if (opt == 'f' && strcmp(optarg, "json") == 0) {
+            format = FORMAT_JSON;
+        } else {
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-f clf|combined|json] segment.blog...\n", argv[0]);
+        return 1;
+    }
+
+    PathTable table;
+    memset(&table, 0, sizeof(table));
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        if (convert_segment(argv[i], &table, format) < 0) status = 1;
+    }
+    free_paths(&table);
+    return status;
+}
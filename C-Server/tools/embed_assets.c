@@ -0,0 +1,202 @@
+/**
+ * Build-time generator for the embedded asset table.
+ *
+ * Usage: embed_assets <webroot> <file>... > assets_data.c
+ *
+ * Each file is emitted as a byte array together with a gzip variant (when
+ * it is smaller), ETags derived from its contents (the gzip variant's with
+ * a "-gz" suffix, since its bytes differ) and its MIME type. The
+ * table is sorted by request path so asset_lookup() can binary-search it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "../Http_server.h"
+
+typedef struct {
+    char path[256];
+    unsigned char *data;
+    size_t len;
+    unsigned char *gzip_data;
+    size_t gzip_len;
+    uint64_t hash;
+} Asset;
+
+static unsigned char* read_file(const char *file, size_t *len) {
+    FILE *fp = fopen(file, "rb");
+    if (!fp) return NULL;
+
+    size_t cap = 4096;
+    unsigned char *data = malloc(cap);
+    *len = 0;
+    size_t n;
+    while (data && (n = fread(data + *len, 1, cap - *len, fp)) > 0) {
+        *len += n;
+        if (*len == cap) {
+            unsigned char *grown = realloc(data, cap * 2);
+            if (!grown) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            cap *= 2;
+        }
+    }
+    fclose(fp);
+    return data;
+}
+
+/**
+ * Compresses data as a gzip stream at the best compression level
+ */
+static unsigned char* gzip_data(const unsigned char *data, size_t len, size_t *out_len) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+
+    size_t cap = deflateBound(&stream, len) + 32;
+    unsigned char *out = malloc(cap);
+    if (!out) {
+        deflateEnd(&stream);
+        return NULL;
+    }
+    stream.next_in = (unsigned char*)data;
+    stream.avail_in = len;
+    stream.next_out = out;
+    stream.avail_out = cap;
+    int result = deflate(&stream, Z_FINISH);
+    *out_len = stream.total_out;
+    deflateEnd(&stream);
+
+    if (result != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * FNV-1a (64-bit) over the file contents, used as the ETag
+ */
+static uint64_t hash_data(const unsigned char *data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void print_array(const char *name, const unsigned char *data, size_t len) {
+    printf("static const unsigned char %s[] = {", name);
+    for (size_t i = 0; i < len; i++) {
+        printf("%s0x%02x,", i % 16 == 0 ? "\n    " : " ", data[i]);
+    }
+    // An empty file still needs a non-empty initializer in C99
+    if (len == 0) printf("0");
+    printf("\n};\n\n");
+}
+
+/**
+ * Prints a string as a C literal, escaping quotes, backslashes and control
+ * characters so any file name survives
+ */
+static void print_string(const char *text) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        } else if (*p < 0x20 || *p == 0x7f || *p == '?') {
+            // Octal escapes, always three digits; '?' cannot form a trigraph
+            printf("\\%03o", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+static int compare_path(const void *a, const void *b) {
+    return strcmp(((const Asset*)a)->path, ((const Asset*)b)->path);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <webroot> <file>...\n", argv[0]);
+        return 1;
+    }
+
+    const char *webroot = argv[1];
+    size_t root_len = strlen(webroot);
+    while (root_len > 0 && webroot[root_len - 1] == '/') root_len--;
+
+    int count = argc - 2;
+    Asset *assets = calloc(count > 0 ? count : 1, sizeof(Asset));
+    if (!assets) return 1;
+
+    for (int i = 0; i < count; i++) {
+        const char *file = argv[i + 2];
+        if (strncmp(file, webroot, root_len) != 0 || file[root_len] != '/') {
+            fprintf(stderr, "%s is not under %s\n", file, webroot);
+            return 1;
+        }
+        snprintf(assets[i].path, sizeof(assets[i].path), "%s", file + root_len);
+
+        assets[i].data = read_file(file, &assets[i].len);
+        if (!assets[i].data) {
+            perror(file);
+            return 1;
+        }
+        assets[i].hash = hash_data(assets[i].data, assets[i].len);
+
+        assets[i].gzip_data = gzip_data(assets[i].data, assets[i].len, &assets[i].gzip_len);
+        if (assets[i].gzip_data && assets[i].gzip_len >= assets[i].len) {
+            free(assets[i].gzip_data);
+            assets[i].gzip_data = NULL;
+        }
+    }
+    qsort(assets, count, sizeof(Asset), compare_path);
+
+    printf("// Generated by tools/embed_assets from %.*s/ - do not edit\n\n", (int)root_len, webroot);
+    printf("#include \"assets.h\"\n\n");
+
+    char name[64];
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "asset_%d", i);
+        print_array(name, assets[i].data, assets[i].len);
+        if (assets[i].gzip_data) {
+            snprintf(name, sizeof(name), "asset_%d_gzip", i);
+            print_array(name, assets[i].gzip_data, assets[i].gzip_len);
+        }
+    }
+
+    printf("const EmbeddedAsset embedded_assets[] = {\n");
+    for (int i = 0; i < count; i++) {
+        printf("    {");
+        print_string(assets[i].path);
+        printf(", asset_%d, %zu, ", i, assets[i].len);
+        if (assets[i].gzip_data) {
+            printf("asset_%d_gzip, %zu, ", i, assets[i].gzip_len);
+        } else {
+            printf("NULL, 0, ");
+        }
+        printf("\"\\\"%016llx\\\"\", ", (unsigned long long)assets[i].hash);
+        if (assets[i].gzip_data) {
+            printf("\"\\\"%016llx-gz\\\"\", ", (unsigned long long)assets[i].hash);
+        } else {
+            printf("NULL, ");
+        }
+        print_string(get_mime_type(assets[i].path));
+        printf("},\n");
+    }
+    if (count == 0) printf("    {\"\", NULL, 0, NULL, 0, \"\", NULL, \"\"}\n");
+    printf("};\n\n");
+    printf("const size_t embedded_asset_count = %d;\n", count);
+    return 0;
+}
@@ -0,0 +1,339 @@
+/**
+ * Replays an access.log (the text format written by log_request) against a
+ * running server.
+ *
+ * Usage: log_replay [-H host] [-p port] [-c connections] [-s speed|max]
+ *                   [-n max_requests] [-t timeout_s] access.log
+ *
+ * Each line "[ctime] ip \"METHOD path\" status" becomes one request on its
+ * own connection. With -s 1 (the default) requests go out at their original
+ * offsets from the first line; -s 4 replays four times faster and -s max
+ * sends as fast as the connections allow. The log has one-second
+ * timestamps, so requests logged in the same second are spread evenly over
+ * it. Bodies are not logged: POST requests are sent with an empty body.
+ *
+ * Reports throughput, latency percentiles and the requests whose status
+ * differs from the logged one. In timed modes latency counts from the
+ * scheduled send time, so a replay that falls behind shows it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MAX_CONNECTIONS 1024
+#define MAX_MISMATCH_KINDS 32
+#define LINE_SIZE 1024
+
+typedef struct {
+    char method[8];
+    char path[512];
+    int logged_status;
+    double offset;         // Seconds after the first request, before scaling
+    double latency_ms;     // -1 when the request failed
+    int status;            // 0 when no status line came back
+    int timed_out;
+    size_t bytes;
+} ReplayRequest;
+
+typedef struct {
+    int logged;
+    int got;
+    unsigned long count;
+    char example[128];
+} MismatchKind;
+
+static ReplayRequest *requests;
+static size_t request_count;
+static size_t next_request;
+
+static struct addrinfo *server_addr;
+static char host_header[300];
+static double speed = 1;          // 0 replays at maximum rate
+static int timeout_s = 10;
+static double start_time;
+static double max_lag;            // Largest delay behind schedule, seconds
+static pthread_mutex_t lag_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Parses one log line. Returns 0 and fills request (offset holding the
+ * absolute timestamp) on success.
+ */
+static int parse_line(const char *line, ReplayRequest *request, time_t *timestamp) {
+    const char *close_bracket = strchr(line, ']');
+    if (line[0] != '[' || !close_bracket) return -1;
+
+    char time_str[64];
+    size_t time_len = close_bracket - line - 1;
+    if (time_len >= sizeof(time_str)) return -1;
+    memcpy(time_str, line + 1, time_len);
+    time_str[time_len] = '\0';
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(time_str, "%a %b %d %H:%M:%S %Y", &tm)) return -1;
+    tm.tm_isdst = -1;
+    *timestamp = mktime(&tm);
+
+    const char *quote = strchr(close_bracket, '"');
+    if (!quote) return -1;
+    int status;
+    if (sscanf(quote, "\"%7s %511[^\"]\" %d", request->method, request->path, &status) != 3) return -1;
+    request->logged_status = status;
+    return 0;
+}
+
+/**
+ * Loads the log. Requests logged in the same second get evenly spaced
+ * offsets inside it.
+ */
+static int load_log(const char *file, size_t limit, size_t *skipped) {
+    FILE *fp = fopen(file, "r");
+    if (!fp) {
+        perror(file);
+        return -1;
+    }
+
+    size_t cap = 1024;
+    requests = malloc(cap * sizeof(ReplayRequest));
+    time_t *seconds = malloc(cap * sizeof(time_t));
+    if (!requests || !seconds) return -1;
+
+    char line[LINE_SIZE];
+    while (fgets(line, sizeof(line), fp) && (limit == 0 || request_count < limit)) {
+        ReplayRequest request;
+        memset(&request, 0, sizeof(request));
+        time_t timestamp;
+        if (parse_line(line, &request, &timestamp) < 0) {
+            (*skipped)++;
+            continue;
+        }
+        if (request_count == cap) {
+            cap *= 2;
+            requests = realloc(requests, cap * sizeof(ReplayRequest));
+            seconds = realloc(seconds, cap * sizeof(time_t));
+            if (!requests || !seconds) return -1;
+        }
+        seconds[request_count] = timestamp;
+        requests[request_count++] = request;
+    }
+    fclose(fp);
+
+    for (size_t i = 0; i < request_count; ) {
+        size_t same = i;
+        while (same < request_count && seconds[same] == seconds[i]) same++;
+        for (size_t j = i; j < same; j++) {
+            requests[j].offset = difftime(seconds[j], seconds[0]) + (double)(j - i) / (same - i);
+        }
+        i = same;
+    }
+    free(seconds);
+    return 0;
+}
+
+/**
+ * Sends one request on a fresh connection and reads the response to EOF
+ */
+static void send_request(ReplayRequest *request, double scheduled) {
+    double sent_at = now_s();
+    double measured_from = speed > 0 ? scheduled : sent_at;
+    request->latency_ms = -1;
+
+    int fd = socket(server_addr->ai_family, SOCK_STREAM, 0);
+    if (fd < 0) return;
+    struct timeval tv = { timeout_s, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, server_addr->ai_addr, server_addr->ai_addrlen) < 0) {
+        close(fd);
+        return;
+    }
+
+    char buffer[8192];
+    int is_post = strcmp(request->method, "POST") == 0 || strcmp(request->method, "PUT") == 0;
+    int len = snprintf(buffer, sizeof(buffer),
+                       "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: log_replay\r\n%sConnection: close\r\n\r\n",
+                       request->method, request->path, host_header, is_post ? "Content-Length: 0\r\n" : "");
+    if (send(fd, buffer, len, MSG_NOSIGNAL) != len) {
+        close(fd);
+        return;
+    }
+
+    // Streams (SSE, WebSocket) never end on their own: give up on any
+    // response still arriving after the timeout
+    size_t total = 0;
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer) - 1, 0)) > 0) {
+        if (total == 0) {
+            buffer[n] = '\0';
+            sscanf(buffer, "HTTP/1.%*d %d", &request->status);
+        }
+        total += n;
+        if (now_s() - sent_at > timeout_s) break;
+    }
+    close(fd);
+    if (n != 0 || total == 0) {
+        request->timed_out = n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+        return;
+    }
+
+    request->bytes = total;
+    request->latency_ms = (now_s() - measured_from) * 1000;
+}
+
+static void *replay_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        size_t index = __atomic_fetch_add(&next_request, 1, __ATOMIC_RELAXED);
+        if (index >= request_count) break;
+        ReplayRequest *request = &requests[index];
+
+        double scheduled = start_time;
+        if (speed > 0) {
+            scheduled += request->offset / speed;
+            double wait = scheduled - now_s();
+            if (wait > 0) {
+                struct timespec pause = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+                nanosleep(&pause, NULL);
+            } else if (-wait > max_lag) {
+                pthread_mutex_lock(&lag_lock);
+                if (-wait > max_lag) max_lag = -wait;
+                pthread_mutex_unlock(&lag_lock);
+            }
+        }
+        send_request(request, scheduled);
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, size_t count, double p) {
+    if (count == 0) return 0;
+    size_t index = (size_t)(p / 100 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void report(double elapsed) {
+    double *latencies = malloc((request_count + 1) * sizeof(double));
+    size_t done = 0, failed = 0, timed_out = 0, bytes = 0;
+    MismatchKind kinds[MAX_MISMATCH_KINDS];
+    int kind_count = 0;
+    unsigned long mismatches = 0;
+
+    for (size_t i = 0; i < request_count; i++) {
+        ReplayRequest *request = &requests[i];
+        if (request->latency_ms < 0) {
+            failed++;
+            if (request->timed_out) timed_out++;
+            continue;
+        }
+        latencies[done++] = request->latency_ms;
+        bytes += request->bytes;
+        if (request->status == request->logged_status) continue;
+
+        mismatches++;
+        int k = 0;
+        while (k < kind_count && (kinds[k].logged != request->logged_status || kinds[k].got != request->status)) k++;
+        if (k == kind_count && kind_count < MAX_MISMATCH_KINDS) {
+            kinds[k].logged = request->logged_status;
+            kinds[k].got = request->status;
+            kinds[k].count = 0;
+            snprintf(kinds[k].example, sizeof(kinds[k].example), "%.7s %.100s", request->method, request->path);
+            kind_count++;
+        }
+        if (k < kind_count) kinds[k].count++;
+    }
+    qsort(latencies, done, sizeof(double), compare_double);
+
+    printf("Replayed %zu requests in %.2f s (%s)\n", request_count, elapsed,
+           speed > 0 ? "timed" : "max rate");
+    printf("  completed   %zu, failed %zu (%zu timed out)\n", done, failed, timed_out);
+    printf("  throughput  %.1f req/s, %.1f KB/s\n", done / elapsed, bytes / 1024.0 / elapsed);
+    printf("  latency ms  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+           percentile(latencies, done, 50), percentile(latencies, done, 90),
+           percentile(latencies, done, 99), percentile(latencies, done, 99.9),
+           done ? latencies[done - 1] : 0);
+    if (speed > 0) printf("  schedule    fell up to %.1f ms behind\n", max_lag * 1000);
+    printf("  status      %lu of %zu differ from the log\n", mismatches, done);
+    for (int k = 0; k < kind_count; k++) {
+        printf("    %d -> %d  x%lu  (e.g. %s)\n", kinds[k].logged, kinds[k].got, kinds[k].count, kinds[k].example);
+    }
+    free(latencies);
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    const char *port = "8080";
+    int connections = 8;
+    size_t limit = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:c:s:n:t:")) != -1) {
+        switch (opt) {
+            case 'H': host = optarg; break;
+            case 'p': port = optarg; break;
+            case 'c': connections = atoi(optarg); break;
+            case 's': speed = strcmp(optarg, "max") == 0 ? 0 : atof(optarg); break;
+            case 'n': limit = strtoul(optarg, NULL, 10); break;
+            case 't': timeout_s = atoi(optarg); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1 || connections < 1 || connections > MAX_CONNECTIONS || speed < 0 || timeout_s < 1) {
+        fprintf(stderr, "Usage: %s [-H host] [-p port] [-c connections] [-s speed|max] [-n max_requests] [-t timeout_s] access.log\n",
+                argv[0]);
+        return 1;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    int error = getaddrinfo(host, port, &hints, &server_addr);
+    if (error != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(error));
+        return 1;
+    }
+    snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
+
+    size_t skipped = 0;
+    if (load_log(argv[optind], limit, &skipped) < 0) return 1;
+    if (skipped > 0) fprintf(stderr, "Skipped %zu unparsable lines\n", skipped);
+    if (request_count == 0) {
+        fprintf(stderr, "No requests in %s\n", argv[optind]);
+        return 1;
+    }
+
+    pthread_t threads[MAX_CONNECTIONS];
+    start_time = now_s();
+    for (int i = 0; i < connections; i++) {
+        pthread_create(&threads[i], NULL, replay_thread, NULL);
+    }
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    report(now_s() - start_time);
+
+    freeaddrinfo(server_addr);
+    free(requests);
+    return 0;
+}
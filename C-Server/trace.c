@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+// One timed phase of a sampled request
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint32_t request;   // Sample number, shared by the phases of one request
+    uint32_t tid;
+    uint32_t phase;
+} TraceEvent;
+
+// Single-writer event ring. The owning thread fills a slot and then
+// publishes it by advancing head; readers never block it.
+typedef struct TraceRing {
+    unsigned long head;  // Events written so far
+    int in_use;          // Owned by a live thread
+    struct TraceRing *next;
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static const char *phase_names[TRACE_PHASE_COUNT] = {
+    "accept", "recv", "parse", "dispatch", "handler", "send"
+};
+
+static unsigned int sample_every;   // 0 disables sampling
+static unsigned long sample_counter;
+static double cycles_per_us = 1.0;
+static uint64_t base_cycles;
+
+static TraceRing *rings = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread TraceRing *thread_ring = NULL;
+static __thread uint32_t thread_request;
+static __thread uint32_t thread_tid;
+__thread int trace_sampled = 0;
+
+/**
+ * Enables sampling of every Nth request and calibrates the cycle counter
+ * against the monotonic clock
+ */
+void trace_init(unsigned int every) {
+    sample_every = every;
+    if (every == 0) return;
+
+    struct timespec start, end, pause = { 0, 20000000 };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_cycles = trace_cycles();
+    nanosleep(&pause, NULL);
+    uint64_t end_cycles = trace_cycles();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+    if (elapsed_us > 0 && end_cycles > start_cycles) {
+        cycles_per_us = (end_cycles - start_cycles) / elapsed_us;
+    }
+    base_cycles = start_cycles;
+}
+
+/**
+ * Decides whether the calling thread's next request is sampled
+ */
+void trace_request_start(void) {
+    if (sample_every == 0) {
+        trace_sampled = 0;
+        return;
+    }
+    unsigned long n = __atomic_add_fetch(&sample_counter, 1, __ATOMIC_RELAXED);
+    trace_sampled = n % sample_every == 0;
+    thread_request = (uint32_t)n;
+}
+
+/**
+ * Thread exit: the ring keeps its events and goes to the next thread
+ */
+static void release_ring(void *arg) {
+    TraceRing *ring = arg;
+    __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+/**
+ * Returns the calling thread's ring, reusing one left by an exited thread
+ */
+static TraceRing* get_ring(void) {
+    if (thread_ring) return thread_ring;
+    pthread_once(&ring_key_once, create_ring_key);
+
+    TraceRing *ring;
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&ring->in_use, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!ring) {
+        ring = calloc(1, sizeof(TraceRing));
+        if (!ring) return NULL;
+        ring->in_use = 1;
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+    thread_tid = (uint32_t)syscall(SYS_gettid);
+    return ring;
+}
+
+/**
+ * Appends a timed phase to the calling thread's ring
+ */
+void trace_record(TracePhase phase, uint64_t start, uint64_t end) {
+    TraceRing *ring = get_ring();
+    if (!ring) return;
+
+    unsigned long head = ring->head;
+    TraceEvent *event = &ring->events[head % TRACE_RING_SIZE];
+    event->start = start;
+    event->end = end;
+    event->request = thread_request;
+    event->tid = thread_tid;
+    event->phase = phase;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Writes every ring as Chrome trace JSON (chrome://tracing, Perfetto,
+ * speedscope). Slots a writer overwrote while they were copied are dropped.
+ */
+int trace_dump_json(ByteBuffer *out) {
+    TraceEvent *copy = malloc(sizeof(TraceEvent) * TRACE_RING_SIZE);
+    if (!copy) return -1;
+
+    char line[256];
+    int len = snprintf(line, sizeof(line),
+                       "{\"otherData\":{\"sample_every\":%u,\"cycles_per_us\":%.3f},"
+                       "\"displayTimeUnit\":\"ns\",\"traceEvents\":[",
+                       sample_every, cycles_per_us);
+    int result = buffer_append(out, line, len);
+    int first = 1;
+    pid_t pid = getpid();
+
+    for (TraceRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring && result == 0; ring = ring->next) {
+        unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (unsigned long i = start; i < head; i++) {
+            copy[i - start] = ring->events[i % TRACE_RING_SIZE];
+        }
+        unsigned long now = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long valid = now > TRACE_RING_SIZE ? now - TRACE_RING_SIZE : 0;
+
+        for (unsigned long i = start > valid ? start : valid; i < head && result == 0; i++) {
+            TraceEvent *event = &copy[i - start];
+            if (event->phase >= TRACE_PHASE_COUNT || event->end < event->start) continue;
+            len = snprintf(line, sizeof(line),
+                           "%s{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                           "\"pid\":%d,\"tid\":%u,\"args\":{\"request\":%u}}",
+                           first ? "" : ",", phase_names[event->phase],
+                           (double)(int64_t)(event->start - base_cycles) / cycles_per_us,
+                           (event->end - event->start) / cycles_per_us,
+                           (int)pid, event->tid, event->request);
+            result = buffer_append(out, line, len);
+            first = 0;
+        }
+    }
+
+    free(copy);
+    if (result == 0) result = buffer_append(out, "]}\n", 3);
+    return result;
+}
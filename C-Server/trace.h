@@ -0,0 +1,102 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "Http_server.h"
+
+#define TRACE_RING_SIZE 4096  // Events kept per thread ring
+
+/*
+ * Static tracepoints. With <sys/sdt.h> available these are the standard
+ * SystemTap probes; otherwise the same .note.stapsdt entries are emitted
+ * here, so bpftrace/perf/stap can attach to usdt:./server:c_server:<name>
+ * either way. A probe is a single nop when nothing is attached.
+ * Build with -DNO_TRACE_PROBES to leave them out.
+ */
+#if !defined(NO_TRACE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_PROBE(name) DTRACE_PROBE(c_server, name)
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(c_server, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(c_server, name, a, b)
+#elif defined(__x86_64__) || defined(__aarch64__)
+#define TRACE_SDT_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"c_server\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+#define TRACE_PROBE(name) __asm__ __volatile__(TRACE_SDT_NOTE(name, ""))
+#define TRACE_PROBE1(name, a) \
+    __asm__ __volatile__(TRACE_SDT_NOTE(name, "-8@%0") :: "nor"((long)(a)))
+#define TRACE_PROBE2(name, a, b) \
+    __asm__ __volatile__(TRACE_SDT_NOTE(name, "-8@%0 -8@%1") :: "nor"((long)(a)), "nor"((long)(b)))
+#endif
+#endif
+
+#ifndef TRACE_PROBE
+#define TRACE_PROBE(name) do { } while (0)
+#define TRACE_PROBE1(name, a) do { (void)(a); } while (0)
+#define TRACE_PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#endif
+
+// Request phases timed by the sampling tracer
+typedef enum {
+    TRACE_ACCEPT = 0,   // accept() until the connection's thread runs
+    TRACE_RECV,
+    TRACE_PARSE,
+    TRACE_DISPATCH,     // Route lookup
+    TRACE_HANDLER,
+    TRACE_SEND,         // Final flush of the response
+    TRACE_PHASE_COUNT
+} TracePhase;
+
+extern __thread int trace_sampled;
+
+/**
+ * Cycle counter used for phase timings
+ */
+static inline uint64_t trace_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t low, high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Phase timing that costs one branch when the request is not sampled
+#define TRACE_SPAN_START(var) uint64_t var = trace_sampled ? trace_cycles() : 0
+#define TRACE_SPAN_END(phase, var) \
+    do { if (trace_sampled) trace_record((phase), (var), trace_cycles()); } while (0)
+
+void trace_init(unsigned int sample_every);
+void trace_request_start(void);
+void trace_record(TracePhase phase, uint64_t start, uint64_t end);
+int trace_dump_json(ByteBuffer *out);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "unixsock.h"
+
+// Filesystem sockets to remove when the process that bound them exits
+static char bound_paths[MAX_UNIX_LISTENERS][sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int path_count = 0;
+static int listener_count = 0;    // Filesystem and abstract sockets
+static int registered = 0;        // remove_sockets() is set to run at exit
+static pid_t bound_by = 0;
+
+static void remove_sockets(void) {
+    // Forked workers exit through here too, but the socket is the master's
+    if (getpid() != bound_by) return;
+    for (int i = 0; i < path_count; i++) {
+        unlink(bound_paths[i]);
+    }
+}
+
+/**
+ * Removes a socket file left behind by a server that did not exit
+ * cleanly. A path that is not a socket, or that someone still accepts
+ * on, is left alone and the bind fails.
+ */
+static void remove_stale(const struct sockaddr_un *addr, socklen_t len) {
+    struct stat st;
+    if (stat(addr->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode)) return;
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return;
+    if (connect(probe, (const struct sockaddr *)addr, len) < 0 && errno == ECONNREFUSED) {
+        unlink(addr->sun_path);
+    }
+    close(probe);
+}
+
+/**
+ * Creates a non-blocking listening Unix domain socket. A spec starting
+ * with '@' names a socket in the abstract namespace, which needs no file
+ * and disappears with the last descriptor; anything else is a filesystem
+ * path, created with UNIX_SOCKET_MODE and removed again at exit. Returns
+ * the socket, or -1 with errno set.
+ */
+int unixsock_listen(const char *spec, int backlog) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    int abstract = spec[0] == '@';
+    size_t name_len = strlen(spec);
+    if (name_len == (size_t)abstract || name_len >= sizeof(addr.sun_path) || listener_count >= MAX_UNIX_LISTENERS) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Abstract names start with a NUL byte and run to the end of the
+    // address, so the length must not include any padding
+    memcpy(addr.sun_path, spec, name_len);
+    if (abstract) addr.sun_path[0] = '\0';
+    socklen_t len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + name_len + !abstract);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    if (!abstract) {
+        remove_stale(&addr, len);
+        // Sockets are created with the umask applied; narrow it for bind()
+        mode_t old_mask = umask(0777 & ~UNIX_SOCKET_MODE);
+        int result = bind(fd, (struct sockaddr *)&addr, len);
+        umask(old_mask);
+        if (result < 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        if (!registered) {
+            bound_by = getpid();
+            atexit(remove_sockets);
+            registered = 1;
+        }
+        snprintf(bound_paths[path_count++], sizeof(bound_paths[0]), "%s", spec);
+    } else if (bind(fd, (struct sockaddr *)&addr, len) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    listener_count++;
+
+    if (listen(fd, backlog) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Describes the process on the other end of a Unix domain connection for
+ * the logs, from the credentials the kernel recorded at connect()
+ */
+void unixsock_peer(int fd, char *label, size_t size) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        snprintf(label, size, "unix");
+        return;
+    }
+    snprintf(label, size, "unix:pid=%d,uid=%u", (int)cred.pid, (unsigned)cred.uid);
+}
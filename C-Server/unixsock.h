@@ -0,0 +1,12 @@
+#ifndef UNIXSOCK_H
+#define UNIXSOCK_H
+
+#include <stddef.h>
+
+#define MAX_UNIX_LISTENERS 4     // -U may be given this many times
+#define UNIX_SOCKET_MODE 0660    // Filesystem sockets: owner and group may connect
+
+int unixsock_listen(const char *spec, int backlog);
+void unixsock_peer(int fd, char *label, size_t size);
+
+#endif